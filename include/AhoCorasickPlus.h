@@ -57,7 +57,7 @@ public:
     
 public:
     
-    AhoCorasickPlus();
+    AhoCorasickPlus(bool fold_case = false);
     ~AhoCorasickPlus();
     
     EnumReturnStatus addPattern (const std::string &pattern, PatternId id);
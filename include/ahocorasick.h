@@ -46,6 +46,10 @@ typedef struct ac_trie
     
     struct mpool *mp;   /**< Memory pool */
     
+    AC_ALPHABET_t alphabet_map[256]; /**< Maps input and pattern alphabets
+                                      * before the transition lookup. Identity
+                                      * by default, see ac_trie_fold_case() */
+    
     /* ******************* Thread specific part ******************** */
     
     /* It is possible to search a long input chunk by chunk. In order to
@@ -72,6 +76,7 @@ typedef struct ac_trie
 
 AC_TRIE_t *ac_trie_create (void);
 AC_STATUS_t ac_trie_add (AC_TRIE_t *thiz, AC_PATTERN_t *patt, int copy);
+void ac_trie_fold_case (AC_TRIE_t *thiz);
 void ac_trie_finalize (AC_TRIE_t *thiz);
 void ac_trie_release (AC_TRIE_t *thiz);
 void ac_trie_display (AC_TRIE_t *thiz);
@@ -0,0 +1,152 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <string>
+
+/*
+ * Формат журнала блокировок: заголовок block_log_header, затем записи block_event фиксированного размера.
+ * Числа в порядке байт хоста, адреса в сетевом порядке. Файл читается утилитой extfilter-blocklog.
+*/
+
+#define BLOCK_LOG_MAGIC "EXTFBLK" // 8 байт с завершающим нулем
+#define BLOCK_LOG_VERSION 1
+
+/// Список, по которому заблокировано соединение
+enum block_list
+{
+	B_LIST_IP_PORT = 1,
+	B_LIST_LEARNED,
+	B_LIST_SSL,
+	B_LIST_SSL_IP,
+	B_LIST_DOMAIN,
+	B_LIST_URL
+};
+
+enum block_action
+{
+	B_ACTION_RST = 1,
+	B_ACTION_REDIRECT
+};
+
+struct block_log_header
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t record_size; // sizeof(block_event)
+};
+
+struct block_event
+{
+	uint64_t time; // в кольце worker'а tsc, в файле микросекунды от начала эпохи
+	uint8_t src_ip[16]; // клиент
+	uint8_t dst_ip[16];
+	uint16_t src_port;
+	uint16_t dst_port;
+	uint8_t ip_version;
+	uint8_t protocol;
+	uint8_t list; // enum block_list
+	uint8_t action; // enum block_action
+	uint32_t lineno; // строка записи в файле списка, 0 - нет (ip:port, ssl ip)
+	uint16_t profile;
+	uint16_t worker;
+	uint32_t reserved[2];
+};
+
+static_assert(sizeof(struct block_event) == 64, "block_event must fill one cache line");
+
+static inline const char *blockListName(uint8_t list)
+{
+	switch(list)
+	{
+		case B_LIST_IP_PORT: return "ip_port";
+		case B_LIST_LEARNED: return "learned";
+		case B_LIST_SSL: return "ssl";
+		case B_LIST_SSL_IP: return "ssl_ip";
+		case B_LIST_DOMAIN: return "domain";
+		case B_LIST_URL: return "url";
+		default: return "unknown";
+	}
+}
+
+static inline const char *blockActionName(uint8_t action)
+{
+	switch(action)
+	{
+		case B_ACTION_RST: return "rst";
+		case B_ACTION_REDIRECT: return "redirect";
+		default: return "unknown";
+	}
+}
+
+/// Header of the new block log file.
+static inline void blockLogInitHeader(struct block_log_header &header)
+{
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, BLOCK_LOG_MAGIC, sizeof(header.magic));
+	header.version = BLOCK_LOG_VERSION;
+	header.record_size = sizeof(struct block_event);
+}
+
+enum block_log_header_status
+{
+	B_HEADER_OK = 0,
+	B_HEADER_NOT_LOG, // не журнал блокировок
+	B_HEADER_UNSUPPORTED // другая версия или размер записи
+};
+
+static inline block_log_header_status blockLogCheckHeader(const struct block_log_header &header)
+{
+	if(memcmp(header.magic, BLOCK_LOG_MAGIC, sizeof(header.magic)) != 0)
+		return B_HEADER_NOT_LOG;
+	if(header.version != BLOCK_LOG_VERSION || header.record_size != sizeof(struct block_event))
+		return B_HEADER_UNSUPPORTED;
+	return B_HEADER_OK;
+}
+
+/// Text of the record from the file as printed by extfilter-blocklog, without the line end.
+static inline std::string blockEventText(const struct block_event &ev)
+{
+	std::string addr[2];
+	const uint8_t *ips[2] = { ev.src_ip, ev.dst_ip };
+	for(int i = 0; i < 2; i++)
+	{
+		char buf[INET6_ADDRSTRLEN];
+		if(inet_ntop(ev.ip_version == 4 ? AF_INET : AF_INET6, ips[i], buf, sizeof(buf)) == nullptr)
+			addr[i] = "?";
+		else
+			addr[i] = (ev.ip_version == 4) ? std::string(buf) : "[" + std::string(buf) + "]";
+	}
+	time_t sec = ev.time / 1000000;
+	struct tm tm;
+	char date[32];
+	gmtime_r(&sec, &tm);
+	strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &tm);
+	char usec[8];
+	snprintf(usec, sizeof(usec), ".%06u", (unsigned int)(ev.time % 1000000));
+	return std::string(date) + usec + " worker " + std::to_string(ev.worker) + " profile " + std::to_string(ev.profile) + " " +
+		addr[0] + ":" + std::to_string(ev.src_port) + " -> " + addr[1] + ":" + std::to_string(ev.dst_port) +
+		" list " + blockListName(ev.list) + " line " + std::to_string(ev.lineno) + " action " + blockActionName(ev.action);
+}
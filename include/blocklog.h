@@ -0,0 +1,69 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <Poco/Task.h>
+#include <Poco/Logger.h>
+#include <Poco/FileStream.h>
+#include "blockevent.h"
+#include "spscring.h"
+#include "tscclock.h"
+
+#define BLOCK_LOG_RING_SIZE 4096 // записей в кольце worker'а по умолчанию
+#define BLOCK_LOG_BATCH 256 // записей из одного кольца за проход
+#define BLOCK_LOG_IDLE_SLEEP 10000 // us, пауза, если все кольца пусты
+
+/// Записи о блокировках от одного worker'а к BlockLogWriter
+typedef SpscRing<block_event> BlockEventRing;
+
+/// Данная задача дописывает записи о блокировках из колец worker'ов в двоичные файлы с ротацией по размеру
+class BlockLogWriter: public Poco::Task
+{
+public:
+	/// path - prefix of the file names. file_size - bytes in one file before the rotation. files - number of the kept files, 0 - keep all.
+	BlockLogWriter(const std::vector<BlockEventRing *> &rings, const std::string &path, uint64_t file_size, int files);
+	~BlockLogWriter();
+
+	void runTask();
+
+private:
+	/// One pass over the rings, returns the number of the written records.
+	size_t poll();
+	bool open();
+	void close();
+
+	std::vector<BlockEventRing *> _rings;
+	std::string _path;
+	uint64_t _file_size;
+	size_t _files;
+	std::unique_ptr<Poco::FileOutputStream> _os;
+	uint64_t _file_bytes;
+	uint32_t _file_seq;
+	std::deque<std::string> _names; // записанные файлы, старые удаляются
+	std::vector<block_event> _batch;
+	TscClock _clock;
+	uint64_t _events;
+	Poco::Logger& _logger;
+};
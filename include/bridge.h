@@ -0,0 +1,74 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <rte_config.h>
+#include <rte_mbuf.h>
+#include <rte_ethdev.h>
+
+#define BRIDGE_BURST_SIZE 32 // пакетов в буфере отправки, отправляются пачкой
+
+/*
+ * Пересылка пакетов между двумя dpdk портами в режиме разрыва (inline).
+ * Пакет, принятый на одном порту, без копирования уходит в другой порт через буфер передачи.
+ * Каждый worker и reader имеют свой экземпляр со своей очередью передачи на обоих портах, поэтому блокировки не нужны.
+*/
+class BridgeForwarder
+{
+public:
+	BridgeForwarder(uint8_t port_a, uint8_t port_b, uint16_t queue);
+	~BridgeForwarder();
+
+	/// Send the packet to the other port of the pair. The mbuf belongs to the bridge after the call.
+	inline void forward(struct rte_mbuf *m)
+	{
+		int out = (m->port == _ports[0]) ? 1 : 0;
+		_forwarded += rte_eth_tx_buffer(_ports[out], _queue, _buffers[out], m);
+	}
+
+	/// Send the buffered packets.
+	inline void flush()
+	{
+		for(int i = 0; i < 2; i++)
+		{
+			if(_buffers[i]->length)
+				_forwarded += rte_eth_tx_buffer_flush(_ports[i], _queue, _buffers[i]);
+		}
+	}
+
+	inline uint64_t forwarded() const
+	{
+		return _forwarded;
+	}
+
+	/// Packets dropped by the full tx queue.
+	inline uint64_t dropped() const
+	{
+		return _dropped;
+	}
+
+private:
+	uint8_t _ports[2];
+	uint16_t _queue;
+	struct rte_eth_dev_tx_buffer *_buffers[2];
+	uint64_t _forwarded;
+	uint64_t _dropped;
+};
@@ -0,0 +1,115 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <pcap.h>
+#include <Poco/Task.h>
+#include <Poco/Logger.h>
+#include "spscring.h"
+#include "tscclock.h"
+
+#define CAPTURE_SNAPLEN 1600 // байт пакета в записи, остаток не сохраняется
+#define CAPTURE_RING_SIZE 512 // записей в кольце worker'а по умолчанию
+#define CAPTURE_BATCH 64 // записей из одного кольца за проход
+#define CAPTURE_IDLE_SLEEP 10000 // us, пауза, если все кольца пусты
+
+/// Копия пакета, вызвавшего блокировку
+struct capture_record
+{
+	uint64_t timestamp; // tsc получения пакета worker'ом
+	uint32_t caplen;
+	uint32_t len;
+	uint8_t data[CAPTURE_SNAPLEN];
+};
+
+/// Пакеты от одного worker'а к PcapWriter
+typedef SpscRing<capture_record> CaptureRing;
+
+/*
+ * Ограничение байт, копируемых worker'ом в кольцо захвата, в секунду (token bucket в форме GCRA, как в InjectLimiter).
+ * Копирование сверх лимита пропускается, поэтому захват не может замедлить обработку трафика.
+*/
+class CaptureBudget
+{
+public:
+	/// rate - bytes per second, 0 - capture is disabled. burst - bytes allowed at once.
+	CaptureBudget(uint64_t rate, uint64_t burst, uint64_t tsc_hz) :
+		_rate(rate),
+		_tsc_hz(tsc_hz),
+		_tolerance(rate ? burst * tsc_hz / rate : 0),
+		_tat(0)
+	{
+	}
+
+	/// now - tsc.
+	inline bool take(uint32_t bytes, uint64_t now)
+	{
+		if(!_rate)
+			return false;
+		if(_tat < now)
+			_tat = now;
+		uint64_t cost = bytes * _tsc_hz / _rate;
+		// пакет больше burst проходит только при полном бюджете
+		if(_tat > now && _tat - now + cost > _tolerance)
+			return false;
+		_tat += cost;
+		return true;
+	}
+
+private:
+	uint64_t _rate;
+	uint64_t _tsc_hz;
+	uint64_t _tolerance;
+	uint64_t _tat; // теоретическое время, когда бюджет снова полон, tsc
+};
+
+/// Данная задача пишет пакеты из колец захвата worker'ов в pcap файлы с ротацией по размеру
+class PcapWriter: public Poco::Task
+{
+public:
+	/// path - prefix of the file names. file_size - bytes in one file before the rotation. files - number of the kept files, 0 - keep all.
+	PcapWriter(const std::vector<CaptureRing *> &rings, const std::string &path, uint64_t file_size, int files);
+	~PcapWriter();
+
+	void runTask();
+
+private:
+	/// One pass over the rings, returns the number of the written packets.
+	size_t poll();
+	bool open();
+	void close();
+
+	std::vector<CaptureRing *> _rings;
+	std::string _path;
+	uint64_t _file_size;
+	size_t _files;
+	pcap_t *_pcap;
+	pcap_dumper_t *_dumper;
+	uint64_t _file_bytes;
+	uint32_t _file_seq;
+	std::deque<std::string> _names; // записанные файлы, старые удаляются
+	TscClock _clock; // время для заголовков пакетов
+	uint64_t _packets;
+	Poco::Logger& _logger;
+};
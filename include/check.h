@@ -0,0 +1,51 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#pragma once
+
+#include <iostream>
+#include <string>
+
+/*
+ * Общая часть программ проверки, которые собираются и запускаются по make check.
+ * Каждая программа - один файл, поэтому счетчик можно держать в заголовке.
+*/
+
+static int check_failures = 0;
+
+static inline void expect(bool ok, const std::string &what)
+{
+	if(!ok)
+	{
+		check_failures++;
+		std::cerr << "FAILED: " << what << std::endl;
+	}
+}
+
+/// Exit code of the check program: 1 if at least one check failed.
+static inline int checkResult()
+{
+	if(check_failures)
+	{
+		std::cerr << check_failures << " checks failed" << std::endl;
+		return 1;
+	}
+	std::cout << "All checks passed" << std::endl;
+	return 0;
+}
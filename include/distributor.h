@@ -1,6 +1,9 @@
 
 #pragma once
 
+#include <stdint.h>
+#include <atomic>
+#include <memory>
 #include <rte_distributor.h>
 
 
@@ -18,7 +21,31 @@ public:
 	{
 		rte_distributor_flush(distr);
 	}
+
+	/// Worker: count the processed packet. Used to find the backlog of the workers.
+	inline void done(unsigned worker_id)
+	{
+		std::atomic<uint64_t> &c = _done[worker_id].value;
+		c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+	/// Reader: packets given to the workers and not processed yet, enqueued - packets given by the reader.
+	inline uint64_t backlog(uint64_t enqueued) const
+	{
+		uint64_t done = 0;
+		for(unsigned i = 0; i < _num_workers; i++)
+			done += _done[i].value.load(std::memory_order_relaxed);
+		return enqueued > done ? enqueued - done : 0;
+	}
 private:
+	// счетчик каждого worker'а в своей строке кэша
+	struct counter
+	{
+		std::atomic<uint64_t> value;
+		char pad[64 - sizeof(std::atomic<uint64_t>)];
+	};
+
 	struct rte_distributor *distr;
 	unsigned _num_workers;
+	std::unique_ptr<counter[]> _done;
 };
\ No newline at end of file
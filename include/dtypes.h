@@ -1,30 +1,215 @@
 #pragma once
 
 #include <Poco/Net/IPAddress.h>
-#include <Poco/HashMap.h>
+#include <Poco/Exception.h>
+#include <stdint.h>
+#include <string.h>
 #include <map>
 #include <set>
 #include <vector>
+#include <memory>
 
-enum entry_types
+#define ENTRIES_IMAGE_MAGIC 0x45444550 // "PEDE"
+
+enum entry_lists : uint8_t
 {
-	E_TYPE_DOMAIN,
-	E_TYPE_URL
+	E_LIST_DOMAINS = 0,
+	E_LIST_URLS,
+	E_LIST_SSL
 };
 
+/*
+ * Флаги шаблона: в каких списках он есть и как совпадает. Один и тот же хост часто есть
+ * и в domainlist, и в ssllist, такой шаблон хранится в индексе один раз с объединением флагов.
+*/
+enum entry_flags : uint8_t
+{
+	E_FLAG_DOMAIN_EXACT = 0x01, // домен из domainlist
+	E_FLAG_DOMAIN_WILDCARD = 0x02, // "*.домен" из domainlist
+	E_FLAG_URL = 0x04, // url из urllist
+	E_FLAG_SSL_EXACT = 0x08, // домен из ssllist
+	E_FLAG_SSL_WILDCARD = 0x10 // "*.домен" из ssllist
+};
+
+#define E_FLAGS_DOMAIN (E_FLAG_DOMAIN_EXACT | E_FLAG_DOMAIN_WILDCARD)
+#define E_FLAGS_HTTP (E_FLAGS_DOMAIN | E_FLAG_URL)
+#define E_FLAGS_SSL (E_FLAG_SSL_EXACT | E_FLAG_SSL_WILDCARD)
+
 struct entry_data
 {
-	uint32_t lineno;
-	entry_types type;
-	bool match_exactly;
+	uint32_t lineno; // строка первого вхождения шаблона
+	uint8_t flags; // entry_flags, 0 - пустая ячейка в EntriesData
+	uint8_t reserved[3];
 };
 
+/*
+ * Метаданные шаблонов, индексированные по id шаблона.
+ * id шаблонов плотные (назначаются при загрузке списков), поэтому вместо хэша
+ * используется обычный массив, поиск - одно обращение по индексу.
+ * При нескольких профилях (profiles.h) для каждого шаблона хранится байт флагов на профиль,
+ * flags в entry_data - их объединение.
+ * Массивы могут лежать в памяти snapshot, тогда EntriesData только читается.
+*/
+class EntriesData
+{
+public:
+	EntriesData() : _data(nullptr), _profile_flags(nullptr), _size(0), _count(0), _profiles(1), _flags(0)
+	{
+	}
+
+	/// Set the number of profiles, must be called before insert().
+	void setProfiles(unsigned profiles)
+	{
+		_profiles = profiles ? profiles : 1;
+	}
+
+	/// Returns false if the id is already occupied.
+	bool insert(uint32_t id, const entry_data &e)
+	{
+		if(id >= _entries.size())
+		{
+			entry_data empty;
+			memset(&empty, 0, sizeof(empty));
+			_entries.resize(id + 1, empty);
+		}
+		if(_entries[id].flags != 0)
+			return false;
+		_entries[id] = e;
+		_count++;
+		_flags |= e.flags;
+		_data = _entries.data();
+		_size = _entries.size();
+		if(_profiles > 1)
+		{
+			_own_profile_flags.resize(_size * _profiles, 0);
+			_profile_flags = _own_profile_flags.data();
+		}
+		return true;
+	}
+
+	/// Set the flags of the inserted entry in every profile (array of profiles() bytes).
+	void setProfileFlags(uint32_t id, const uint8_t *flags)
+	{
+		if(_profiles > 1 && id < _size)
+			memcpy(&_own_profile_flags[(size_t) id * _profiles], flags, _profiles);
+	}
+
+	/// Free the id, e.g. when the pattern turned out to be a duplicate.
+	void remove(uint32_t id)
+	{
+		if(id < _entries.size() && _entries[id].flags != 0)
+		{
+			_entries[id].flags = 0;
+			_count--;
+		}
+	}
 
-typedef Poco::HashMap<unsigned int, struct entry_data> EntriesData;
+	inline const entry_data *find(uint32_t id) const
+	{
+		if(id >= _size || _data[id].flags == 0)
+			return nullptr;
+		return &_data[id];
+	}
 
-typedef Poco::HashMap<unsigned int,bool> DomainsMatchType;
+	/// Flags of the found entry in the profile. Without profiles all entries belong to profile 0.
+	inline uint8_t profileFlags(uint32_t id, unsigned profile) const
+	{
+		if(_profiles <= 1)
+			return _data[id].flags;
+		return _profile_flags[(size_t) id * _profiles + profile];
+	}
+
+	/// Union of the flags of all entries: which lists are present.
+	inline uint8_t flags() const
+	{
+		return _flags;
+	}
+
+	inline unsigned profiles() const
+	{
+		return _profiles;
+	}
+
+	/// Release the unused capacity after loading.
+	void finalize()
+	{
+		_entries.shrink_to_fit();
+		_data = _entries.data();
+		_size = _entries.size();
+		if(_profiles > 1)
+		{
+			_own_profile_flags.resize(_size * _profiles, 0);
+			_own_profile_flags.shrink_to_fit();
+			_profile_flags = _own_profile_flags.data();
+		}
+	}
+
+	inline size_t size() const
+	{
+		return _count;
+	}
+
+	/// Append the image of the entries to out.
+	void serialize(std::string &out) const
+	{
+		image_header h;
+		memset(&h, 0, sizeof(h));
+		h.magic = ENTRIES_IMAGE_MAGIC;
+		h.size = _size;
+		h.count = _count;
+		h.profiles = _profiles > 1 ? _profiles : 0;
+		out.append((const char *) &h, sizeof(h));
+		out.append((const char *) _data, _size * sizeof(entry_data));
+		if(_profiles > 1)
+			out.append((const char *) _profile_flags, _size * _profiles);
+	}
+
+	/// Create the entries over the image made by serialize(). keepalive holds the memory of the image.
+	static EntriesData *fromImage(const void *image, size_t size, std::shared_ptr<const void> keepalive)
+	{
+		const image_header *h = (const image_header *) image;
+		if(size < sizeof(image_header) || h->magic != ENTRIES_IMAGE_MAGIC)
+			throw Poco::Exception("Bad entries image");
+		if(h->size > (size - sizeof(image_header)) / sizeof(entry_data))
+			throw Poco::Exception("Entries image is truncated");
+		size_t profiles = h->profiles > 1 ? h->profiles : 1;
+		size_t rest = size - sizeof(image_header) - h->size * sizeof(entry_data);
+		if(profiles > 1 && (profiles > 256 || h->size * profiles > rest))
+			throw Poco::Exception("Entries image is truncated");
+		EntriesData *ed = new EntriesData();
+		ed->_data = (const entry_data *)((const char *) image + sizeof(image_header));
+		ed->_size = h->size;
+		ed->_count = h->count;
+		ed->_profiles = profiles;
+		if(profiles > 1)
+			ed->_profile_flags = (const uint8_t *) ed->_data + h->size * sizeof(entry_data);
+		ed->_keepalive = keepalive;
+		for(size_t i = 0; i < ed->_size; i++)
+			ed->_flags |= ed->_data[i].flags;
+		return ed;
+	}
+
+private:
+	struct image_header
+	{
+		uint32_t magic;
+		uint32_t size;
+		uint32_t count;
+		uint32_t profiles; // 0 - без профилей
+	};
+
+	std::vector<entry_data> _entries;
+	std::vector<uint8_t> _own_profile_flags;
+	// массивы, по которым идет поиск: собственные или из образа
+	const entry_data *_data;
+	const uint8_t *_profile_flags;
+	size_t _size;
+	size_t _count;
+	unsigned _profiles;
+	uint8_t _flags;
+	std::shared_ptr<const void> _keepalive;
+};
 
-typedef std::map<Poco::Net::IPAddress,std::set<unsigned short>> IPPortMap;
 
 enum ADD_P_TYPES { A_TYPE_NONE, A_TYPE_ID, A_TYPE_URL };
 
@@ -0,0 +1,200 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <memory>
+
+#define FLATAC_NONE 0xffffffff
+#define FLATAC_IMAGE_MAGIC 0x43414c46 // "FLAC"
+
+/*
+ * Автомат Aho-Corasick в виде плоских массивов без указателей: состояния в порядке обхода
+ * в ширину, у каждого состояния непрерывный отсортированный массив переходов, ссылка неудачи
+ * и ссылка на ближайшее состояние с шаблоном по цепочке неудач.
+ * Автомат после finalize() только читается, позиция поиска хранится в Cursor у вызывающего,
+ * поэтому один автомат может использоваться несколькими потоками. Массивы могут лежать
+ * в памяти образа (snapshot), тогда автомат не владеет ими.
+*/
+
+class FlatAC
+{
+public:
+	struct Match
+	{
+		uint32_t position; // позиция за последним символом совпадения
+		uint32_t id;
+		uint32_t length;
+	};
+
+	struct Cursor
+	{
+		const char *text;
+		size_t length;
+		size_t position;
+		uint32_t state;
+		uint32_t output; // состояние, чей шаблон будет выдан следующим
+		const uint8_t *map; // отображение символов текста
+	};
+
+	FlatAC(bool fold_case = false);
+	~FlatAC();
+
+	/// Add pattern. Returns false for the empty pattern or if the automaton is finalized.
+	bool addPattern(const std::string &pattern, uint32_t id);
+
+	/// Build the automaton. Ids of the duplicate patterns (all but the first) are stored in duplicates.
+	void finalize(std::vector<uint32_t> *duplicates = nullptr);
+
+	/// Create the automaton over the image made by serialize(). keepalive holds the memory of the image.
+	/// Throws Poco::Exception if the image is corrupted.
+	static FlatAC *fromImage(const void *image, size_t size, std::shared_ptr<const void> keepalive);
+
+	/// Append the image of the finalized automaton to out.
+	void serialize(std::string &out) const;
+
+	/// fold_case - fold ASCII upper case of the text while searching, patterns must be in lower case to match.
+	/// The automaton itself is not changed, so the same automaton is searched case-sensitively by other callers.
+	inline void search(Cursor &cursor, const char *text, size_t length, bool fold_case = false) const
+	{
+		cursor.text = text;
+		cursor.length = length;
+		cursor.position = 0;
+		cursor.state = 0;
+		cursor.output = FLATAC_NONE;
+		cursor.map = fold_case ? _fold_map : _map;
+	}
+
+	inline bool findNext(Cursor &cursor, Match &match) const
+	{
+		while(true)
+		{
+			if(cursor.output != FLATAC_NONE)
+			{
+				const state &s = _states[cursor.output];
+				match.position = cursor.position;
+				match.id = _patterns[s.pattern].id;
+				match.length = _patterns[s.pattern].length;
+				cursor.output = s.output;
+				return true;
+			}
+			if(cursor.position >= cursor.length || _states_count == 0)
+				return false;
+			uint8_t alpha = cursor.map[(uint8_t) cursor.text[cursor.position++]];
+			uint32_t st = cursor.state;
+			uint32_t next;
+			while((next = step(st, alpha)) == FLATAC_NONE && st != 0)
+				st = _states[st].fail;
+			cursor.state = (next == FLATAC_NONE) ? 0 : next;
+			const state &s = _states[cursor.state];
+			cursor.output = (s.pattern != FLATAC_NONE) ? cursor.state : s.output;
+		}
+	}
+
+	/// Number of the unique patterns.
+	inline size_t size() const
+	{
+		return _unique;
+	}
+
+	inline size_t states() const
+	{
+		return _states_count;
+	}
+
+private:
+	struct state
+	{
+		uint32_t edges_first;
+		uint32_t edges_count;
+		uint32_t fail;
+		uint32_t pattern; // индекс в _patterns или FLATAC_NONE
+		uint32_t output; // следующее состояние с шаблоном по цепочке неудач или FLATAC_NONE
+	};
+
+	struct pattern
+	{
+		uint32_t id;
+		uint32_t length;
+	};
+
+	struct image_header
+	{
+		uint32_t magic;
+		uint32_t states;
+		uint32_t edges;
+		uint32_t patterns;
+		uint32_t unique;
+		uint32_t reserved;
+		uint8_t map[256];
+	};
+
+	inline uint32_t step(uint32_t st, uint8_t alpha) const
+	{
+		if(st == 0)
+			return _root[alpha];
+		const state &s = _states[st];
+		const uint8_t *a = _edge_alpha + s.edges_first;
+		uint32_t lo = 0, hi = s.edges_count;
+		while(lo < hi)
+		{
+			uint32_t mid = (lo + hi) >> 1;
+			if(a[mid] < alpha)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		if(lo < s.edges_count && a[lo] == alpha)
+			return _edge_next[s.edges_first + lo];
+		return FLATAC_NONE;
+	}
+
+	uint32_t buildStep(uint32_t st, uint8_t alpha) const;
+	void setViews();
+	void setFoldMap();
+	static size_t align(size_t size);
+
+	bool _finalized;
+	uint8_t _own_map[256];
+	uint8_t _fold_map[256]; // _map со сложенным регистром для search(fold_case)
+	// данные построения
+	std::vector<char> _pool;
+	std::vector<uint32_t> _offsets;
+	// собственные массивы автомата
+	std::vector<state> _own_states;
+	std::vector<uint8_t> _own_edge_alpha;
+	std::vector<uint32_t> _own_edge_next;
+	std::vector<pattern> _own_patterns;
+	// массивы, по которым идет поиск: собственные или из образа
+	const uint8_t *_map;
+	const state *_states;
+	const uint8_t *_edge_alpha;
+	const uint32_t *_edge_next;
+	const pattern *_patterns;
+	uint32_t _states_count;
+	uint32_t _edges_count;
+	uint32_t _patterns_count;
+	uint32_t _unique;
+	uint32_t _root[256];
+	std::shared_ptr<const void> _keepalive;
+};
@@ -82,6 +82,10 @@ struct ndpi_flow_info
 	uint64_t expire;
 	bool cli2srv_direction;
 	bool block;
+	bool ipport_blocked; // результат поиска в списке ip:port
+	uint32_t ipport_generation; // поколение списка ip:port для ipport_blocked, 0 - поиск не выполнялся
+	uint32_t learned_generation; // поколение списков, с которым сервер искался в выученной таблице, 0 - поиск не выполнялся
+	uint64_t last_inject; // время последнего редиректа или rst в этом соединении, tsc
 	ndpi_flow_info(uint8_t ip_ver, uint64_t l_seen) :
 		hash(0),
 		detection_completed(false),
@@ -94,7 +98,11 @@ struct ndpi_flow_info
 		dst_id(NULL),
 		expire(0),
 		cli2srv_direction(true),
-		block(false)
+		block(false),
+		ipport_blocked(false),
+		ipport_generation(0),
+		learned_generation(0),
+		last_inject(0)
 	{
 	}
 
@@ -110,7 +118,11 @@ struct ndpi_flow_info
 		dst_id(NULL),
 		expire(0),
 		cli2srv_direction(true),
-		block(false)
+		block(false),
+		ipport_blocked(false),
+		ipport_generation(0),
+		learned_generation(0),
+		last_inject(0)
 	{ }
 
 	bool isIdle(uint64_t time)
@@ -0,0 +1,84 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "verdictcache.h"
+
+#ifndef INJECT_LIMITER_SIZE
+#define INJECT_LIMITER_SIZE 4096 // абонентов в таблице одного worker'а, степень 2
+#endif
+
+#if INJECT_LIMITER_SIZE & (INJECT_LIMITER_SIZE - 1)
+#error "INJECT_LIMITER_SIZE must be a power of 2"
+#endif
+
+/*
+ * Ограничение числа редиректов и rst, отправляемых одному абоненту (token bucket).
+ * Ведро хранится как теоретическое время следующей отправки (GCRA): каждая отправка сдвигает его
+ * на интервал 1/rate, отправка разрешена, пока оно опережает текущее время не более чем на burst-1 интервалов.
+ * Таблица с прямым отображением принадлежит одному worker'у, при коллизии ячейка отдается новому абоненту.
+*/
+class InjectLimiter
+{
+public:
+	/// rate - injections per second for one subscriber, 0 - no limit. burst - injections allowed at once.
+	InjectLimiter(uint32_t rate, uint32_t burst, uint64_t tsc_hz) :
+		_interval(rate ? tsc_hz / rate : 0),
+		_tolerance(rate && burst > 1 ? (tsc_hz / rate) * (burst - 1) : 0)
+	{
+		if(rate)
+		{
+			_slots.resize(INJECT_LIMITER_SIZE);
+			memset(_slots.data(), 0, _slots.size() * sizeof(slot));
+		}
+	}
+
+	/// addr - address of the subscriber (4 or 16 bytes), now - tsc.
+	inline bool allow(const void *addr, size_t length, uint64_t now)
+	{
+		if(_slots.empty())
+			return true;
+		uint64_t key = VerdictCache::hash((const char *) addr, length, 0);
+		slot &s = _slots[key & (INJECT_LIMITER_SIZE - 1)];
+		if(s.key != key || s.tat < now)
+		{
+			s.key = key;
+			s.tat = now;
+		}
+		if(s.tat - now > _tolerance)
+			return false;
+		s.tat += _interval;
+		return true;
+	}
+
+private:
+	struct slot
+	{
+		uint64_t key;
+		uint64_t tat; // теоретическое время следующей отправки, tsc
+	};
+
+	uint64_t _interval;
+	uint64_t _tolerance;
+	std::vector<slot> _slots;
+};
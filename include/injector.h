@@ -0,0 +1,102 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <rte_config.h>
+#include <rte_mbuf.h>
+#include <rte_ethdev.h>
+#include "sender.h"
+#include "latencyhistogram.h"
+
+#define INJECT_BURST_SIZE 32 // пакетов в буфере отправки, отправляются пачкой
+#define INJECT_MBUF_CACHE 32
+
+/*
+ * Отправка редиректов и rst через очередь передачи DPDK порта, без raw сокетов и ядра.
+ * Ответ строится из заголовков зеркалированного пакета: L2 (вместе с vlan) копируется с обменом mac,
+ * адреса и порты меняются местами, seq/ack берутся из пакета. Пакеты собираются в буфер
+ * и уходят пачкой при его заполнении или при flush(). Один экземпляр на worker,
+ * у каждого своя очередь передачи, поэтому блокировки не нужны.
+ * Задержка от приема пакета до передачи ответа в очередь порта учитывается так же, как у SenderTask.
+*/
+class PacketInjector
+{
+public:
+	/// hw_cksum - the port calculates the ip and tcp checksums.
+	PacketInjector(uint8_t port, uint16_t queue, struct rte_mempool *pool, const struct CSender::params &prm, bool hw_cksum);
+	~PacketInjector();
+
+	/// Send the redirect to the client of the mirrored packet and rst to the server if configured.
+	/// frame - start of the frame, l3 - its ip header. acknum, seqnum - in the network byte order as in CSender.
+	/// timestamp - tsc of the receipt of the mirrored packet.
+	void redirect(const uint8_t *frame, const uint8_t *l3, int ip_version, uint32_t acknum, uint32_t seqnum, int f_psh, const char *param, size_t param_length, uint64_t timestamp);
+
+	/// Send rst to the client of the mirrored packet and to the server if configured.
+	void reset(const uint8_t *frame, const uint8_t *l3, int ip_version, uint32_t acknum, uint32_t seqnum, uint64_t timestamp);
+
+	/// Send the buffered packets.
+	inline void flush()
+	{
+		if(_buffer->length)
+			_sent += rte_eth_tx_buffer_flush(_port, _queue, _buffer);
+		if(_stamps_count)
+			addLatency();
+	}
+
+	/// Latency from the receipt of the packet to the transmission of the response.
+	inline const LatencyHistogram &latency() const
+	{
+		return _latency;
+	}
+
+	inline uint64_t sent() const
+	{
+		return _sent;
+	}
+
+	/// Packets dropped by the full tx queue or the lack of mbufs.
+	inline uint64_t dropped() const
+	{
+		return _dropped + _no_mbufs;
+	}
+
+private:
+	/// The payload is the redirect response with param if f_reset is 0, empty otherwise.
+	void send(const uint8_t *frame, const uint8_t *l3, int ip_version, bool to_client, uint32_t acknum, uint32_t seqnum, const char *param, size_t param_length, int f_reset, int f_psh);
+	void stamp(uint64_t timestamp);
+	void addLatency();
+
+	uint8_t _port;
+	uint16_t _queue;
+	struct rte_mempool *_pool;
+	struct rte_eth_dev_tx_buffer *_buffer;
+	struct CSender::params _parameters;
+	RedirectTemplate _template;
+	bool _hw_cksum;
+	uint16_t _ip_id;
+	uint64_t _sent;
+	uint64_t _dropped;
+	uint64_t _no_mbufs;
+	LatencyHistogram _latency;
+	uint64_t _stamps[INJECT_BURST_SIZE]; // время приема пакетов, ответы на которые еще в буфере
+	unsigned _stamps_count;
+};
@@ -0,0 +1,169 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <map>
+#include <set>
+#include <vector>
+#include <utility>
+#include <memory>
+
+#define IPPORT_ANY 0x10000 // запись для всех портов или диапазонов адреса
+#define IPPORT_EMPTY_SLOT 0xffffffff
+#define IPPORT_BITMAP_WORDS (65536 / 64)
+#define IPPORT_IMAGE_MAGIC 0x54504950 // "PIPT"
+
+/*
+ * Таблица ip:port с открытой адресацией. Ключ - адрес (IPv4 хранится как ::ffff:a.b.c.d) и порт.
+ * Для адреса без порта заводится запись (адрес, IPPORT_ANY) со значением 0.
+ * Диапазоны портов адреса собираются в bitmap, запись (адрес, IPPORT_ANY) хранит номер bitmap + 1.
+ * Поиск - не более двух обращений к таблице и одно к bitmap.
+ * Построенная таблица может быть записана в snapshot и использоваться прямо из его памяти.
+*/
+
+class IPPortTable
+{
+public:
+	IPPortTable();
+	~IPPortTable();
+
+	/// Add address (network byte order, 4 or 16 bytes) with the port range. port_from = 0 - all ports.
+	void add(const void *address, int length, uint16_t port_from, uint16_t port_to);
+
+	/// Build the hash table. After this call only lookups are allowed.
+	void build();
+
+	/// Append the image of the built table to out.
+	void serialize(std::string &out) const;
+
+	/// Create the table over the image made by serialize(). keepalive holds the memory of the image.
+	/// Throws Poco::Exception if the image is corrupted.
+	static IPPortTable *fromImage(const void *image, size_t size, std::shared_ptr<const void> keepalive);
+
+	/// ip in the network byte order.
+	inline bool lookup4(uint32_t ip, uint16_t port) const
+	{
+		uint8_t addr[16];
+		map_ipv4(&ip, addr);
+		return lookup(addr, port);
+	}
+
+	inline bool lookup6(const uint8_t *ip, uint16_t port) const
+	{
+		return lookup(ip, port);
+	}
+
+	/// Number of the (address, port) entries.
+	inline size_t size() const
+	{
+		return _count;
+	}
+
+	inline size_t bitmaps() const
+	{
+		return _bitmaps_words / IPPORT_BITMAP_WORDS;
+	}
+
+private:
+	struct slot
+	{
+		uint8_t addr[16];
+		uint32_t port; // IPPORT_EMPTY_SLOT - пустая ячейка
+		uint32_t value;
+	};
+
+	struct image_header
+	{
+		uint32_t magic;
+		uint32_t reserved;
+		uint64_t slots;
+		uint64_t bitmaps_words;
+		uint64_t count;
+	};
+
+	struct pending_entry
+	{
+		bool any;
+		std::set<uint16_t> ports;
+		std::vector<std::pair<uint16_t, uint16_t>> ranges;
+		pending_entry() : any(false) {}
+	};
+
+	static inline void map_ipv4(const void *ip, uint8_t *addr)
+	{
+		memset(addr, 0, 10);
+		addr[10] = 0xff;
+		addr[11] = 0xff;
+		memcpy(addr + 12, ip, 4);
+	}
+
+	static inline uint64_t hash(const uint8_t *addr, uint32_t port)
+	{
+		uint64_t a, b;
+		memcpy(&a, addr, 8);
+		memcpy(&b, addr + 8, 8);
+		uint64_t h = a * 0x9E3779B97F4A7C15ULL ^ b * 0xC2B2AE3D27D4EB4FULL ^ (uint64_t) port * 0x165667B19E3779F9ULL;
+		return h ^ (h >> 29);
+	}
+
+	inline const slot *find(const uint8_t *addr, uint32_t port) const
+	{
+		uint64_t i = hash(addr, port) & _mask;
+		while(true)
+		{
+			const slot &s = _slots_ptr[i];
+			if(s.port == IPPORT_EMPTY_SLOT)
+				return nullptr;
+			if(s.port == port && memcmp(s.addr, addr, 16) == 0)
+				return &s;
+			i = (i + 1) & _mask;
+		}
+	}
+
+	inline bool lookup(const uint8_t *addr, uint16_t port) const
+	{
+		if(_count == 0)
+			return false;
+		if(find(addr, port))
+			return true;
+		const slot *s = find(addr, IPPORT_ANY);
+		if(s == nullptr)
+			return false;
+		if(s->value == 0)
+			return true;
+		const uint64_t *bm = _bitmaps_ptr + (s->value - 1) * IPPORT_BITMAP_WORDS;
+		return (bm[port >> 6] >> (port & 63)) & 1;
+	}
+
+	void insert(const uint8_t *addr, uint32_t port, uint32_t value);
+
+	std::vector<slot> _slots;
+	std::vector<uint64_t> _bitmaps;
+	std::map<std::vector<uint8_t>, pending_entry> _pending;
+	// массивы, по которым идет поиск: собственные или из образа
+	const slot *_slots_ptr;
+	const uint64_t *_bitmaps_ptr;
+	size_t _bitmaps_words;
+	uint64_t _mask;
+	size_t _count;
+	std::shared_ptr<const void> _keepalive;
+};
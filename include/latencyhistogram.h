@@ -0,0 +1,89 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+#define LATENCY_BUCKETS 24 // корзина i - задержка меньше 2^i мкс, последняя - все остальные
+
+/*
+ * Гистограмма задержек с корзинами по степеням 2 микросекунд.
+ * Пишет один поток, читать можно из любого (значения могут быть немного несогласованы между корзинами).
+*/
+class LatencyHistogram
+{
+public:
+	LatencyHistogram(uint64_t tsc_hz) : _cycles_per_us(tsc_hz >= 1000000 ? tsc_hz / 1000000 : 1)
+	{
+		for(int i = 0; i < LATENCY_BUCKETS; i++)
+			_buckets[i].store(0, std::memory_order_relaxed);
+	}
+
+	/// Writer: account the latency in tsc cycles.
+	inline void add(uint64_t cycles)
+	{
+		uint64_t us = cycles / _cycles_per_us;
+		int b = us ? 64 - __builtin_clzll(us) : 0;
+		if(b >= LATENCY_BUCKETS)
+			b = LATENCY_BUCKETS - 1;
+		_buckets[b].store(_buckets[b].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+	inline uint64_t bucket(int i) const
+	{
+		return _buckets[i].load(std::memory_order_relaxed);
+	}
+
+	/// Upper bound of the bucket in microseconds.
+	static inline uint64_t bound(int i)
+	{
+		return (uint64_t)1 << i;
+	}
+
+	uint64_t count() const
+	{
+		uint64_t n = 0;
+		for(int i = 0; i < LATENCY_BUCKETS; i++)
+			n += bucket(i);
+		return n;
+	}
+
+	/// Upper bound in microseconds of the bucket with the given percentile (0-100), 0 if there is no data.
+	uint64_t percentile(double p) const
+	{
+		uint64_t n = count();
+		if(!n)
+			return 0;
+		uint64_t rank = (uint64_t)(n * p / 100.);
+		uint64_t seen = 0;
+		for(int i = 0; i < LATENCY_BUCKETS; i++)
+		{
+			seen += bucket(i);
+			if(seen > rank)
+				return bound(i);
+		}
+		return bound(LATENCY_BUCKETS - 1);
+	}
+
+private:
+	uint64_t _cycles_per_us;
+	std::atomic<uint64_t> _buckets[LATENCY_BUCKETS];
+};
@@ -0,0 +1,129 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <vector>
+
+#define LEARNED_PROBES 4 // ячеек, просматриваемых от позиции хэша
+
+/*
+ * Выученные адреса: ip:port серверов, соединения с которыми были заблокированы по SNI или Host.
+ * Общая для всех worker'ов таблица фиксированного размера с открытой адресацией и без блокировок.
+ * Каждая ячейка защищена счетчиком seqlock: писатель делает его нечетным на время записи,
+ * читатель повторяет чтение счетчика после копирования ячейки и отбрасывает ее, если счетчик изменился.
+ * Если ячейку в этот момент пишет другой worker, запись пропускается, а поиск считается промахом.
+ * Ячейка действительна до expire (такты TSC) и только для того поколения списков, из которого выучена.
+ * Новая запись занимает свободную, устаревшую или самую старую из LEARNED_PROBES ячеек.
+*/
+class LearnedTable
+{
+public:
+	/// size - number of the slots, rounded up to the power of 2. ttl - lifetime of the entry in TSC cycles.
+	LearnedTable(size_t size, uint64_t ttl);
+	~LearnedTable();
+
+	/// Remember the blocked destination. addr - address in the network byte order (4 or 16 bytes).
+	/// lineno - line of the matched entry, generation - generation of the lists.
+	void insert(const void *addr, int length, uint16_t port, uint32_t lineno, uint32_t generation, uint64_t now);
+
+	/// Returns true and the line of the matched entry if the destination is learned and not expired.
+	inline bool lookup(const void *addr, int length, uint16_t port, uint32_t generation, uint64_t now, uint32_t &lineno) const
+	{
+		uint8_t key[16];
+		makeKey(addr, length, key);
+		uint64_t i = hash(key, port) & _mask;
+		for(int p = 0; p < LEARNED_PROBES; p++, i = (i + 1) & _mask)
+		{
+			slot_data d;
+			if(!read(_slots[i], d))
+				continue;
+			if(d.port == port && d.expire > now && d.generation == generation && memcmp(d.addr, key, 16) == 0)
+			{
+				lineno = d.lineno;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/// Number of the not expired entries. Scans the whole table.
+	size_t occupancy(uint64_t now) const;
+
+	inline size_t size() const
+	{
+		return _mask + 1;
+	}
+
+private:
+	struct slot_data
+	{
+		uint8_t addr[16];
+		uint64_t expire; // 0 - пустая ячейка
+		uint32_t lineno;
+		uint32_t generation;
+		uint16_t port;
+	};
+
+	struct slot
+	{
+		std::atomic<uint32_t> seq; // нечетный - ячейка записывается
+		slot_data data;
+	};
+
+	static inline void makeKey(const void *addr, int length, uint8_t *key)
+	{
+		if(length == 4)
+		{
+			memset(key, 0, 10);
+			key[10] = 0xff;
+			key[11] = 0xff;
+			memcpy(key + 12, addr, 4);
+		} else {
+			memcpy(key, addr, 16);
+		}
+	}
+
+	static inline uint64_t hash(const uint8_t *key, uint16_t port)
+	{
+		uint64_t a, b;
+		memcpy(&a, key, 8);
+		memcpy(&b, key + 8, 8);
+		uint64_t h = a * 0x9E3779B97F4A7C15ULL ^ b * 0xC2B2AE3D27D4EB4FULL ^ (uint64_t) port * 0x165667B19E3779F9ULL;
+		return h ^ (h >> 29);
+	}
+
+	/// Consistent copy of the slot, false if it is being written.
+	static inline bool read(const slot &s, slot_data &d)
+	{
+		uint32_t seq = s.seq.load(std::memory_order_acquire);
+		if(seq & 1)
+			return false;
+		memcpy(&d, &s.data, sizeof(d));
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return s.seq.load(std::memory_order_relaxed) == seq;
+	}
+
+	slot *_slots;
+	uint64_t _mask;
+	uint64_t _ttl;
+};
@@ -0,0 +1,77 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <Poco/Logger.h>
+#include "dtypes.h"
+
+class IPPortTable;
+class IPPrefixList;
+
+/// Шаблон из списка доменов или url.
+struct list_entry
+{
+	std::string pattern;
+	entry_data data;
+	uint32_t id; // назначается PatternDBBuilder, у одинаковых шаблонов из разных списков общий
+	uint8_t profile; // профиль списка (profiles.h)
+};
+
+/*
+ * Загрузка текстовых списков. Используется extFilter при запуске и перезагрузке,
+ * а также extfilter-compile при подготовке snapshot.
+*/
+
+class ListLoader
+{
+public:
+	ListLoader(Poco::Logger &logger);
+
+	/**
+	    Parse domains ("*." prefix - with subdomains) and append them to entries.
+	    lower - convert domains to lower case (lower_host for the SSL list).
+	**/
+	void parseDomains(const std::string &fn, entry_lists list, std::vector<list_entry> &entries, bool lower = false);
+
+	/**
+	    Parse urls and append them to entries.
+	**/
+	void parseURLs(const std::string &fn, std::vector<list_entry> &entries);
+
+	/**
+	    Load IP SSL for blocking.
+	**/
+	void loadSSLIP(const std::string &fn, IPPrefixList *list);
+
+	/**
+	    Load IP:port for blocking. Networks are stored in nets.
+	**/
+	void loadHosts(const std::string &fn, IPPortTable *table, IPPrefixList *nets);
+
+	/**
+	    Hash of the file contents, used to skip unchanged lists on reload. Throws Poco::Exception on error.
+	**/
+	static uint64_t fileHash(const std::string &fn);
+
+private:
+	Poco::Logger &_logger;
+};
@@ -0,0 +1,77 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <rte_config.h>
+#include <rte_lpm.h>
+#include <rte_lpm6.h>
+#include "prefixlist.h"
+
+/*
+ * Таблица префиксов с поиском по самому длинному совпадению.
+ * IPv4 - rte_lpm (DIR-24-8), IPv6 - rte_lpm6. Префиксы собираются в IPPrefixList,
+ * build() создает по нему таблицы нужного размера. После build() таблица только читается
+ * и может использоваться всеми worker'ами одновременно.
+*/
+
+class LpmTable
+{
+public:
+	LpmTable(const std::string &name);
+	~LpmTable();
+
+	/// Create the lookup tables from the list. Throws Poco::Exception on error.
+	void build(const IPPrefixList &list);
+
+	/// ip in the host byte order.
+	inline bool lookup4(uint32_t ip, uint32_t &value) const
+	{
+		return _lpm4 != nullptr && rte_lpm_lookup(_lpm4, ip, &value) == 0;
+	}
+
+	inline bool lookup6(const uint8_t *ip, uint32_t &value) const
+	{
+		uint8_t next_hop;
+		if(_lpm6 == nullptr || rte_lpm6_lookup(_lpm6, (uint8_t *) ip, &next_hop) != 0)
+			return false;
+		value = next_hop;
+		return true;
+	}
+
+	inline size_t size4() const
+	{
+		return _rules4;
+	}
+
+	inline size_t size6() const
+	{
+		return _rules6;
+	}
+
+private:
+	std::string _name;
+	struct rte_lpm *_lpm4;
+	struct rte_lpm6 *_lpm6;
+	size_t _rules4;
+	size_t _rules6;
+};
@@ -2,15 +2,51 @@
 
 #include <Poco/Util/ServerApplication.h>
 #include <Poco/HashMap.h>
+#include <memory>
+#include <vector>
+#include <string>
 #include "dtypes.h"
 #include "sender.h"
+#include "profiles.h"
 
 #define DEFAULT_MBUF_POOL_SIZE 8191
 #define DEFAULT_RING_SIZE 4096
 
 
-class AhoCorasickPlus;
-class Patricia;
+class FlatAC;
+class LpmTable;
+class IPPortTable;
+class URLIndex;
+class Snapshot;
+struct PatternDB;
+class PatternDBBuilder;
+class LearnedTable;
+
+/// Списки, которые строятся и перезагружаются независимо.
+enum generation_lists
+{
+	G_LIST_PATTERNS = 0, // общий индекс доменов, url и доменов ssl
+	G_LIST_SSL_IPS,
+	G_LIST_HOSTS,
+	G_LIST_MAX
+};
+
+/*
+ * Новое поколение всех списков. Строится один раз за перезагрузку и раздается всем worker'ам.
+ * Пустое поле - список не настроен или не загрузился (ошибка в errors).
+ * Деструктор удаляет то, что не было передано worker'ам (поле не обнулено).
+*/
+struct ListsGeneration
+{
+	PatternDB *patternsDB;
+	LpmTable *sslIPs;
+	IPPortTable *ipPortTable;
+	LpmTable *ipPortNets;
+	std::vector<std::string> errors;
+
+	ListsGeneration();
+	~ListsGeneration();
+};
 
 class extFilter: public Poco::Util::ServerApplication
 {
@@ -31,30 +67,42 @@ public:
 	int main(const ArgVec& args);
 
 	/**
-	    Load domains for blocking.
+	    Open the snapshot, if it is configured. Throws Poco::Exception on error.
 	**/
-	void loadDomains(std::string &fn, AhoCorasickPlus *_dm_atm,DomainsMatchType *_dm_map);
+	std::shared_ptr<Snapshot> openSnapshot();
+
+	/*
+	 * Списки загружаются из snapshot, если он задан, иначе из текстовых файлов.
+	 * Методы возвращают false (nullptr), если список не настроен, и бросают Poco::Exception при ошибке.
+	*/
 
 	/**
-	    Load URLs for blocking.
+	    Create the new generation of the common index of domains, urls and ssl domains. Text lists are compared
+	    with the loaded version and only the changes are compiled. url index is created only for text lists with match_url_exactly.
 	**/
-	void loadURLs(std::string &fn, AhoCorasickPlus *dm_atm);
+	PatternDB *createPatterns(Snapshot *snapshot);
 
 	/**
-	    Load IP SSL for blocking.
+	    Create the table of SSL IPs for blocking.
 	**/
-	void loadSSLIP(const std::string &fn, Patricia *patricia);
+	LpmTable *createSSLIPs(Snapshot *snapshot);
 
 	/**
-	    Load IP:port for blocking.
+	    Create the tables of ip:port and networks for blocking.
 	**/
-	void loadHosts(std::string &fn, IPPortMap *ippm, Patricia *patricia);
+	bool createHosts(Snapshot *snapshot, IPPortTable *&table, LpmTable *&nets);
 
+	/**
+	    Build the new generation of all lists. Lists are built in parallel threads on the cores,
+	    which are not used by DPDK. Errors are stored in gen.errors. Logs the wall time and the memory usage.
+	    If changed_only is set, lists with the same content hash as the loaded version are skipped (left empty in gen).
+	**/
+	void buildGeneration(Snapshot *snapshot, ListsGeneration &gen, bool changed_only = false);
 
 	/**
-	    Load domains and urls into one database.
+	    Files of the lists: the snapshot if it is configured, otherwise the configured text lists.
 	**/
-	void loadDomainsURLs(std::string &domains, std::string &urls, AhoCorasickPlus *dm_atm, EntriesData *ed);
+	std::vector<std::string> getListFiles();
 
 	std::string &getSSLFile()
 	{
@@ -81,6 +129,31 @@ public:
 		return _sslIpsFile;
 	}
 
+	std::string &getSnapshotFile()
+	{
+		return _snapshotFile;
+	}
+
+	bool getWatchLists()
+	{
+		return _watch_lists;
+	}
+
+	int getReloadDebounce()
+	{
+		return _reload_debounce;
+	}
+
+	bool getBlockUndetectedSSL()
+	{
+		return _block_undetected_ssl;
+	}
+
+	bool getMatchURLExactly()
+	{
+		return _match_url_exactly;
+	}
+
 	static inline uint64_t getTscHz()
 	{
 		return _tsc_hz;
@@ -90,7 +163,11 @@ public:
 	std::vector<int> _dpdkPortVec;
 	
 private:
-	int initPort(int port, struct rte_mempool *mbuf_pool, struct ether_addr *addr);
+	/// txRings - number of the tx queues. hw_cksum - set to true if the tx queues calculate ip and tcp checksums.
+	int initPort(int port, struct rte_mempool *mbuf_pool, struct ether_addr *addr, uint16_t txRings = 1, bool *hw_cksum = nullptr);
+
+	/// Hash of the list sources, throws Poco::Exception if they can't be read.
+	uint64_t listHash(Snapshot *snapshot, int list);
 
 	bool _helpRequested;
 	bool _listDPDKPorts;
@@ -101,6 +178,16 @@ private:
 	std::string _sslIpsFile;
 	std::string _sslFile;
 	std::string _hostsFile;
+	std::string _snapshotFile;
+	// загруженные версии текстовых списков, используются только при запуске и в ReloadTask
+	std::unique_ptr<PatternDBBuilder> _patternsBuilder;
+	std::vector<list_profile> _profiles; // профиль 0 - _domainsFile, _urlsFile, _sslFile
+	ProfileMap _profileMap;
+	// хэши содержимого загруженных версий списков, каждый элемент меняет только поток своего списка
+	uint64_t _listsHash[G_LIST_MAX];
+	bool _listsLoaded[G_LIST_MAX];
+	bool _watch_lists;
+	int _reload_debounce; // ms
 	std::string _protocolsFile;
 	std::string _statisticsFile;
 
@@ -109,7 +196,9 @@ private:
 	bool _block_undetected_ssl;
 	bool _http_redirect;
 	bool _url_normalization;
+	bool _fast_url_normalization;
 	bool _remove_dot;
+	std::unique_ptr<LearnedTable> _learned;
 
 	int _num_of_readers;
 	int _num_of_workers;
@@ -123,6 +212,23 @@ private:
 	uint32_t _flowhash_size_per_worker;
 
 	int _num_of_senders;
+	uint32_t _sender_ring_size;
+	bool _sender_lcores; // SenderTask на отдельных ядрах dpdk вместо потоков Poco
+	int _inject_dedup_window; // ms
+	int _inject_rate;
+	int _inject_burst;
+	int _inject_port; // dpdk порт для отправки ответов, -1 - raw сокеты SenderTask
+	int _bridge_port; // второй порт пары в режиме разрыва, -1 - анализ копии трафика
+	uint64_t _bridge_max_backlog;
+	std::string _capture_path; // префикс pcap файлов с пакетами, вызвавшими блокировку, пусто - не записывать
+	uint64_t _capture_file_size; // байт
+	int _capture_files;
+	uint64_t _capture_rate; // байт в секунду на все worker'ы
+	uint32_t _capture_ring_size;
+	std::string _block_log_path; // префикс файлов журнала блокировок, пусто - не записывать
+	uint64_t _block_log_file_size; // байт
+	int _block_log_files;
+	uint32_t _block_log_ring_size;
 };
 
 
@@ -0,0 +1,131 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <Poco/Logger.h>
+#include "dtypes.h"
+#include "listloader.h"
+
+// накладной автомат пересобирается целиком при каждом обновлении, поэтому его размер ограничен
+#define PATTERNDB_OVERLAY_MIN 4096 // шаблонов в накладном автомате, до которых полная сборка не нужна
+#define PATTERNDB_OVERLAY_RATIO 16 // или 1/16 от размера базового автомата
+#define PATTERNDB_REMOVED_RATIO 2 // полная сборка, если удалена половина шаблонов базового автомата
+
+class FlatAC;
+class URLIndex;
+class URLHosts;
+
+/*
+ * Поколение базы шаблонов: общий индекс доменов, url и доменов ssl. Шаблон, который есть в нескольких
+ * списках, хранится один раз, списки и тип совпадения задаются флагами в entries.
+ * Только читается, все части разделяются между worker'ами и между поколениями:
+ * при обновлении списка базовый автомат остается прежним.
+*/
+struct PatternDB
+{
+	std::shared_ptr<const FlatAC> base;
+	std::shared_ptr<const FlatAC> overlay; // шаблоны, добавленные после сборки base, может отсутствовать
+	std::shared_ptr<const EntriesData> entries;
+	std::shared_ptr<const URLIndex> urlIndex; // точные url, если match_url_exactly
+	std::shared_ptr<const URLHosts> urlHosts; // хосты url в автомате, нет в снимке
+};
+
+/*
+ * Строит поколения PatternDB и хранит загруженную версию списка (ключ шаблона -> id).
+ * При обновлении новый список сравнивается с загруженным: сохранившиеся шаблоны остаются в базовом
+ * автомате со старыми id, удаленные просто отсутствуют в новых EntriesData, а добавленные
+ * собираются в небольшой накладной автомат. Стоимость пропорциональна изменениям,
+ * пока накладной автомат мал, иначе выполняется полная сборка.
+*/
+class PatternDBBuilder
+{
+public:
+	struct stats
+	{
+		size_t patterns;
+		size_t added;
+		size_t removed;
+		size_t overlay;
+		bool full;
+	};
+
+	/// url_index - urls are stored in URLIndex instead of the automaton.
+	/// profiles - number of the list profiles, entries store the flags of every profile if it is more than 1.
+	PatternDBBuilder(bool fold_case = false, bool url_index = false, unsigned profiles = 1);
+	~PatternDBBuilder();
+
+	/// Build the new generation from the entries of all lists. Entries with the same pattern are merged,
+	/// their flags are combined. Ids are assigned to the entries.
+	/// Throws Poco::Exception on error, the loaded version stays unchanged in this case.
+	PatternDB *update(std::vector<list_entry> &entries, Poco::Logger &logger);
+
+	/// Forget the loaded version, the next update() makes the full build.
+	void reset();
+
+	inline const stats &lastStats() const
+	{
+		return _stats;
+	}
+
+private:
+	/// Уникальный шаблон после объединения списков.
+	struct pattern
+	{
+		const list_entry *entry; // первое вхождение
+		entry_data data;
+		uint32_t id;
+	};
+
+	/// profile_flags - flags of the patterns in the profiles, _profiles bytes per pattern.
+	std::vector<pattern> merge(std::vector<list_entry> &entries, std::vector<uint8_t> &profile_flags, Poco::Logger &logger);
+	/// Key of the pattern in the loaded version: its text and whether it is stored in the automaton.
+	std::string key(const pattern &p) const;
+	std::shared_ptr<EntriesData> newEntries() const;
+	void insertEntry(EntriesData &ed, uint32_t id, const pattern &p, const std::vector<pattern> &patterns, const std::vector<uint8_t> &profile_flags) const;
+	PatternDB *fullBuild(std::vector<list_entry> &entries, std::vector<pattern> &patterns, const std::vector<uint8_t> &profile_flags, Poco::Logger &logger);
+	static void assignIds(std::vector<list_entry> &entries, const std::vector<pattern> &patterns);
+
+	bool inURLIndex(const entry_data &d) const
+	{
+		return _url_index && (d.flags & E_FLAG_URL);
+	}
+
+	bool inAutomaton(const entry_data &d) const
+	{
+		return !_url_index || (d.flags & ~E_FLAG_URL);
+	}
+
+	bool _fold_case;
+	bool _url_index;
+	unsigned _profiles;
+	std::unordered_map<std::string, uint32_t> _ids;
+	std::shared_ptr<const FlatAC> _base;
+	std::vector<std::pair<std::string, uint32_t>> _overlay_patterns;
+	uint32_t _next_id;
+	size_t _base_size;
+	size_t _removed;
+	stats _stats;
+};
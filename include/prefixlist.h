@@ -0,0 +1,93 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#define PREFIXLIST_IMAGE_MAGIC 0x4c504950 // "PIPL"
+
+/*
+ * Список префиксов IPv4/IPv6, из которого строится LpmTable. Не зависит от DPDK,
+ * поэтому используется и в extfilter-compile для записи списков в snapshot.
+*/
+
+class IPPrefixList
+{
+public:
+	struct prefix4
+	{
+		uint32_t ip; // host byte order
+		uint8_t depth;
+		uint8_t value;
+		uint8_t reserved[2];
+	};
+
+	struct prefix6
+	{
+		uint8_t ip[16];
+		uint8_t depth;
+		uint8_t value;
+		uint8_t reserved[2];
+	};
+
+	/// Add "address" or "address/prefix_length". Value must fit in 8 bits for IPv6.
+	bool add(const std::string &description, uint8_t value = 0);
+
+	/// Add address in the network byte order.
+	bool add(const void *address, int family, int depth, uint8_t value = 0);
+
+	/// Append all prefixes of the other list.
+	void append(const IPPrefixList &other);
+
+	/// Append the image of the list to out.
+	void serialize(std::string &out) const;
+
+	/// Replace the list with the image made by serialize(). Throws Poco::Exception if the image is corrupted.
+	void deserialize(const void *image, size_t size);
+
+	inline const std::vector<prefix4> &prefixes4() const
+	{
+		return _prefixes4;
+	}
+
+	inline const std::vector<prefix6> &prefixes6() const
+	{
+		return _prefixes6;
+	}
+
+	inline size_t size() const
+	{
+		return _prefixes4.size() + _prefixes6.size();
+	}
+
+private:
+	struct image_header
+	{
+		uint32_t magic;
+		uint32_t count4;
+		uint32_t count6;
+		uint32_t reserved;
+	};
+
+	std::vector<prefix4> _prefixes4;
+	std::vector<prefix6> _prefixes6;
+};
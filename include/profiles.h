@@ -0,0 +1,93 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <Poco/Util/AbstractConfiguration.h>
+
+#define MAX_PROFILES 32
+#define PROFILE_MAX_PORTS 256
+#define PROFILE_VLANS 4096
+#define PROFILE_NONE 0xff
+#define PROFILE_NO_VLAN 0xffff
+
+/*
+ * Профили списков для нескольких клиентов на одном extFilter. Профиль 0 - списки из основной
+ * секции конфигурации, остальные задаются секциями [profile.<имя>] со своими domainlist, urllist,
+ * ssllist и выбираются по vlan или порту DPDK, на который пришел пакет.
+ * Шаблоны всех профилей компилируются в общий индекс, профиль хранит только флаги шаблона.
+*/
+
+struct list_profile
+{
+	std::string name;
+	std::string domainsFile;
+	std::string urlsFile;
+	std::string sslFile;
+
+	bool empty() const
+	{
+		return (domainsFile.empty() || urlsFile.empty()) && sslFile.empty();
+	}
+};
+
+/// Выбор профиля по vlan и порту. vlan имеет приоритет над портом.
+class ProfileMap
+{
+public:
+	ProfileMap()
+	{
+		memset(_vlans, PROFILE_NONE, sizeof(_vlans));
+		memset(_ports, PROFILE_NONE, sizeof(_ports));
+	}
+
+	void setVlan(uint16_t vlan, uint8_t profile)
+	{
+		_vlans[vlan % PROFILE_VLANS] = profile;
+	}
+
+	void setPort(uint16_t port, uint8_t profile)
+	{
+		_ports[port % PROFILE_MAX_PORTS] = profile;
+	}
+
+	/// vlan - PROFILE_NO_VLAN if the packet has no vlan tag.
+	inline uint8_t lookup(uint16_t port, uint16_t vlan) const
+	{
+		if(vlan < PROFILE_VLANS && _vlans[vlan] != PROFILE_NONE)
+			return _vlans[vlan];
+		if(port < PROFILE_MAX_PORTS && _ports[port] != PROFILE_NONE)
+			return _ports[port];
+		return 0;
+	}
+
+private:
+	uint8_t _vlans[PROFILE_VLANS];
+	uint8_t _ports[PROFILE_MAX_PORTS];
+};
+
+/**
+    Read the profiles from the configuration: profile 0 from the main section, others from the [profile.<name>] sections
+    in the order of names. map may be null (extfilter-compile). Throws Poco::Exception on bad configuration.
+**/
+void loadProfiles(const Poco::Util::AbstractConfiguration &config, std::vector<list_profile> &profiles, ProfileMap *map);
@@ -0,0 +1,82 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <rte_config.h>
+#include <rte_ip.h>
+
+/*
+ * Шаблон http ответа с редиректом. Ответ состоит из неизменных префикса
+ * ("HTTP/1.1 <code>\r\nLocation: <redirect_url>") и суффикса ("\r\nConnection: close\r\n"),
+ * между которыми может быть дополнительный параметр. Контрольные суммы префикса и суффикса
+ * считаются один раз при создании, для каждого ответа досчитывается только сумма параметра.
+*/
+class RedirectTemplate
+{
+public:
+	/// code, redirect_url - as in CSender::params.
+	RedirectTemplate(const std::string &code, const std::string &redirect_url);
+
+	/// Write the response with the additional parameter into dst, max - the room for the payload.
+	/// The parameter is used only if redirect_url ends with '?' and the response fits into max.
+	/// Returns the length of the payload, sum - its raw (not folded, not inverted) checksum.
+	size_t build(char *dst, size_t max, const char *param, size_t param_length, uint32_t &sum) const;
+
+	/// Response without the additional parameter.
+	inline const std::string &header() const
+	{
+		return _header;
+	}
+
+	/// TCP checksum from the pseudo header checksum, the tcp header without options and the raw checksum of the payload.
+	static inline uint16_t tcpChecksum(uint16_t phdr_cksum, const void *tcph, size_t tcph_len, uint32_t payload_sum)
+	{
+		uint32_t cksum = __rte_raw_cksum_reduce(__rte_raw_cksum(tcph, tcph_len, payload_sum));
+		cksum += phdr_cksum;
+		cksum = ((cksum & 0xffff0000) >> 16) + (cksum & 0xffff);
+		cksum = (~cksum) & 0xffff;
+		if(cksum == 0)
+			cksum = 0xffff;
+		return (uint16_t) cksum;
+	}
+
+private:
+	/// Checksum of the data placed at the offset from the start of the payload.
+	static inline uint32_t placeSum(uint32_t sum, size_t offset)
+	{
+		if(offset & 1)
+		{
+			// с нечетного смещения байты в 16 битных словах меняются местами
+			uint16_t s = __rte_raw_cksum_reduce(sum);
+			return (uint16_t)((s << 8) | (s >> 8));
+		}
+		return sum;
+	}
+
+	std::string _header;
+	std::string _prefix;
+	std::string _suffix;
+	uint32_t _header_sum;
+	uint32_t _prefix_sum;
+	uint32_t _suffix_sum;
+	bool _with_param;
+};
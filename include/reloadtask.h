@@ -22,7 +22,11 @@
 #include <Poco/Event.h>
 #include <Poco/Task.h>
 #include <Poco/Logger.h>
+#include <Poco/Timestamp.h>
 #include <vector>
+#include <map>
+#include <set>
+#include <string>
 #include "dpdk.h"
 
 class extFilter;
@@ -36,8 +40,23 @@ public:
 	static Poco::Event _event;
 
 private:
+	/// Add inotify watches on the directories of the list files.
+	void watchLists();
+
+	/// Read inotify events. Returns true when the lists were changed and no more changes came during the debounce time.
+	bool listsChanged();
+
+	/// Build the new generation of the changed lists and pass it to the workers.
+	void reloadLists();
+
 	extFilter *_parent;
 	Poco::Logger& _logger;
 	std::vector<DpdkWorkerThread*>& workerThreadVec;
+	int _inotify_fd;
+	// каталог (watch descriptor) -> имена файлов списков в нем. Файлы отслеживаются через каталог,
+	// так как списки обычно заменяются переименованием нового файла.
+	std::map<int, std::set<std::string>> _watches;
+	bool _changed;
+	Poco::Timestamp _last_change;
 };
 
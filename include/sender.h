@@ -31,10 +31,17 @@
 #include <netinet/tcp.h>
 #include <netinet/ip.h>
 #include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/uio.h>
+#include <memory>
 
 #include <Poco/Logger.h>
 #include <Poco/Net/IPAddress.h>
+#include "redirecttemplate.h"
 
+#define SENDER_MMSG_BATCH 64 // пакетов, отправляемых одним вызовом sendmmsg
+#define SENDER_FRAME_SIZE 4096
+#define RST_BURST_MAX 16 // максимальное количество rst в одной серии
 
 class CSender {
 public:
@@ -46,20 +53,84 @@ public:
 		int ttl;
 		int ip6_hops;
 		int mtu;
-		params() : code("302 Moved Temporarily"), send_rst_to_server(false), ttl(250), ip6_hops(250), mtu(1500) { }
+		int rst_burst; // rst в серии со сдвигом seq в пределах окна
+		params() : code("302 Moved Temporarily"), send_rst_to_server(false), ttl(250), ip6_hops(250), mtu(1500), rst_burst(1) { }
 	};
 	CSender( std::string url );
 	CSender(struct params &prm);
 	~CSender();
-	void Redirect(int user_port, int dst_port, Poco::Net::IPAddress &src_ip, Poco::Net::IPAddress &dst_ip, uint32_t acknum, uint32_t seqnum, int f_psh, std::string &additional_param);
-	void sendPacket(Poco::Net::IPAddress &ip_from, Poco::Net::IPAddress &ip_to, int port_from, int port_to, uint32_t acknum, uint32_t seqnum, std::string &dt, int f_reset, int f_psh);
-	void SendRST(int user_port, int dst_port, Poco::Net::IPAddress &user_ip, Poco::Net::IPAddress &dst_ip, uint32_t acknum, uint32_t seqnum, int f_psh);
+	void Redirect(int user_port, int dst_port, Poco::Net::IPAddress &src_ip, Poco::Net::IPAddress &dst_ip, uint32_t acknum, uint32_t seqnum, int f_psh, const char *additional_param, size_t param_length);
+	/// Payload is the redirect response with param if f_reset is 0, empty otherwise.
+	void sendPacket(Poco::Net::IPAddress &ip_from, Poco::Net::IPAddress &ip_to, int port_from, int port_to, uint32_t acknum, uint32_t seqnum, const char *param, size_t param_length, int f_reset, int f_psh);
+	/// window - tcp window of the mirrored packet in the host byte order, used for the series of rst.
+	void SendRST(int user_port, int dst_port, Poco::Net::IPAddress &user_ip, Poco::Net::IPAddress &dst_ip, uint32_t acknum, uint32_t seqnum, int f_psh, uint16_t window);
+
+	/// Sequence number in the network byte order for the i-th rst of the series of burst rst spread over the window.
+	static inline uint32_t rstSeq(uint32_t seq, int i, int burst, uint16_t window)
+	{
+		if(i == 0)
+			return seq;
+		return htonl(ntohl(seq) + (uint32_t)i * (window / burst));
+	}
+
+	/// Number of rst in the series, one if the window is unknown.
+	static inline int rstBurst(int burst, uint16_t window)
+	{
+		return (window >= burst) ? burst : 1;
+	}
+
+	/// Series of rst for the packet from the client, shared by the raw socket and dpdk senders.
+	/// send(to_client, acknum, seqnum) is called for every rst with acknum and seqnum of the client packet.
+	/// Rst to the client are spread over the window of the client packet (the window the client checks them against).
+	/// The window of the server is not known from this packet, so the rst to the server is sent once, at the exact seq.
+	template <typename F>
+	static inline void rstSeries(int burst, uint16_t window, bool to_server, uint32_t acknum, uint32_t seqnum, F send)
+	{
+		int n = rstBurst(burst, window);
+		for(int i = 0; i < n; i++)
+			send(true, rstSeq(acknum, i, n, window), seqnum);
+		if(to_server)
+			send(false, acknum, seqnum);
+	}
+	/// Send all the packets prepared by sendPacket. Also called when the batch of the family is full.
+	void flush();
+
+	inline uint64_t packets() const
+	{
+		return _packets;
+	}
+
+	inline uint64_t syscalls() const
+	{
+		return _syscalls;
+	}
 private:
+	/// Пакеты одного семейства, ожидающие отправки через sendmmsg. Заголовки сообщений настроены заранее.
+	struct batch
+	{
+		int sock;
+		unsigned int count;
+		char frames[SENDER_MMSG_BATCH][SENDER_FRAME_SIZE];
+		struct iovec iov[SENDER_MMSG_BATCH];
+		struct mmsghdr msgs[SENDER_MMSG_BATCH];
+		union
+		{
+			struct sockaddr_in sin;
+			struct sockaddr_in6 sin6;
+		} addrs[SENDER_MMSG_BATCH];
+	};
+	void initBatch(batch &b, int sock);
+	void flush(batch &b);
+
 	int s;
 	int s6;
-	std::string rHeader;
+	std::unique_ptr<batch> _batch4;
+	std::unique_ptr<batch> _batch6;
+	uint64_t _packets;
+	uint64_t _syscalls;
 	Poco::Logger& _logger;
 	struct params _parameters;
+	RedirectTemplate _template;
 };
 
 
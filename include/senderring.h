@@ -0,0 +1,94 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <atomic>
+#include "spscring.h"
+
+#define SENDER_PARAM_MAX 1024 // длина дополнительного параметра редиректа, более длинный не передается
+#define SENDER_RING_SIZE 1024 // запросов в кольце worker'а по умолчанию
+
+/// Запрос на отправку редиректа или rst. Адреса и seq/ack в сетевом порядке байт.
+struct inject_request
+{
+	uint64_t timestamp; // tsc получения пакета worker'ом
+	uint8_t ip_version;
+	uint8_t is_rst;
+	uint8_t f_psh;
+	uint8_t reserved;
+	uint16_t user_port;
+	uint16_t dst_port;
+	uint16_t window; // окно tcp из пакета, в порядке байт хоста
+	uint8_t user_ip[16];
+	uint8_t dst_ip[16];
+	uint32_t acknum;
+	uint32_t seqnum;
+	uint16_t param_length;
+	char param[SENDER_PARAM_MAX];
+};
+
+/// Запросы от одного worker'а к одному потоку отправки
+typedef SpscRing<inject_request> SenderRing;
+
+/// Будит SenderTask, уснувший на пустых кольцах. Отправитель перед сном выставляет _sleeping и еще раз
+/// проверяет кольца, поэтому в eventfd пишет только первый commit после засыпания, т.е. переход кольца
+/// из пустого в непустое, остальные запросы обходятся без системных вызовов.
+class SenderWakeup
+{
+public:
+	SenderWakeup();
+	~SenderWakeup();
+
+	/// Called by a worker after commit() of a request.
+	inline void notify()
+	{
+		// пара к барьеру в prepare(): либо отправитель увидит запрос, либо мы увидим _sleeping
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if(_sleeping.load(std::memory_order_relaxed) && _sleeping.exchange(false, std::memory_order_acq_rel))
+		{
+			uint64_t one=1;
+			ssize_t r=write(_fd, &one, sizeof(one));
+			(void)r;
+		}
+	}
+
+	/// The sender announces the sleep, then must check its rings once more before wait().
+	inline void prepare()
+	{
+		_sleeping.store(true, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+	}
+
+	/// The rings were not empty after prepare().
+	inline void cancel()
+	{
+		_sleeping.store(false, std::memory_order_relaxed);
+	}
+
+	/// Sleeps until notify() or timeout (ms).
+	void wait(int timeout);
+
+private:
+	int _fd;
+	std::atomic<bool> _sleeping;
+};
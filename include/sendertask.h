@@ -19,96 +19,99 @@
 #ifndef __SENDER_TASK_H
 #define __SENDER_TASK_H
 
+#include <vector>
+#include <memory>
 #include <Poco/Task.h>
-#include <Poco/Mutex.h>
-#include <Poco/Notification.h>
-#include <Poco/NotificationQueue.h>
-#include <Poco/AutoPtr.h>
 #include <Poco/Logger.h>
-#include <Poco/Net/IPAddress.h>
 
 #include "sender.h"
+#include "senderring.h"
+#include "latencyhistogram.h"
+#include "dpdk.h"
 
-class RedirectNotification: public Poco::Notification
-	// The notification sent to worker threads.
+#define SENDER_BATCH 32 // запросов из одного кольца за проход
+#define SENDER_IDLE_POLLS 64 // пустых проходов до сна SenderTask
+#define SENDER_WAIT_TIMEOUT 100 // ms, самый долгий сон SenderTask, чтобы заметить остановку
+
+/// Отсылает редиректы из колец заданных worker'ов и считает задержку от получения пакета worker'ом до отправки
+class RingSender
 {
 public:
-	typedef Poco::AutoPtr<RedirectNotification> Ptr;
-	
-	RedirectNotification(int user_port, int dst_port, Poco::Net::IPAddress *user_ip, Poco::Net::IPAddress *dst_ip, uint32_t acknum, uint32_t seqnum, int f_psh, std::string &additional_param, bool is_rst=false):
-		_user_port(user_port),
-		_dst_port(dst_port),
-		_user_ip(*user_ip),
-		_dst_ip(*dst_ip),
-		_acknum(acknum),
-		_seqnum(seqnum),
-		_f_psh(f_psh),
-		_additional_param(additional_param),
-		_is_rst(is_rst)
-	{
-	}
-	int user_port()
-	{
-		return _user_port;
-	}
-	int dst_port()
-	{
-		return _dst_port;
-	}
-	Poco::Net::IPAddress &user_ip()
-	{
-		return _user_ip;
-	}
-	Poco::Net::IPAddress &dst_ip()
-	{
-		return _dst_ip;
-	}
-	u_int32_t acknum()
-	{
-		return _acknum;
-	}
-	u_int32_t seqnum()
+	/// rings - rings of the workers, every ring must be drained by one sender only.
+	RingSender(struct CSender::params &prm, int instance, const std::vector<SenderRing *> &rings);
+
+	/// One pass over the rings, returns the number of the sent requests.
+	size_t poll();
+
+	/// Sleeps until a worker commits a request to one of the rings or timeout (ms) expires.
+	void wait(int timeout);
+
+	/// Workers of the rings must notify it, if the sender sleeps in wait().
+	inline SenderWakeup *wakeup()
 	{
-		return _seqnum;
+		return &_wakeup;
 	}
-	int f_psh()
+
+	inline const LatencyHistogram &latency() const
 	{
-		return _f_psh;
+		return _latency;
 	}
-	std::string &additional_param()
+
+	inline int instance() const
 	{
-		return _additional_param;
+		return _instance;
 	}
-	bool is_rst()
+
+	inline const CSender &sender() const
 	{
-		return _is_rst;
+		return *_sender;
 	}
+
 private:
-	int _user_port;
-	int _dst_port;
-	Poco::Net::IPAddress _user_ip;
-	Poco::Net::IPAddress _dst_ip;
-	uint32_t _acknum;
-	uint32_t _seqnum;
-	int _f_psh;
-	std::string _additional_param;
-	bool _is_rst;
+	void send(const inject_request &req);
+
+	std::unique_ptr<CSender> _sender;
+	int _instance;
+	std::vector<SenderRing *> _rings;
+	std::vector<uint64_t> _stamps; // время получения пакетов из запросов текущего прохода
+	LatencyHistogram _latency;
+	SenderWakeup _wakeup;
 };
 
-/// Данная задача отсылает редирект заданному клиенту
+/// Данная задача отсылает редиректы в потоке Poco, засыпая до прихода запроса, если кольца пусты
 class SenderTask: public Poco::Task
 {
 public:
-	SenderTask(struct CSender::params &prm, int instance);
-	~SenderTask();
+	SenderTask(RingSender *sender);
 
 	void runTask();
 
-	// очередь, куда необходимо писать отправные данные...
-	static Poco::NotificationQueue queue;
+private:
+	RingSender *_sender;
+	Poco::Logger& _logger;
+};
+
+/// Отсылка редиректов на отдельном ядре dpdk, кольца опрашиваются без пауз
+class SenderThread : public DpdkWorkerThread
+{
+public:
+	SenderThread(RingSender *sender);
+
+	bool run(uint32_t coreId);
+
+	void stop()
+	{
+		m_Stop = true;
+	}
+
+	RingSender *getSender()
+	{
+		return _sender;
+	}
 
 private:
-	CSender *sender;
+	RingSender *_sender;
+	bool m_Stop;
 	Poco::Logger& _logger;
 };
 
@@ -0,0 +1,142 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <utility>
+
+#define SNAPSHOT_MAGIC "EXTFSNAP"
+#define SNAPSHOT_VERSION 2
+#define SNAPSHOT_MAX_SECTIONS 16
+#define SNAPSHOT_SECTION_ALIGN 64
+
+class FlatAC;
+class EntriesData;
+class IPPortTable;
+class IPPrefixList;
+
+/*
+ * Snapshot - бинарный образ готовых структур поиска, который готовит extfilter-compile.
+ * extFilter отображает файл в память и использует автоматы, метаданные и таблицу ip:port
+ * прямо из образа, без разбора текстовых списков. Префиксы сетей хранятся списком,
+ * таблицы DPDK lpm по ним строятся при загрузке.
+ *
+ * Формат: заголовок (магия, версия, размер файла, контрольная сумма всего, что за заголовком,
+ * таблица секций), затем секции, каждая выровнена на SNAPSHOT_SECTION_ALIGN.
+*/
+
+enum snapshot_sections : uint32_t
+{
+	S_SECTION_NONE = 0,
+	S_SECTION_PATTERNS, // FlatAC общего индекса доменов, url и доменов ssl
+	S_SECTION_PATTERNS_ENTRIES, // EntriesData общего индекса
+	S_SECTION_SSL_IPS = 5, // IPPrefixList, секции 3 и 4 (отдельный индекс ssl) были в версии 1
+	S_SECTION_HOSTS, // IPPortTable
+	S_SECTION_HOSTS_NETS // IPPrefixList
+};
+
+struct snapshot_section
+{
+	uint32_t type;
+	uint32_t reserved;
+	uint64_t offset;
+	uint64_t size;
+};
+
+struct snapshot_header
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t sections;
+	uint64_t size; // размер всего файла
+	uint64_t checksum; // snapshot_checksum() данных после заголовка
+	uint64_t created; // время создания, секунды с начала эпохи
+	snapshot_section section[SNAPSHOT_MAX_SECTIONS];
+};
+
+uint64_t snapshot_checksum(const void *data, size_t size);
+
+class SnapshotWriter
+{
+public:
+	/// Returns the buffer of the new section, the data is appended by the serialize() methods.
+	std::string &addSection(uint32_t type);
+
+	/// Write the image through the temporary file and rename, so the reader never sees a partial file.
+	/// Throws Poco::Exception on error.
+	void write(const std::string &path);
+
+private:
+	std::vector<std::pair<uint32_t, std::string>> _sections;
+};
+
+class Snapshot : public std::enable_shared_from_this<Snapshot>
+{
+public:
+	~Snapshot();
+
+	/// Map the image into memory and verify it. Throws Poco::Exception on error.
+	static std::shared_ptr<Snapshot> open(const std::string &path);
+
+	bool has(uint32_t type) const;
+
+	/// Checksum of the section data, 0 if there is no such section. Used to find the changed lists on reload.
+	uint64_t sectionChecksum(uint32_t type) const;
+
+	/// Objects below use the memory of the image and hold the snapshot until they are deleted.
+	FlatAC *automaton(uint32_t type);
+	EntriesData *entries(uint32_t type);
+	IPPortTable *ipPortTable(uint32_t type);
+
+	/// Copy prefixes from the section into list.
+	void prefixes(uint32_t type, IPPrefixList &list) const;
+
+	inline size_t size() const
+	{
+		return _size;
+	}
+
+	inline uint64_t checksum() const
+	{
+		return header()->checksum;
+	}
+
+	inline uint64_t created() const
+	{
+		return header()->created;
+	}
+
+private:
+	Snapshot();
+
+	inline const snapshot_header *header() const
+	{
+		return (const snapshot_header *) _data;
+	}
+
+	/// Throws Poco::Exception if there is no such section.
+	const void *section(uint32_t type, size_t &size) const;
+
+	void *_data;
+	size_t _size;
+};
@@ -0,0 +1,111 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+#define SPSC_CACHE_LINE 64
+
+/*
+ * Кольцо от одного worker'а к одному потоку-потребителю (single producer, single consumer).
+ * Запись делается прямо в ячейку кольца, без выделения памяти и блокировок.
+ * Если кольцо заполнено, запись отбрасывается и учитывается в drops().
+*/
+template <typename T>
+class SpscRing
+{
+public:
+	/// size - number of the slots, rounded up to the power of 2.
+	SpscRing(size_t size) :
+		_head(0),
+		_drops(0),
+		_tail(0)
+	{
+		size_t n = 2;
+		while(n < size)
+			n <<= 1;
+		_slots.resize(n);
+		_mask = n - 1;
+	}
+
+	/// Producer: free slot for the next entry or nullptr if the ring is full. The entry is visible after commit().
+	inline T *reserve()
+	{
+		uint64_t head = _head.load(std::memory_order_relaxed);
+		if(head - _tail.load(std::memory_order_acquire) > _mask)
+		{
+			_drops.store(_drops.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			return nullptr;
+		}
+		return &_slots[head & _mask];
+	}
+
+	inline void commit()
+	{
+		_head.store(_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	/// Consumer: number of the entries ready to be read.
+	inline size_t readable() const
+	{
+		return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_relaxed);
+	}
+
+	/// Consumer: i-th entry from the read position, i < readable().
+	inline const T &at(size_t i) const
+	{
+		return _slots[(_tail.load(std::memory_order_relaxed) + i) & _mask];
+	}
+
+	/// Consumer: free n read entries.
+	inline void release(size_t n)
+	{
+		_tail.store(_tail.load(std::memory_order_relaxed) + n, std::memory_order_release);
+	}
+
+	/// Current number of the entries in the ring.
+	inline size_t depth() const
+	{
+		return _head.load(std::memory_order_relaxed) - _tail.load(std::memory_order_relaxed);
+	}
+
+	inline uint64_t drops() const
+	{
+		return _drops.load(std::memory_order_relaxed);
+	}
+
+	inline size_t size() const
+	{
+		return _mask + 1;
+	}
+
+private:
+	// позиции записи и чтения разделены заполнением, чтобы не попадать в одну строку кэша
+	// (alignas не используется: в c++11 operator new не гарантирует выравнивание больше 16)
+	std::atomic<uint64_t> _head;
+	std::atomic<uint64_t> _drops;
+	char _pad1[SPSC_CACHE_LINE];
+	std::atomic<uint64_t> _tail;
+	char _pad2[SPSC_CACHE_LINE];
+	std::vector<T> _slots;
+	uint64_t _mask;
+};
@@ -22,16 +22,19 @@
 #include <vector>
 #include "dpdk.h"
 
+class RingSender;
+
 class StatisticTask: public Poco::Task
 {
 public:
-	StatisticTask(int sec, std::vector<DpdkWorkerThread*>& workerThreadVector, std::string &statisticsFile);
+	StatisticTask(int sec, std::vector<DpdkWorkerThread*>& workerThreadVector, const std::vector<RingSender*> &senders, std::string &statisticsFile);
 	void runTask();
 	void OutStatistic();
 
 private:
 	int _sec;
 	std::vector<DpdkWorkerThread*>& workerThreadVec;
+	std::vector<RingSender*> _senders;
 	std::string _statisticsFile;
 };
 
@@ -27,9 +27,24 @@ public:
 	uint64_t ipv4_fragments;
 	uint64_t ipv6_fragments;
 	uint64_t already_detected_blocked;
-	ThreadStats() : redirected_domains(0), redirected_urls(0), sended_rst(0), ip_packets(0), total_bytes(0), matched_ssl(0), matched_ssl_ip(0), matched_ip_port(0),total_packets(0), analyzed_packets(0), matched_domains(0), matched_urls(0), ipv4_packets(0), ipv6_packets(0), ndpi_flows_count(0), ndpi_ipv4_flows_count(0), ndpi_ipv6_flows_count(0), ndpi_flows_deleted(0), missed_packets(0), enqueued_packets(0), ipv4_short_packets(0), ipv4_fragments(0), ipv6_fragments(0), already_detected_blocked(0) {}
+	uint64_t url_index_lookups;
+	uint64_t url_index_hits;
+	uint64_t url_index_probes;
+	uint64_t verdict_cache_lookups;
+	uint64_t verdict_cache_hits;
+	uint64_t learned_lookups;
+	uint64_t learned_hits;
+	uint64_t learned_inserts;
+	uint64_t inject_duplicates;
+	uint64_t inject_rate_limited;
+	uint64_t bridge_dropped;
+	uint64_t bridge_bypassed;
+	uint64_t captured_packets;
+	uint64_t capture_rate_limited;
+	uint64_t block_events;
+	ThreadStats() : redirected_domains(0), redirected_urls(0), sended_rst(0), ip_packets(0), total_bytes(0), matched_ssl(0), matched_ssl_ip(0), matched_ip_port(0),total_packets(0), analyzed_packets(0), matched_domains(0), matched_urls(0), ipv4_packets(0), ipv6_packets(0), ndpi_flows_count(0), ndpi_ipv4_flows_count(0), ndpi_ipv6_flows_count(0), ndpi_flows_deleted(0), missed_packets(0), enqueued_packets(0), ipv4_short_packets(0), ipv4_fragments(0), ipv6_fragments(0), already_detected_blocked(0), url_index_lookups(0), url_index_hits(0), url_index_probes(0), verdict_cache_lookups(0), verdict_cache_hits(0), learned_lookups(0), learned_hits(0), learned_inserts(0), inject_duplicates(0), inject_rate_limited(0), bridge_dropped(0), bridge_bypassed(0), captured_packets(0), capture_rate_limited(0), block_events(0) {}
 
-	void clear() { redirected_domains = 0; redirected_urls = 0; sended_rst = 0; ip_packets = 0; total_bytes = 0; matched_ssl = 0; matched_ssl_ip = 0; matched_ip_port = 0; total_packets = 0; analyzed_packets = 0; matched_domains = 0; matched_urls = 0; ipv4_packets = 0; ipv6_packets = 0; ndpi_flows_count = 0; ndpi_flows_deleted = 0; missed_packets = 0; enqueued_packets = 0; ipv4_short_packets = 0; ipv4_fragments = 0; ipv6_fragments = 0; ndpi_ipv4_flows_count = 0; ndpi_ipv6_flows_count = 0; already_detected_blocked = 0; }
+	void clear() { redirected_domains = 0; redirected_urls = 0; sended_rst = 0; ip_packets = 0; total_bytes = 0; matched_ssl = 0; matched_ssl_ip = 0; matched_ip_port = 0; total_packets = 0; analyzed_packets = 0; matched_domains = 0; matched_urls = 0; ipv4_packets = 0; ipv6_packets = 0; ndpi_flows_count = 0; ndpi_flows_deleted = 0; missed_packets = 0; enqueued_packets = 0; ipv4_short_packets = 0; ipv4_fragments = 0; ipv6_fragments = 0; ndpi_ipv4_flows_count = 0; ndpi_ipv6_flows_count = 0; already_detected_blocked = 0; url_index_lookups = 0; url_index_hits = 0; url_index_probes = 0; verdict_cache_lookups = 0; verdict_cache_hits = 0; learned_lookups = 0; learned_hits = 0; learned_inserts = 0; inject_duplicates = 0; inject_rate_limited = 0; bridge_dropped = 0; bridge_bypassed = 0; captured_packets = 0; capture_rate_limited = 0; block_events = 0; }
 
 
 };
@@ -0,0 +1,58 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/time.h>
+#include <rte_config.h>
+#include <rte_cycles.h>
+
+/// Перевод tsc из записей worker'ов во время. Соответствие tsc и времени запоминается при создании, tsc синхронен на всех ядрах.
+class TscClock
+{
+public:
+	TscClock(uint64_t tsc_hz) :
+		_tsc_hz(tsc_hz)
+	{
+		struct timeval now;
+		_base_tsc = rte_rdtsc();
+		gettimeofday(&now, NULL);
+		_base_usec = (int64_t)now.tv_sec * 1000000 + now.tv_usec;
+	}
+
+	/// Microseconds since the epoch, tsc may be taken before the clock was created.
+	inline int64_t toMicroseconds(uint64_t tsc) const
+	{
+		int64_t cycles = (int64_t)(tsc - _base_tsc);
+		return _base_usec + cycles / (int64_t)_tsc_hz * 1000000 + (cycles % (int64_t)_tsc_hz) * 1000000 / (int64_t)_tsc_hz;
+	}
+
+	inline void toTimeval(uint64_t tsc, struct timeval &tv) const
+	{
+		int64_t usec = toMicroseconds(tsc);
+		tv.tv_sec = usec / 1000000;
+		tv.tv_usec = usec % 1000000;
+	}
+
+private:
+	uint64_t _tsc_hz;
+	uint64_t _base_tsc;
+	int64_t _base_usec;
+};
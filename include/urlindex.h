@@ -0,0 +1,156 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+/*
+ * Индекс url для режима match_url_exactly.
+ * Таблица хостов с открытой адресацией, у каждого хоста своя подтаблица url.
+ * Поиск делается одним проходом хэша по нормализованному url (без http://).
+*/
+
+class URLIndex
+{
+public:
+	enum EnumInsertStatus
+	{
+		INSERT_SUCCESS = 0,
+		INSERT_DUPLICATE,
+		INSERT_EMPTY,
+		INSERT_CLOSED
+	};
+
+	URLIndex();
+	~URLIndex();
+
+	EnumInsertStatus insert(const std::string &url, uint32_t id);
+
+	/// Build the tables. After this call no urls can be added.
+	void finalize();
+
+	/// Search url (host/path) in the index. probes returns number of the visited slots.
+	bool find(const char *url, size_t length, uint32_t &id, uint32_t &probes) const;
+
+	/// Returns true if the index has urls of the host (text before the first '/').
+	bool hasHost(const char *host, size_t length) const;
+
+	inline size_t size() const
+	{
+		return _urls_count;
+	}
+
+	inline size_t hostsCount() const
+	{
+		return _hosts_count;
+	}
+
+	/// Incremental FNV-1a hash, host hash is the value at the first '/'.
+	static inline void hash(const char *url, size_t length, uint64_t &host_hash, uint64_t &url_hash)
+	{
+		uint64_t h = 14695981039346656037ULL;
+		size_t i = 0;
+		for(; i < length && url[i] != '/'; i++)
+		{
+			h ^= (unsigned char) url[i];
+			h *= 1099511628211ULL;
+		}
+		host_hash = h;
+		for(; i < length; i++)
+		{
+			h ^= (unsigned char) url[i];
+			h *= 1099511628211ULL;
+		}
+		url_hash = h;
+	}
+
+private:
+	struct host_slot
+	{
+		uint64_t hash;
+		uint32_t first; // first url slot of the host
+		uint32_t mask; // size of the host url table - 1
+	};
+
+	struct url_slot
+	{
+		uint64_t hash;
+		uint32_t offset; // offset in the _pool
+		uint32_t length; // 0 - empty slot
+		uint32_t id;
+	};
+
+	struct pending_url
+	{
+		uint64_t host_hash;
+		uint64_t url_hash;
+		uint32_t offset;
+		uint32_t length;
+		uint32_t id;
+	};
+
+	const host_slot *findHost(uint64_t host_hash, uint32_t &probes) const;
+
+	std::vector<host_slot> _hosts;
+	std::vector<url_slot> _urls;
+	std::vector<char> _pool;
+	std::vector<pending_url> _pending;
+	std::unordered_multimap<uint64_t, uint32_t> _pending_hashes;
+	uint64_t _hosts_mask;
+	size_t _urls_count;
+	size_t _hosts_count;
+	bool _finalized;
+};
+
+/*
+ * Хосты url, которые ищутся автоматом (без match_url_exactly). Шаблон url совпадает с началом
+ * url или после точки, поэтому хост запроса проверяется вместе с родительскими доменами.
+ * Позволяет не искать и не кэшировать url хостов, для которых в списках нет url.
+ * Совпадение хэшей разных хостов приводит только к лишнему поиску.
+*/
+class URLHosts
+{
+public:
+	URLHosts() : _any(false)
+	{
+	}
+
+	/// Add the host of the url pattern.
+	void insert(const std::string &url);
+
+	/// Sort the hashes. After this call no urls can be added.
+	void finalize();
+
+	/// Returns true if the url patterns can match the urls of the host.
+	bool match(const char *host, size_t length) const;
+
+	inline size_t size() const
+	{
+		return _hashes.size();
+	}
+
+private:
+	std::vector<uint64_t> _hashes;
+	bool _any; // шаблон без хоста или без пути может совпасть с любым хостом
+};
@@ -0,0 +1,97 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+#define URL_NORMALIZER_BUFFER_SIZE 2048
+
+/*
+ * Нормализация url без выделения памяти.
+ * Результат совпадает с Poco::URI::normalize() + toString(): схема и хост в нижнем регистре,
+ * порт по умолчанию удаляется, путь декодируется, удаляются сегменты '.', '..' и пустые,
+ * затем путь кодируется обратно так же, как это делает Poco.
+ * Если url не требует изменений, то он не копируется и data() указывает на исходную строку.
+ * Url длиннее буфера (редкость) нормализуется через Poco::URI с выделением памяти.
+ * Путь разбирается без Poco::URI только с NORM_FAST (fast_url_normalization), пока совпадение
+ * с Poco не проверено через make check (extfilter-urlcheck) на той версии Poco, с которой собрана программа.
+*/
+
+class URLNormalizer
+{
+public:
+	enum
+	{
+		NORM_LOWER_HOST = 0x01, // хост в нижний регистр
+		NORM_PATH = 0x02, // схема, порт, декодирование и сегменты пути
+		NORM_STRIP_DOT = 0x04, // удалить точку в конце имени хоста
+		NORM_FAST = 0x08, // NORM_PATH без Poco::URI
+		NORM_URI = NORM_LOWER_HOST | NORM_PATH
+	};
+
+	URLNormalizer();
+
+	/// Normalize url according to flags. Returns true if the result was written to the internal buffer.
+	/// If url has broken escapes, only NORM_STRIP_DOT is applied, as on Poco::SyntaxException.
+	bool normalize(const char *url, size_t length, int flags);
+
+	inline const char *data() const
+	{
+		return _data;
+	}
+
+	inline size_t length() const
+	{
+		return _length;
+	}
+
+private:
+	bool needsWork(const char *url, size_t length, int flags);
+	bool build(const char *url, size_t length, int flags);
+	bool buildPath(const char *path, size_t length);
+	bool fallback(const char *url, size_t length, int flags);
+
+	inline bool put(char c)
+	{
+		if(_out == URL_NORMALIZER_BUFFER_SIZE)
+			return false;
+		_buf[_out++] = c;
+		return true;
+	}
+
+	const char *_data;
+	size_t _length;
+
+	// разбор url, заполняется в needsWork()
+	size_t _host_start;
+	size_t _host_end; // конец хоста без порта, если порт удаляется
+	size_t _authority_end;
+	size_t _path_end;
+
+	std::string _long; // результат для url, которые не помещаются в буфер
+
+	size_t _out;
+	char _buf[URL_NORMALIZER_BUFFER_SIZE];
+	char _path[URL_NORMALIZER_BUFFER_SIZE];
+	uint16_t _seg_offset[URL_NORMALIZER_BUFFER_SIZE / 2 + 1];
+	uint16_t _seg_length[URL_NORMALIZER_BUFFER_SIZE / 2 + 1];
+};
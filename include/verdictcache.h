@@ -0,0 +1,119 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#ifndef VERDICT_CACHE_SIZE
+#define VERDICT_CACHE_SIZE 4096 // ячеек в кэше одного worker'а, степень 2
+#endif
+
+#if VERDICT_CACHE_SIZE & (VERDICT_CACHE_SIZE - 1)
+#error "VERDICT_CACHE_SIZE must be a power of 2"
+#endif
+
+/*
+ * Кэш результатов поиска по спискам для часто встречающихся хостов (CDN, мессенджеры, поисковики).
+ * Ключ - хэш хоста http, нормализованного url (только для хостов, у которых есть url в списках)
+ * или имени из SNI вместе с профилем и типом поиска,
+ * значение - результат и id найденного шаблона. Каждая ячейка помнит поколение списков,
+ * при публикации нового поколения все ячейки становятся недействительными без очистки.
+ * Кэш принадлежит одному worker'у и не требует блокировок. Ячейка с прямым отображением
+ * перезаписывается при коллизии, сравнивается полный 64-битный хэш.
+*/
+class VerdictCache
+{
+public:
+	enum kind
+	{
+		K_HTTP = 1, // url
+		K_SSL,
+		K_HTTP_HOST // хост http
+	};
+
+	enum verdict : uint8_t
+	{
+		V_NONE = 0, // не найден в списках
+		V_DOMAIN,
+		V_URL,
+		V_SSL,
+		V_HOST_URLS // домен не найден, но для хоста есть url в списках
+	};
+
+	VerdictCache() : _slots(VERDICT_CACHE_SIZE)
+	{
+		memset(_slots.data(), 0, _slots.size() * sizeof(slot));
+	}
+
+	/// Hash of the text, seed distinguishes the profile and the kind of the lookup.
+	static inline uint64_t hash(const char *text, size_t length, uint32_t seed)
+	{
+		uint64_t h = (length ^ ((uint64_t) seed << 32)) * 0x9E3779B97F4A7C15ULL;
+		while(length >= 8)
+		{
+			uint64_t w;
+			memcpy(&w, text, 8);
+			h = (h ^ w) * 0xC2B2AE3D27D4EB4FULL;
+			h ^= h >> 29;
+			text += 8;
+			length -= 8;
+		}
+		if(length)
+		{
+			uint64_t w = 0;
+			memcpy(&w, text, length);
+			h = (h ^ w) * 0xC2B2AE3D27D4EB4FULL;
+		}
+		return h ^ (h >> 32);
+	}
+
+	/// generation - generation of the lists, 0 is never valid.
+	inline bool find(uint64_t key, uint32_t generation, uint8_t &verdict, uint32_t &id) const
+	{
+		const slot &s = _slots[key & (VERDICT_CACHE_SIZE - 1)];
+		if(s.generation != generation || s.key != key)
+			return false;
+		verdict = s.verdict;
+		id = s.id;
+		return true;
+	}
+
+	inline void insert(uint64_t key, uint32_t generation, uint8_t verdict, uint32_t id)
+	{
+		slot &s = _slots[key & (VERDICT_CACHE_SIZE - 1)];
+		s.key = key;
+		s.generation = generation;
+		s.id = id;
+		s.verdict = verdict;
+	}
+
+private:
+	struct slot
+	{
+		uint64_t key;
+		uint32_t generation;
+		uint32_t id;
+		uint8_t verdict;
+	};
+
+	std::vector<slot> _slots;
+};
@@ -4,6 +4,7 @@
 #include <map>
 #include <unordered_map>
 #include <set>
+#include <atomic>
 #include <iostream>
 #include <Poco/Mutex.h>
 #include <Poco/HashMap.h>
@@ -11,10 +12,23 @@
 #include <ndpi_api.h>
 #include <rte_hash.h>
 #include "dtypes.h"
-#include "AhoCorasickPlus.h"
-#include "patr.h"
+#include "flatac.h"
+#include "patterndb.h"
+#include "urlindex.h"
+#include "urlnormalizer.h"
+#include "lpm.h"
+#include "ipporttable.h"
 #include "flow.h"
 #include "stats.h"
+#include "profiles.h"
+#include "verdictcache.h"
+#include "learnedtable.h"
+#include "injector.h"
+#include "senderring.h"
+#include "injectlimiter.h"
+#include "bridge.h"
+#include "capture.h"
+#include "blocklog.h"
 #include "dpdk.h"
 
 
@@ -28,7 +42,6 @@
 #define EXTFILTER_CAPTURE_BURST_SIZE 32
 #define EXTFILTER_WORKER_BURST_SIZE 32
 
-#define URI_RESERVATION_SIZE 2048
 
 /**
  * Contains all the configuration needed for the worker thread including:
@@ -39,40 +52,66 @@ struct WorkerConfig
 {
 	uint32_t CoreId;
 	int port;
-	AhoCorasickPlus *atm;
-	Poco::FastMutex atmLock; // для загрузки url
-	AhoCorasickPlus *atmSSLDomains;
-	DomainsMatchType *SSLdomainsMatchType;
-	Poco::FastMutex atmSSLDomainsLock; // для загрузки domains
-	Patricia *sslIPs; // ip addresses for blocking
+	PatternDB *patternsDB; // общий индекс доменов, url и доменов ssl
+	Poco::FastMutex atmLock; // для загрузки patternsDB
+	std::atomic<uint32_t> patterns_generation; // меняется при каждой замене patternsDB, сбрасывает кэш результатов
+	const ProfileMap *profiles; // выбор профиля списков по vlan и порту, NULL - только профиль 0
+	LpmTable *sslIPs; // ip addresses for blocking, shared between workers
 	Poco::FastMutex sslIPsLock;
-	IPPortMap *ipportMap;
-	Patricia *ipPortMap;
+	IPPortTable *ipPortTable; // shared between workers
+	LpmTable *ipPortNets; // networks from the ip:port list, shared between workers
+	std::atomic<uint32_t> ipport_generation; // меняется при каждой перезагрузке списка ip:port
 	Poco::FastMutex ipportMapLock;
+	PacketInjector *injector; // отправка ответов через dpdk порт, NULL - через SenderTask
+	SenderRing *senderRing; // запросы к SenderTask, если нет injector
+	SenderWakeup *senderWakeup; // будит SenderTask после запроса, NULL для отправителя на своем ядре
+	LearnedTable *learned; // выученные ip:port заблокированных серверов, общая для всех worker'ов, NULL - выключено
+	BridgeForwarder *bridge; // режим разрыва: пересылка пакетов в парный порт, NULL - только анализ копии трафика
+	int bridge_port; // reader: второй порт пары
+	uint64_t bridge_max_backlog; // reader: пакетов у worker'ов, после которого пакеты идут в обход анализа
+	uint64_t inject_dedup_cycles; // повторные ответы в соединение в течение этого времени не отправляются, 0 - выключено
+	uint32_t inject_rate; // ответов в секунду одному абоненту, 0 - без ограничения
+	uint32_t inject_burst;
+	CaptureRing *captureRing; // копии пакетов, вызвавших блокировку, для PcapWriter, NULL - выключено
+	uint64_t capture_rate; // байт в секунду, копируемых в captureRing
+	BlockEventRing *blockLog; // записи о блокировках для BlockLogWriter, NULL - выключено
 
 	bool match_url_exactly;
 	bool lower_host;
 	bool block_undetected_ssl;
 	bool http_redirect;
-	std::string PathToWritePackets;
 	enum ADD_P_TYPES add_p_type;
 	struct ndpi_detection_module_struct *ndpi_struct;
 	uint32_t max_ndpi_flows;
 	uint32_t num_roots;
 
-	EntriesData *entriesData;
-
 	bool url_normalization;
+	bool fast_url_normalization; // нормализация пути без Poco::URI
 	bool remove_dot;
 
 	WorkerConfig()
 	{
 		CoreId = RTE_MAX_LCORE+1;
-		atm = NULL;
-		atmSSLDomains = NULL;
-		SSLdomainsMatchType = NULL;
+		patternsDB = NULL;
+		profiles = NULL;
+		patterns_generation = 1;
 		sslIPs = NULL;
-		ipportMap = NULL;
+		ipPortTable = NULL;
+		ipPortNets = NULL;
+		ipport_generation = 1;
+		learned = NULL;
+		injector = NULL;
+		senderRing = NULL;
+		senderWakeup = NULL;
+		bridge = NULL;
+		bridge_port = -1;
+		bridge_max_backlog = 0;
+		inject_dedup_cycles = 0;
+		inject_rate = 0;
+		inject_burst = 1;
+		captureRing = NULL;
+		capture_rate = 0;
+		blockLog = NULL;
 		match_url_exactly = false;
 		lower_host = false;
 		block_undetected_ssl = false;
@@ -83,6 +122,7 @@ struct WorkerConfig
 //		num_roots = NUM_ROOTS;
 
 		url_normalization = true;
+		fast_url_normalization = false;
 		remove_dot = true;
 	}
 /*	
@@ -116,10 +156,31 @@ private:
 
 	int _worker_id;
 
-	std::string uri;
+	URLNormalizer _normalizer;
+
+	VerdictCache _verdicts;
+
+	InjectLimiter _limiter;
+
+	CaptureBudget _capture_budget;
 
 	bool analyzePacket(struct rte_mbuf* mBuf, uint64_t timestamp);
 	bool analyzePacketFlow(struct rte_mbuf *m, uint64_t timestamp);
+	/// Request in the sender ring filled with the addresses of the packet, nullptr if the ring is full.
+	inject_request *newRequest(uint64_t timestamp, uint8_t *l3, int ip_version, int src_port, int dst_port, uint32_t acknum, uint32_t seqnum);
+	/// Suppress the repeated injection into the flow and the injections over the rate of the subscriber.
+	bool injectAllowed(ndpi_flow_info *flow, uint8_t *l3, int ip_version, uint64_t timestamp);
+	/// Copy the packet which triggered the block into the capture ring, within the capture byte rate.
+	void capturePacket(struct rte_mbuf *m, uint64_t timestamp);
+	/// Put the audit record of the block decision into the block log ring.
+	void logBlock(uint64_t timestamp, uint8_t *l3, int ip_version, int src_port, int dst_port, uint8_t profile, uint8_t list, uint32_t lineno, uint8_t action);
+	void sendRST(struct rte_mbuf *m, ndpi_flow_info *flow, uint64_t timestamp, uint8_t *l3, int ip_version, int src_port, int dst_port, uint32_t acknum, uint32_t seqnum);
+	/// Write the additional parameter of the redirect (add_p_type) into buf without allocations.
+	/// Returns its length, 0 if there is no parameter or it does not fit into size.
+	size_t redirectParam(const entry_data *entry, char *buf, size_t size) const;
+	void sendRedirect(struct rte_mbuf *m, ndpi_flow_info *flow, uint64_t timestamp, uint8_t *l3, int ip_version, int src_port, int dst_port, uint32_t acknum, uint32_t seqnum, int f_psh, const char *param, size_t param_length);
+	/// Remember the destination of the flow blocked by SNI or Host in the learned table.
+	void learnBlocked(int ip_version, const void *ip_header, uint16_t port, uint32_t lineno, uint64_t timestamp);
 //	Flow *getFlow(Poco::Net::IPAddress *src_ip, Poco::Net::IPAddress *dst_ip, uint16_t src_port, uint8_t dst_port, uint8_t protocol, bool *src2dst_direction, time_t first_seen, time_t last_seen, bool *new_flow);
 public:
 	WorkerThread(const std::string& name, WorkerConfig &workerConfig, flowHash *fh, Distributor *distr, int worker_id);
@@ -23,9 +23,11 @@
 #include "ahocorasick.h"
 #include "AhoCorasickPlus.h"
 
-AhoCorasickPlus::AhoCorasickPlus ()
+AhoCorasickPlus::AhoCorasickPlus (bool fold_case)
 {
     m_automata = ac_trie_create ();
+    if (fold_case)
+        ac_trie_fold_case (m_automata);
     m_acText = new AC_TEXT_t;
 }
 
@@ -65,6 +65,9 @@ AC_TRIE_t *ac_trie_create (void)
     
     thiz->patterns_count = 0;
     
+    for (int i = 0; i < 256; i++)
+        thiz->alphabet_map[i] = (AC_ALPHABET_t) i;
+    
     mf_repdata_init (thiz);
     ac_trie_reset (thiz);    
     thiz->text = NULL;
@@ -106,7 +109,7 @@ AC_STATUS_t ac_trie_add (AC_TRIE_t *thiz, AC_PATTERN_t *patt, int copy)
     
     for (i = 0; i < patt->ptext.length; i++)
     {
-        alpha = patt->ptext.astring[i];
+        alpha = thiz->alphabet_map[(unsigned char) patt->ptext.astring[i]];
         if ((next = node_find_next (n, alpha)))
         {
             n = next;
@@ -130,6 +133,21 @@ AC_STATUS_t ac_trie_add (AC_TRIE_t *thiz, AC_PATTERN_t *patt, int copy)
     return ACERR_SUCCESS;
 }
 
+/**
+ * @brief Makes the trie case insensitive for ASCII letters.
+ * 
+ * Patterns are folded to lower case when they are added and input bytes are 
+ * folded during the transition lookup, so the caller does not need to make a 
+ * lower case copy of the text. Must be called before adding patterns.
+ * 
+ * @param thiz pointer to the trie
+ *****************************************************************************/
+void ac_trie_fold_case (AC_TRIE_t *thiz)
+{
+    for (int i = 'A'; i <= 'Z'; i++)
+        thiz->alphabet_map[i] = (AC_ALPHABET_t) (i - 'A' + 'a');
+}
+
 /**
  * @brief Finalizes the preprocessing stage and gets the trie ready
  * 
@@ -198,7 +216,8 @@ int ac_trie_search (AC_TRIE_t *thiz, AC_TEXT_t *text, int keep,
      */
     while (position < text->length)
     {
-        if (!(next = node_find_next_bs (current, text->astring[position])))
+        if (!(next = node_find_next_bs (current, 
+                thiz->alphabet_map[(unsigned char) text->astring[position]])))
         {
             if(current->failure_node /* We are not in the root node */)
                 current = current->failure_node;
@@ -0,0 +1,147 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+
+#include <unistd.h>
+#include <string.h>
+#include <inttypes.h>
+#include <Poco/File.h>
+#include <Poco/LocalDateTime.h>
+#include <Poco/DateTimeFormatter.h>
+#include "blocklog.h"
+
+BlockLogWriter::BlockLogWriter(const std::vector<BlockEventRing *> &rings, const std::string &path, uint64_t file_size, int files):
+	Task("BlockLogWriter"),
+	_rings(rings),
+	_path(path),
+	_file_size(file_size),
+	_files(files),
+	_file_bytes(0),
+	_file_seq(0),
+	_clock(rte_get_tsc_hz()),
+	_events(0),
+	_logger(Poco::Logger::get("BlockLogWriter"))
+{
+	_batch.reserve(BLOCK_LOG_BATCH);
+}
+
+BlockLogWriter::~BlockLogWriter()
+{
+	close();
+}
+
+bool BlockLogWriter::open()
+{
+	std::string name(_path + "-" + Poco::DateTimeFormatter::format(Poco::LocalDateTime(), "%Y%m%d%H%M%S") + "-" + std::to_string(++_file_seq) + ".blk");
+	struct block_log_header header;
+	blockLogInitHeader(header);
+	try
+	{
+		_os.reset(new Poco::FileOutputStream(name, std::ios::out | std::ios::trunc | std::ios::binary));
+		_os->write((const char *)&header, sizeof(header));
+	} catch (Poco::Exception &excep)
+	{
+		_logger.error("Unable to open block log file %s: %s", name, excep.displayText());
+		_os.reset();
+		return false;
+	}
+	if(!_os->good())
+	{
+		_logger.error("Unable to write block log file %s", name);
+		_os.reset();
+		return false;
+	}
+	_file_bytes = sizeof(header);
+	_names.push_back(name);
+	while(_files && _names.size() > _files)
+	{
+		try
+		{
+			Poco::File(_names.front()).remove();
+		} catch (Poco::Exception &excep)
+		{
+			_logger.warning("Unable to remove old block log file: %s", excep.displayText());
+		}
+		_names.pop_front();
+	}
+	_logger.information("Writing block events to %s", name);
+	return true;
+}
+
+void BlockLogWriter::close()
+{
+	if(!_os)
+		return;
+	_os->close();
+	_os.reset();
+}
+
+size_t BlockLogWriter::poll()
+{
+	size_t processed = 0;
+	for(auto ring : _rings)
+	{
+		size_t n = ring->readable();
+		if(n > BLOCK_LOG_BATCH)
+			n = BLOCK_LOG_BATCH;
+		if(!n)
+			continue;
+		_batch.clear();
+		for(size_t i = 0; i < n; i++)
+		{
+			_batch.push_back(ring->at(i));
+			_batch.back().time = _clock.toMicroseconds(_batch.back().time);
+		}
+		ring->release(n);
+		processed += n;
+		// файл открывается по первой записи, при ошибке записи пропускаются, чтобы не переполнять кольца
+		if(!_os && !open())
+			continue;
+		_os->write((const char *)_batch.data(), n * sizeof(struct block_event));
+		if(!_os->good())
+		{
+			_logger.error("Unable to write block events, starting a new file");
+			close();
+			continue;
+		}
+		_file_bytes += n * sizeof(struct block_event);
+		_events += n;
+		if(_file_bytes >= _file_size)
+			close();
+	}
+	if(processed && _os)
+		_os->flush();
+	return processed;
+}
+
+void BlockLogWriter::runTask()
+{
+	_logger.debug("Starting BlockLogWriter...");
+
+	while(!isCancelled())
+	{
+		if(!poll())
+			usleep(BLOCK_LOG_IDLE_SLEEP);
+	}
+	// worker'ы к этому моменту остановлены, дописываем оставшееся
+	while(poll());
+	close();
+
+	_logger.information("Stopping BlockLogWriter, written %" PRIu64 " events", _events);
+}
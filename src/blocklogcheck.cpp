@@ -0,0 +1,118 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+
+/*
+ * extfilter-blocklogcheck: журнал блокировок.
+ * - заголовок и записи пишутся так же, как BlockLogWriter, и читаются так же, как extfilter-blocklog;
+ * - текст записей ipv4 и ipv6, неизвестные список и действие, оборванная последняя запись;
+ * - журнал с чужой сигнатурой, версией или размером записи отвергается.
+ * Возвращает 1, если хотя бы одна проверка не прошла.
+*/
+
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "blockevent.h"
+#include "check.h"
+
+static void checkBlockLog()
+{
+	std::vector<block_event> events(3);
+	memset(events.data(), 0, events.size() * sizeof(block_event));
+	const uint8_t client4[4] = { 10, 0, 0, 1 }, server4[4] = { 93, 184, 216, 34 };
+	events[0].time = 1500000000123456ULL;
+	memcpy(events[0].src_ip, client4, 4);
+	memcpy(events[0].dst_ip, server4, 4);
+	events[0].src_port = 51000;
+	events[0].dst_port = 80;
+	events[0].ip_version = 4;
+	events[0].list = B_LIST_DOMAIN;
+	events[0].action = B_ACTION_REDIRECT;
+	events[0].lineno = 42;
+	events[0].profile = 1;
+	events[0].worker = 2;
+	events[1].time = 1500000001000001ULL;
+	events[1].src_ip[0] = 0x20;
+	events[1].src_ip[1] = 0x01;
+	events[1].src_ip[15] = 1;
+	events[1].dst_ip[0] = 0x20;
+	events[1].dst_ip[1] = 0x01;
+	events[1].dst_ip[15] = 2;
+	events[1].src_port = 40000;
+	events[1].dst_port = 443;
+	events[1].ip_version = 6;
+	events[1].list = B_LIST_SSL;
+	events[1].action = B_ACTION_RST;
+	events[1].lineno = 7;
+	events[2] = events[0];
+	events[2].list = 100;
+	events[2].action = 100;
+	const char *expected[] = {
+		"2017-07-14 02:40:00.123456 worker 2 profile 1 10.0.0.1:51000 -> 93.184.216.34:80 list domain line 42 action redirect",
+		"2017-07-14 02:40:01.000001 worker 0 profile 0 [2001::1]:40000 -> [2001::2]:443 list ssl line 7 action rst",
+		"2017-07-14 02:40:00.123456 worker 2 profile 1 10.0.0.1:51000 -> 93.184.216.34:80 list unknown line 42 action unknown"
+	};
+
+	// файл пишется так же, как его пишет BlockLogWriter, и читается так же, как extfilter-blocklog
+	char name[] = "/tmp/extfilter-blocklogcheck-XXXXXX";
+	int fd = mkstemp(name);
+	expect(fd >= 0, "temporary block log is created");
+	if(fd < 0)
+		return;
+	FILE *f = fdopen(fd, "w+b");
+	struct block_log_header header;
+	blockLogInitHeader(header);
+	fwrite(&header, sizeof(header), 1, f);
+	fwrite(events.data(), sizeof(block_event), events.size(), f);
+	fwrite(events.data(), sizeof(block_event) / 2, 1, f); // оборванная запись
+	rewind(f);
+	struct block_log_header read_header;
+	expect(fread(&read_header, sizeof(read_header), 1, f) == 1 && blockLogCheckHeader(read_header) == B_HEADER_OK, "block log header is accepted");
+	block_event ev;
+	size_t n = 0;
+	while(fread(&ev, sizeof(ev), 1, f) == 1)
+	{
+		expect(n < events.size() && blockEventText(ev) == expected[n], "block event " + std::to_string(n) + " is decoded as '" + blockEventText(ev) + "'");
+		n++;
+	}
+	expect(n == events.size(), "truncated block event is skipped");
+	fclose(f);
+	unlink(name);
+
+	struct block_log_header bad = header;
+	bad.magic[0] = 'X';
+	expect(blockLogCheckHeader(bad) == B_HEADER_NOT_LOG, "block log with the wrong magic is rejected");
+	bad = header;
+	bad.version++;
+	expect(blockLogCheckHeader(bad) == B_HEADER_UNSUPPORTED, "block log of the other version is rejected");
+	bad = header;
+	bad.record_size--;
+	expect(blockLogCheckHeader(bad) == B_HEADER_UNSUPPORTED, "block log with the other record size is rejected");
+	std::cout << "block log: " << n << " events" << std::endl;
+}
+
+int main()
+{
+	checkBlockLog();
+	return checkResult();
+}
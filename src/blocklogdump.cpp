@@ -0,0 +1,116 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+
+/*
+ * extfilter-blocklog: выводит записи журнала блокировок extFilter (block_log_path) в текстовом виде,
+ * по одной строке на запись:
+ * <время UTC> worker <n> profile <n> <клиент>:<порт> -> <сервер>:<порт> list <список> line <строка> action <действие>
+*/
+
+#include <iostream>
+#include <fstream>
+#include <string.h>
+#include <Poco/Util/Application.h>
+#include <Poco/Util/Option.h>
+#include <Poco/Util/OptionSet.h>
+#include <Poco/Util/HelpFormatter.h>
+#include "blockevent.h"
+
+class extFilterBlockLog: public Poco::Util::Application
+{
+public:
+	extFilterBlockLog() : _helpRequested(false)
+	{
+	}
+
+protected:
+	void defineOptions(Poco::Util::OptionSet& options)
+	{
+		Application::defineOptions(options);
+		options.addOption(
+			Poco::Util::Option("help","h","Display help on command line arguments.")
+				.required(false)
+				.repeatable(false)
+				.callback(Poco::Util::OptionCallback<extFilterBlockLog>(this,&extFilterBlockLog::handleHelp)));
+	}
+
+	void handleHelp(const std::string& name,const std::string& value)
+	{
+		_helpRequested=true;
+		Poco::Util::HelpFormatter helpFormatter(options());
+		helpFormatter.setCommand(commandName());
+		helpFormatter.setUsage("<block log file>...");
+		helpFormatter.setHeader("Print the block events written by the extFilter as text.");
+		helpFormatter.format(std::cout);
+		stopOptionsProcessing();
+	}
+
+	/// Returns false if the file is not a block log. A truncated last record is skipped with a warning.
+	bool dump(const std::string &file)
+	{
+		std::ifstream is(file.c_str(), std::ios::in | std::ios::binary);
+		if(!is)
+		{
+			logger().error("Unable to open file %s", file);
+			return false;
+		}
+		struct block_log_header header;
+		if(!is.read((char *)&header, sizeof(header)) || blockLogCheckHeader(header) == B_HEADER_NOT_LOG)
+		{
+			logger().error("File %s is not a block log", file);
+			return false;
+		}
+		if(blockLogCheckHeader(header) != B_HEADER_OK)
+		{
+			logger().error("Unsupported version %u (record size %u) of the block log %s", header.version, header.record_size, file);
+			return false;
+		}
+		block_event ev;
+		while(is.read((char *)&ev, sizeof(ev)))
+			std::cout << blockEventText(ev) << "\n";
+		if(is.gcount())
+			logger().warning("Truncated record at the end of the block log %s", file);
+		return true;
+	}
+
+	int main(const ArgVec& args)
+	{
+		if(_helpRequested)
+			return Application::EXIT_OK;
+		if(args.empty())
+		{
+			logger().fatal("Block log files are not specified");
+			return Application::EXIT_USAGE;
+		}
+		int ret=Application::EXIT_OK;
+		for(auto &file : args)
+		{
+			if(!dump(file))
+				ret=Application::EXIT_DATAERR;
+		}
+		std::cout.flush();
+		return ret;
+	}
+
+private:
+	bool _helpRequested;
+};
+
+POCO_APP_MAIN(extFilterBlockLog)
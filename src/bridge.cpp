@@ -0,0 +1,51 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#include <rte_malloc.h>
+#include <Poco/Exception.h>
+#include "bridge.h"
+
+BridgeForwarder::BridgeForwarder(uint8_t port_a, uint8_t port_b, uint16_t queue) :
+	_queue(queue),
+	_forwarded(0),
+	_dropped(0)
+{
+	_ports[0] = port_a;
+	_ports[1] = port_b;
+	for(int i = 0; i < 2; i++)
+	{
+		_buffers[i] = (struct rte_eth_dev_tx_buffer *) rte_zmalloc_socket("bridge_buffer", RTE_ETH_TX_BUFFER_SIZE(BRIDGE_BURST_SIZE), 0, rte_eth_dev_socket_id(_ports[i]));
+		if(_buffers[i] == nullptr)
+		{
+			if(i)
+				rte_free(_buffers[0]);
+			throw Poco::Exception("Unable to allocate the tx buffer for the bridge");
+		}
+		rte_eth_tx_buffer_init(_buffers[i], BRIDGE_BURST_SIZE);
+		// неотправленные пакеты освобождаются и учитываются в _dropped
+		rte_eth_tx_buffer_set_err_callback(_buffers[i], rte_eth_tx_buffer_count_callback, &_dropped);
+	}
+}
+
+BridgeForwarder::~BridgeForwarder()
+{
+	flush();
+	rte_free(_buffers[0]);
+	rte_free(_buffers[1]);
+}
@@ -0,0 +1,136 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+
+#include <unistd.h>
+#include <inttypes.h>
+#include <Poco/File.h>
+#include <Poco/LocalDateTime.h>
+#include <Poco/DateTimeFormatter.h>
+#include <rte_config.h>
+#include <rte_cycles.h>
+#include "capture.h"
+
+PcapWriter::PcapWriter(const std::vector<CaptureRing *> &rings, const std::string &path, uint64_t file_size, int files):
+	Task("PcapWriter"),
+	_rings(rings),
+	_path(path),
+	_file_size(file_size),
+	_files(files),
+	_pcap(nullptr),
+	_dumper(nullptr),
+	_file_bytes(0),
+	_file_seq(0),
+	_clock(rte_get_tsc_hz()),
+	_packets(0),
+	_logger(Poco::Logger::get("PcapWriter"))
+{
+	_pcap = pcap_open_dead(DLT_EN10MB, CAPTURE_SNAPLEN);
+	if(_pcap == nullptr)
+		throw Poco::Exception("Unable to create pcap handle for the capture");
+}
+
+PcapWriter::~PcapWriter()
+{
+	close();
+	pcap_close(_pcap);
+}
+
+bool PcapWriter::open()
+{
+	std::string name(_path + "-" + Poco::DateTimeFormatter::format(Poco::LocalDateTime(), "%Y%m%d%H%M%S") + "-" + std::to_string(++_file_seq) + ".pcap");
+	_dumper = pcap_dump_open(_pcap, name.c_str());
+	if(_dumper == nullptr)
+	{
+		_logger.error("Unable to open capture file %s: %s", name, std::string(pcap_geterr(_pcap)));
+		return false;
+	}
+	_file_bytes = 0;
+	_names.push_back(name);
+	while(_files && _names.size() > _files)
+	{
+		try
+		{
+			Poco::File(_names.front()).remove();
+		} catch (Poco::Exception &excep)
+		{
+			_logger.warning("Unable to remove old capture file: %s", excep.displayText());
+		}
+		_names.pop_front();
+	}
+	_logger.information("Writing captured packets to %s", name);
+	return true;
+}
+
+void PcapWriter::close()
+{
+	if(_dumper == nullptr)
+		return;
+	pcap_dump_close(_dumper);
+	_dumper = nullptr;
+}
+
+size_t PcapWriter::poll()
+{
+	size_t processed = 0;
+	for(auto ring : _rings)
+	{
+		size_t n = ring->readable();
+		if(n > CAPTURE_BATCH)
+			n = CAPTURE_BATCH;
+		for(size_t i = 0; i < n; i++)
+		{
+			// файл открывается по первому пакету, пустые файлы не создаются
+			if(_dumper == nullptr && !open())
+				break;
+			const capture_record &rec = ring->at(i);
+			struct pcap_pkthdr hdr;
+			_clock.toTimeval(rec.timestamp, hdr.ts);
+			hdr.caplen = rec.caplen;
+			hdr.len = rec.len;
+			pcap_dump((u_char *)_dumper, &hdr, rec.data);
+			_file_bytes += sizeof(hdr) + rec.caplen;
+			_packets++;
+			if(_file_bytes >= _file_size)
+				close();
+		}
+		// при ошибке открытия файла пакеты отбрасываются, чтобы не переполнять кольца
+		ring->release(n);
+		processed += n;
+	}
+	if(processed && _dumper)
+		pcap_dump_flush(_dumper);
+	return processed;
+}
+
+void PcapWriter::runTask()
+{
+	_logger.debug("Starting PcapWriter...");
+
+	while(!isCancelled())
+	{
+		if(!poll())
+			usleep(CAPTURE_IDLE_SLEEP);
+	}
+	// worker'ы к этому моменту остановлены, дописываем оставшееся
+	while(poll());
+	close();
+
+	_logger.information("Stopping PcapWriter, written %" PRIu64 " packets", _packets);
+}
@@ -0,0 +1,99 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+
+/*
+ * extfilter-capturecheck: передача пакетов от worker'ов к PcapWriter.
+ * - SpscRing: порядок и отсутствие потерь между двумя потоками, учет drops();
+ * - CaptureBudget: размер пачки и средняя скорость.
+ * Возвращает 1, если хотя бы одна проверка не прошла.
+*/
+
+#include <string>
+#include <thread>
+#include <atomic>
+#include "spscring.h"
+#include "capture.h"
+#include "check.h"
+
+static void checkSpscRing()
+{
+	const uint64_t count = 2000000;
+	SpscRing<uint64_t> ring(256);
+	expect(ring.size() == 256, "SpscRing size");
+	std::atomic<uint64_t> full(0);
+	std::thread producer([&ring, &full, count]()
+	{
+		for(uint64_t v = 1; v <= count;)
+		{
+			uint64_t *slot = ring.reserve();
+			if(slot == nullptr)
+			{
+				full.fetch_add(1, std::memory_order_relaxed);
+				std::this_thread::yield();
+				continue;
+			}
+			*slot = v++;
+			ring.commit();
+		}
+	});
+	uint64_t expected = 1;
+	bool ordered = true;
+	while(expected <= count)
+	{
+		size_t n = ring.readable();
+		expect(n <= ring.size(), "SpscRing readable() does not exceed the size");
+		for(size_t i = 0; i < n; i++)
+			ordered &= (ring.at(i) == expected++);
+		ring.release(n);
+	}
+	producer.join();
+	expect(ordered, "SpscRing delivers the entries in order without losses");
+	expect(ring.readable() == 0 && ring.depth() == 0, "SpscRing is empty");
+	expect(ring.drops() == full.load(), "SpscRing counts the drops of the full ring");
+	std::cout << "spsc ring: " << count << " entries, " << ring.drops() << " drops" << std::endl;
+}
+
+static void checkCaptureBudget()
+{
+	const uint64_t hz = 1000000;
+	CaptureBudget budget(10000, 3000, hz);
+	uint64_t now = hz;
+	int burst = 0;
+	while(budget.take(1000, now) && burst < 100)
+		burst++;
+	expect(burst == 3, "CaptureBudget allows the burst of 3000 bytes, allowed " + std::to_string(burst * 1000));
+	expect(!budget.take(1000, now + hz / 10 - 1) && budget.take(1000, now + hz / 10), "CaptureBudget refills at the rate");
+	uint64_t bytes = 0;
+	for(uint64_t t = 0; t < 10 * hz; t += hz / 1000)
+	{
+		if(budget.take(100, 100 * hz + t))
+			bytes += 100;
+	}
+	expect(bytes >= 102800 && bytes <= 103200, "CaptureBudget keeps the rate, taken " + std::to_string(bytes) + " bytes in 10 seconds");
+	CaptureBudget disabled(0, 0, hz);
+	expect(!disabled.take(1, now), "CaptureBudget without the rate takes nothing");
+}
+
+int main()
+{
+	checkSpscRing();
+	checkCaptureBudget();
+	return checkResult();
+}
@@ -0,0 +1,168 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+/*
+ * extfilter-compile: читает те же списки, что и extFilter (по тому же файлу конфигурации),
+ * строит структуры поиска и записывает их в snapshot. extFilter загружает snapshot,
+ * если в конфигурации задан параметр snapshot.
+*/
+
+#include <iostream>
+#include <memory>
+#include <Poco/Util/Application.h>
+#include <Poco/Util/Option.h>
+#include <Poco/Util/OptionSet.h>
+#include <Poco/Util/HelpFormatter.h>
+#include <Poco/Timestamp.h>
+#include "dtypes.h"
+#include "flatac.h"
+#include "ipporttable.h"
+#include "prefixlist.h"
+#include "listloader.h"
+#include "snapshot.h"
+#include "patterndb.h"
+#include "profiles.h"
+
+class extFilterCompile: public Poco::Util::Application
+{
+public:
+	extFilterCompile() : _helpRequested(false)
+	{
+	}
+
+protected:
+	void defineOptions(Poco::Util::OptionSet& options)
+	{
+		Application::defineOptions(options);
+		options.addOption(
+			Poco::Util::Option("help","h","Display help on command line arguments.")
+				.required(false)
+				.repeatable(false)
+				.callback(Poco::Util::OptionCallback<extFilterCompile>(this,&extFilterCompile::handleHelp)));
+		options.addOption(
+			Poco::Util::Option("config-file","f","Specify config file of the extFilter to read the lists from.")
+				.required(true)
+				.repeatable(false)
+				.argument("FILE"));
+		options.addOption(
+			Poco::Util::Option("output","o","Output file. Default is the value of the snapshot parameter from the config file.")
+				.required(false)
+				.repeatable(false)
+				.argument("FILE"));
+	}
+
+	void handleOption(const std::string& name,const std::string& value)
+	{
+		Application::handleOption(name, value);
+		if(name == "config-file")
+			loadConfiguration(value);
+		if(name == "output")
+			_output = value;
+	}
+
+	void handleHelp(const std::string& name,const std::string& value)
+	{
+		_helpRequested=true;
+		Poco::Util::HelpFormatter helpFormatter(options());
+		helpFormatter.setCommand(commandName());
+		helpFormatter.setUsage("<-f config file> [-o output file]");
+		helpFormatter.setHeader("Compile the blocking lists of the extFilter into the binary snapshot.");
+		helpFormatter.format(std::cout);
+		stopOptionsProcessing();
+	}
+
+	int main(const ArgVec& args)
+	{
+		if(_helpRequested)
+			return Application::EXIT_OK;
+		if(_output.empty())
+			_output=config().getString("snapshot","");
+		if(_output.empty())
+		{
+			logger().fatal("Output file is not specified");
+			return Application::EXIT_USAGE;
+		}
+		std::string ssl_ips=config().getString("sslips","");
+		std::string hosts=config().getString("hostlist","");
+		bool lower_host=config().getBool("lower_host", false);
+
+		ListLoader loader(logger());
+		SnapshotWriter writer;
+		Poco::Timestamp start;
+		try
+		{
+			// домены, url и домены ssl всех профилей компилируются в общий индекс
+			std::vector<list_profile> profiles;
+			loadProfiles(config(), profiles, nullptr);
+			std::vector<list_entry> entries;
+			for(size_t i=0; i < profiles.size(); i++)
+			{
+				const list_profile &p=profiles[i];
+				size_t first=entries.size();
+				if(!p.domainsFile.empty() && !p.urlsFile.empty())
+				{
+					loader.parseDomains(p.domainsFile, E_LIST_DOMAINS, entries);
+					loader.parseURLs(p.urlsFile, entries);
+				}
+				if(!p.sslFile.empty())
+					loader.parseDomains(p.sslFile, E_LIST_SSL, entries, lower_host);
+				for(size_t k=first; k < entries.size(); k++)
+					entries[k].profile=i;
+			}
+			if(!entries.empty())
+			{
+				// url_index не сохраняется, точные url ищутся автоматом с проверкой длины совпадения
+				PatternDBBuilder builder(false, false, profiles.size());
+				std::unique_ptr<PatternDB> db(builder.update(entries, logger()));
+				db->base->serialize(writer.addSection(S_SECTION_PATTERNS));
+				db->entries->serialize(writer.addSection(S_SECTION_PATTERNS_ENTRIES));
+				logger().information("Compiled %z domains, urls and ssl domains of %z profiles from %z lines into %z states", db->entries->size(), profiles.size(), entries.size(), db->base->states());
+			}
+			if(!ssl_ips.empty())
+			{
+				IPPrefixList list;
+				loader.loadSSLIP(ssl_ips, &list);
+				list.serialize(writer.addSection(S_SECTION_SSL_IPS));
+				logger().information("Compiled %z SSL IPs prefixes", list.size());
+			}
+			if(!hosts.empty())
+			{
+				IPPortTable table;
+				IPPrefixList nets;
+				loader.loadHosts(hosts, &table, &nets);
+				table.serialize(writer.addSection(S_SECTION_HOSTS));
+				nets.serialize(writer.addSection(S_SECTION_HOSTS_NETS));
+				logger().information("Compiled %z ip:port entries and %z networks", table.size(), nets.size());
+			}
+			writer.write(_output);
+		} catch (Poco::Exception &excep)
+		{
+			logger().fatal("Unable to compile the snapshot: %s", excep.displayText());
+			return Application::EXIT_DATAERR;
+		}
+		logger().information("Snapshot %s written in %d ms", _output, (int)(start.elapsed() / 1000));
+		return Application::EXIT_OK;
+	}
+
+private:
+	bool _helpRequested;
+	std::string _output;
+};
+
+POCO_APP_MAIN(extFilterCompile)
@@ -9,8 +9,11 @@
 #include "distributor.h"
 
 Distributor::Distributor(unsigned num_workers):
-	_num_workers(num_workers)
+	_num_workers(num_workers),
+	_done(new counter[num_workers])
 {
+	for(unsigned i = 0; i < num_workers; i++)
+		_done[i].value.store(0, std::memory_order_relaxed);
 	distr = rte_distributor_create("PKT_DIST", rte_socket_id(), _num_workers);
 	if(!distr)
 	{
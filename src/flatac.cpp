@@ -0,0 +1,301 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#include <string.h>
+#include <algorithm>
+#include <numeric>
+#include <Poco/Exception.h>
+#include "flatac.h"
+
+FlatAC::FlatAC(bool fold_case) :
+	_finalized(false),
+	_map(_own_map),
+	_states(nullptr),
+	_edge_alpha(nullptr),
+	_edge_next(nullptr),
+	_patterns(nullptr),
+	_states_count(0),
+	_edges_count(0),
+	_patterns_count(0),
+	_unique(0)
+{
+	for(int i = 0; i < 256; i++)
+		_own_map[i] = (fold_case && i >= 'A' && i <= 'Z') ? i + ('a' - 'A') : i;
+	setFoldMap();
+	for(int i = 0; i < 256; i++)
+		_root[i] = FLATAC_NONE;
+}
+
+FlatAC::~FlatAC()
+{
+}
+
+void FlatAC::setFoldMap()
+{
+	for(int i = 0; i < 256; i++)
+		_fold_map[i] = _map[(i >= 'A' && i <= 'Z') ? i + ('a' - 'A') : i];
+}
+
+size_t FlatAC::align(size_t size)
+{
+	return (size + 7) & ~((size_t) 7);
+}
+
+bool FlatAC::addPattern(const std::string &pattern, uint32_t id)
+{
+	if(_finalized || pattern.empty())
+		return false;
+	_offsets.push_back(_pool.size());
+	for(auto c : pattern)
+		_pool.push_back(_own_map[(uint8_t) c]);
+	FlatAC::pattern p;
+	p.id = id;
+	p.length = pattern.length();
+	_own_patterns.push_back(p);
+	return true;
+}
+
+uint32_t FlatAC::buildStep(uint32_t st, uint8_t alpha) const
+{
+	const state &s = _own_states[st];
+	const uint8_t *first = _own_edge_alpha.data() + s.edges_first;
+	const uint8_t *last = first + s.edges_count;
+	const uint8_t *it = std::lower_bound(first, last, alpha);
+	if(it != last && *it == alpha)
+		return _own_edge_next[s.edges_first + (it - first)];
+	return FLATAC_NONE;
+}
+
+void FlatAC::finalize(std::vector<uint32_t> *duplicates)
+{
+	if(_finalized)
+		return;
+	_finalized = true;
+	const char *pool = _pool.data();
+	const std::vector<uint32_t> &offsets = _offsets;
+	const std::vector<pattern> &patterns = _own_patterns;
+	auto less = [pool, &offsets, &patterns](uint32_t a, uint32_t b)
+	{
+		uint32_t la = patterns[a].length, lb = patterns[b].length;
+		int r = memcmp(pool + offsets[a], pool + offsets[b], std::min(la, lb));
+		return r < 0 || (r == 0 && la < lb);
+	};
+	// сортировка дает каждому узлу непрерывный диапазон шаблонов с общим префиксом,
+	// короткий шаблон идет раньше своих продолжений
+	std::vector<uint32_t> order(_own_patterns.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), less);
+	std::vector<uint32_t> uniq;
+	uniq.reserve(order.size());
+	for(auto i : order)
+	{
+		if(!uniq.empty() && !less(uniq.back(), i))
+		{
+			if(duplicates)
+				duplicates->push_back(_own_patterns[i].id);
+			continue;
+		}
+		uniq.push_back(i);
+	}
+	std::vector<uint32_t>().swap(order);
+	_unique = uniq.size();
+
+	// узлы создаются в порядке обхода в ширину: у родителя переходы непрерывны и отсортированы,
+	// а ссылка неудачи указывает на уже обработанный узел меньшей глубины
+	std::vector<uint32_t> range_lo, range_hi, depth;
+	state root;
+	memset(&root, 0, sizeof(root));
+	root.pattern = FLATAC_NONE;
+	root.output = FLATAC_NONE;
+	_own_states.push_back(root);
+	range_lo.push_back(0);
+	range_hi.push_back(uniq.size());
+	depth.push_back(0);
+	for(uint32_t u = 0; u < _own_states.size(); u++)
+	{
+		uint32_t i = range_lo[u];
+		uint32_t end = range_hi[u];
+		uint32_t d = depth[u];
+		_own_states[u].edges_first = _own_edge_alpha.size();
+		while(i < end)
+		{
+			uint8_t alpha = pool[offsets[uniq[i]] + d];
+			uint32_t j = i + 1;
+			while(j < end && (uint8_t) pool[offsets[uniq[j]] + d] == alpha)
+				j++;
+			state s;
+			s.edges_first = 0;
+			s.edges_count = 0;
+			s.pattern = FLATAC_NONE;
+			uint32_t child_lo = i;
+			if(patterns[uniq[i]].length == d + 1)
+			{
+				s.pattern = uniq[i];
+				child_lo++;
+			}
+			s.fail = 0;
+			if(u != 0)
+			{
+				uint32_t f = _own_states[u].fail;
+				while(true)
+				{
+					uint32_t next = buildStep(f, alpha);
+					if(next != FLATAC_NONE)
+					{
+						s.fail = next;
+						break;
+					}
+					if(f == 0)
+						break;
+					f = _own_states[f].fail;
+				}
+			}
+			const state &fs = _own_states[s.fail];
+			s.output = (fs.pattern != FLATAC_NONE) ? s.fail : fs.output;
+			_own_edge_alpha.push_back(alpha);
+			_own_edge_next.push_back(_own_states.size());
+			_own_states.push_back(s);
+			range_lo.push_back(child_lo);
+			range_hi.push_back(j);
+			depth.push_back(d + 1);
+			i = j;
+		}
+		_own_states[u].edges_count = _own_edge_alpha.size() - _own_states[u].edges_first;
+	}
+	std::vector<char>().swap(_pool);
+	std::vector<uint32_t>().swap(_offsets);
+	_own_states.shrink_to_fit();
+	_own_edge_alpha.shrink_to_fit();
+	_own_edge_next.shrink_to_fit();
+	_own_patterns.shrink_to_fit();
+	setViews();
+}
+
+void FlatAC::setViews()
+{
+	_map = _own_map;
+	_states = _own_states.data();
+	_edge_alpha = _own_edge_alpha.data();
+	_edge_next = _own_edge_next.data();
+	_patterns = _own_patterns.data();
+	_states_count = _own_states.size();
+	_edges_count = _own_edge_alpha.size();
+	_patterns_count = _own_patterns.size();
+	for(int i = 0; i < 256; i++)
+		_root[i] = FLATAC_NONE;
+	if(_states_count)
+	{
+		for(uint32_t e = _states[0].edges_first; e < _states[0].edges_first + _states[0].edges_count; e++)
+			_root[_edge_alpha[e]] = _edge_next[e];
+	}
+}
+
+void FlatAC::serialize(std::string &out) const
+{
+	if(!_finalized)
+		throw Poco::Exception("Unable to serialize not finalized automaton");
+	size_t start = out.size();
+	image_header h;
+	memset(&h, 0, sizeof(h));
+	h.magic = FLATAC_IMAGE_MAGIC;
+	h.states = _states_count;
+	h.edges = _edges_count;
+	h.patterns = _patterns_count;
+	h.unique = _unique;
+	memcpy(h.map, _map, sizeof(h.map));
+	auto append = [&out, start](const void *data, size_t size)
+	{
+		out.append((const char *) data, size);
+		out.resize(start + align(out.size() - start), '\0');
+	};
+	append(&h, sizeof(h));
+	append(_states, _states_count * sizeof(state));
+	append(_edge_alpha, _edges_count);
+	append(_edge_next, _edges_count * sizeof(uint32_t));
+	append(_patterns, _patterns_count * sizeof(pattern));
+}
+
+FlatAC *FlatAC::fromImage(const void *image, size_t size, std::shared_ptr<const void> keepalive)
+{
+	const uint8_t *p = (const uint8_t *) image;
+	if(size < sizeof(image_header))
+		throw Poco::Exception("Automaton image is too short");
+	const image_header *h = (const image_header *) p;
+	if(h->magic != FLATAC_IMAGE_MAGIC)
+		throw Poco::Exception("Bad automaton image magic");
+	size_t off_states = align(sizeof(image_header));
+	size_t off_alpha = off_states + align((size_t) h->states * sizeof(state));
+	size_t off_next = off_alpha + align(h->edges);
+	size_t off_patterns = off_next + align((size_t) h->edges * sizeof(uint32_t));
+	size_t need = off_patterns + align((size_t) h->patterns * sizeof(pattern));
+	if(need > size)
+		throw Poco::Exception("Automaton image is truncated");
+
+	FlatAC *ac = new FlatAC();
+	ac->_finalized = true;
+	ac->_map = h->map;
+	ac->setFoldMap();
+	ac->_states = (const state *)(p + off_states);
+	ac->_edge_alpha = p + off_alpha;
+	ac->_edge_next = (const uint32_t *)(p + off_next);
+	ac->_patterns = (const pattern *)(p + off_patterns);
+	ac->_states_count = h->states;
+	ac->_edges_count = h->edges;
+	ac->_patterns_count = h->patterns;
+	ac->_unique = h->unique;
+	ac->_keepalive = keepalive;
+	// проверяем индексы, чтобы поврежденный образ не приводил к выходу за границы при поиске.
+	// Состояния идут в порядке обхода в ширину: переходы ведут к большему номеру, ссылки неудачи
+	// и выхода - к меньшему, иначе цикл в образе зациклил бы поиск. Длина шаблона равна глубине
+	// его состояния, иначе совпадение начиналось бы до начала текста
+	std::vector<uint32_t> depth(ac->_states_count, 0);
+	for(uint32_t i = 0; i < ac->_states_count; i++)
+	{
+		const state &s = ac->_states[i];
+		bool bad = (uint64_t) s.edges_first + s.edges_count > ac->_edges_count || (i != 0 && s.fail >= i) || (i == 0 && s.fail != 0) ||
+			(s.pattern != FLATAC_NONE && (s.pattern >= ac->_patterns_count || ac->_patterns[s.pattern].length != depth[i])) ||
+			(s.output != FLATAC_NONE && (s.output >= i || ac->_states[s.output].pattern == FLATAC_NONE));
+		for(uint32_t e = s.edges_first; !bad && e < s.edges_first + s.edges_count; e++)
+		{
+			uint32_t next = ac->_edge_next[e];
+			bad = next <= i || next >= ac->_states_count;
+			if(!bad)
+				depth[next] = depth[i] + 1;
+		}
+		if(bad)
+		{
+			delete ac;
+			throw Poco::Exception("Automaton image is corrupted");
+		}
+	}
+	for(uint32_t e = 0; e < ac->_edges_count; e++)
+	{
+		if(ac->_edge_next[e] >= ac->_states_count)
+		{
+			delete ac;
+			throw Poco::Exception("Automaton image is corrupted");
+		}
+	}
+	if(ac->_states_count)
+	{
+		for(uint32_t e = ac->_states[0].edges_first; e < ac->_states[0].edges_first + ac->_states[0].edges_count; e++)
+			ac->_root[ac->_edge_alpha[e]] = ac->_edge_next[e];
+	}
+	return ac;
+}
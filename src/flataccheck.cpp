@@ -0,0 +1,218 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+
+/*
+ * extfilter-flataccheck: FlatAC, которым worker ищет по спискам.
+ * - FlatAC против AhoCorasickPlus на одном наборе шаблонов;
+ * - поиск без учета регистра: search(fold_case) и FlatAC(fold_case) против AhoCorasickPlus(fold_case);
+ * - образ FlatAC: serialize() -> fromImage() ищет так же, поврежденный образ отвергается или безопасен.
+ * Возвращает 1, если хотя бы одна проверка не прошла.
+*/
+
+#include <string>
+#include <vector>
+#include <set>
+#include <random>
+#include <algorithm>
+#include <memory>
+#include <string.h>
+#include <Poco/Exception.h>
+#include "AhoCorasickPlus.h"
+#include "flatac.h"
+#include "check.h"
+
+typedef std::vector<std::pair<uint32_t, uint32_t>> matches; // позиция за совпадением, id
+
+static std::string randomText(std::mt19937 &rng, const std::string &alphabet, size_t min_length, size_t max_length)
+{
+	size_t length = min_length + rng() % (max_length - min_length + 1);
+	std::string text;
+	for(size_t i = 0; i < length; i++)
+		text += alphabet[rng() % alphabet.length()];
+	return text;
+}
+
+static matches searchAC(AhoCorasickPlus &ac, const std::string &text)
+{
+	matches result;
+	std::string copy(text);
+	AhoCorasickPlus::Match match;
+	ac.search(&copy[0], copy.length(), false);
+	while(ac.findNext(match))
+		result.push_back(std::make_pair(match.position, match.id));
+	std::sort(result.begin(), result.end());
+	return result;
+}
+
+static matches searchFlat(const FlatAC &flat, const std::string &text, bool fold_case)
+{
+	matches result;
+	FlatAC::Cursor cursor;
+	FlatAC::Match match;
+	flat.search(cursor, text.data(), text.length(), fold_case);
+	while(flat.findNext(cursor, match))
+	{
+		if(match.length > match.position)
+			return matches(1, std::make_pair(FLATAC_NONE, FLATAC_NONE));
+		result.push_back(std::make_pair(match.position, match.id));
+	}
+	std::sort(result.begin(), result.end());
+	return result;
+}
+
+static void checkAutomata(std::vector<std::string> &patterns, std::vector<std::string> &texts, std::unique_ptr<FlatAC> &flat)
+{
+	std::mt19937 rng(1);
+	std::set<std::string> unique;
+	while(unique.size() < 3000)
+		unique.insert(randomText(rng, "abc./", 1, 8));
+	patterns.assign(unique.begin(), unique.end());
+	for(int i = 0; i < 1000; i++)
+		texts.push_back(randomText(rng, "abcABC./", 0, 300));
+
+	AhoCorasickPlus ac;
+	flat.reset(new FlatAC());
+	for(size_t i = 0; i < patterns.size(); i++)
+	{
+		ac.addPattern(patterns[i], i);
+		flat->addPattern(patterns[i], i);
+	}
+	ac.finalize();
+	flat->finalize();
+	expect(flat->size() == patterns.size(), "FlatAC keeps all unique patterns");
+
+	size_t total = 0;
+	for(auto &text : texts)
+	{
+		matches expected = searchAC(ac, text);
+		total += expected.size();
+		expect(searchFlat(*flat, text, false) == expected, "FlatAC matches AhoCorasickPlus on '" + text + "'");
+	}
+	expect(total > 0, "texts have matches");
+
+	FlatAC dup;
+	dup.addPattern("abc", 1);
+	dup.addPattern("abc", 2);
+	dup.addPattern("ab", 3);
+	std::vector<uint32_t> duplicates;
+	dup.finalize(&duplicates);
+	expect(duplicates.size() == 1 && duplicates[0] == 2 && dup.size() == 2, "FlatAC reports the duplicate pattern");
+	std::cout << "automata: " << patterns.size() << " patterns, " << texts.size() << " texts, " << total << " matches" << std::endl;
+}
+
+static FlatAC *loadImage(const std::string &image)
+{
+	// образ в памяти снимка выровнен на 8 байт
+	std::shared_ptr<std::vector<uint64_t>> buffer = std::make_shared<std::vector<uint64_t>>(image.size() / 8 + 1);
+	memcpy(buffer->data(), image.data(), image.size());
+	return FlatAC::fromImage(buffer->data(), image.size(), buffer);
+}
+
+static void checkFold(const std::vector<std::string> &patterns, const std::vector<std::string> &texts, const FlatAC &flat)
+{
+	AhoCorasickPlus ac_fold(true);
+	FlatAC flat_fold(true);
+	for(size_t i = 0; i < patterns.size(); i++)
+	{
+		ac_fold.addPattern(patterns[i], i);
+		flat_fold.addPattern(patterns[i], i);
+	}
+	ac_fold.finalize();
+	flat_fold.finalize();
+	std::string image;
+	flat_fold.serialize(image);
+	std::unique_ptr<FlatAC> loaded(loadImage(image));
+
+	size_t total = 0;
+	for(auto &text : texts)
+	{
+		matches expected = searchAC(ac_fold, text);
+		total += expected.size();
+		expect(searchFlat(flat, text, true) == expected, "FlatAC search(fold_case) matches AhoCorasickPlus(fold_case) on '" + text + "'");
+		expect(searchFlat(flat_fold, text, false) == expected, "FlatAC(fold_case) matches AhoCorasickPlus(fold_case) on '" + text + "'");
+		expect(searchFlat(*loaded, text, false) == expected, "FlatAC(fold_case) from the image folds the case on '" + text + "'");
+	}
+
+	FlatAC host;
+	host.addPattern("example.com", 1);
+	host.finalize();
+	expect(searchFlat(host, "WWW.Example.COM", true) == matches(1, std::make_pair(15, 1)), "FlatAC search(fold_case) finds the upper-case host");
+	expect(searchFlat(host, "WWW.Example.COM", false).empty(), "FlatAC search keeps the case by default");
+	std::cout << "fold case: " << texts.size() << " texts, " << total << " matches" << std::endl;
+}
+
+static void checkImage(const std::vector<std::string> &texts, const FlatAC &flat)
+{
+	std::string image;
+	flat.serialize(image);
+	std::unique_ptr<FlatAC> loaded(loadImage(image));
+	expect(loaded->size() == flat.size() && loaded->states() == flat.states(), "FlatAC image keeps the size");
+	for(auto &text : texts)
+	{
+		expect(searchFlat(*loaded, text, false) == searchFlat(flat, text, false), "FlatAC from the image matches the original on '" + text + "'");
+	}
+
+	size_t truncated = 0;
+	for(size_t size = 0; size < image.size(); size += 1 + image.size() / 500)
+	{
+		try
+		{
+			std::unique_ptr<FlatAC> ac(loadImage(image.substr(0, size)));
+		} catch (Poco::Exception &)
+		{
+			truncated++;
+			continue;
+		}
+		expect(false, "truncated FlatAC image of " + std::to_string(size) + " bytes is rejected");
+	}
+
+	// поврежденный образ должен отвергаться или искать без выхода за границы и зацикливания
+	std::mt19937 rng(2);
+	size_t rejected = 0;
+	for(int i = 0; i < 2000; i++)
+	{
+		std::string bad(image);
+		size_t pos = 4 + rng() % (image.size() - 4);
+		bad[pos] ^= 1 << (rng() % 8);
+		std::unique_ptr<FlatAC> ac;
+		try
+		{
+			ac.reset(loadImage(bad));
+		} catch (Poco::Exception &)
+		{
+			rejected++;
+			continue;
+		}
+		for(size_t t = 0; t < 20; t++)
+			expect(searchFlat(*ac, texts[t], false).size() != 1 || searchFlat(*ac, texts[t], false)[0].first != FLATAC_NONE, "match of the corrupted FlatAC image is inside the text");
+	}
+	std::cout << "image: " << image.size() << " bytes, rejected " << truncated << " truncated and " << rejected << " of 2000 corrupted images" << std::endl;
+}
+
+int main()
+{
+	std::vector<std::string> patterns;
+	std::vector<std::string> texts;
+	std::unique_ptr<FlatAC> flat;
+	checkAutomata(patterns, texts, flat);
+	checkFold(patterns, texts, *flat);
+	checkImage(texts, *flat);
+	return checkResult();
+}
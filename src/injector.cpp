@@ -0,0 +1,188 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#include <netinet/tcp.h>
+#include <algorithm>
+#include <rte_malloc.h>
+#include <rte_ip.h>
+#include <rte_tcp.h>
+#include <rte_ether.h>
+#include <rte_cycles.h>
+#include <Poco/Exception.h>
+#include "injector.h"
+
+PacketInjector::PacketInjector(uint8_t port, uint16_t queue, struct rte_mempool *pool, const struct CSender::params &prm, bool hw_cksum) :
+	_port(port),
+	_queue(queue),
+	_pool(pool),
+	_parameters(prm),
+	_template(prm.code, prm.redirect_url),
+	_hw_cksum(hw_cksum),
+	_ip_id(0),
+	_sent(0),
+	_dropped(0),
+	_no_mbufs(0),
+	_latency(rte_get_tsc_hz()),
+	_stamps_count(0)
+{
+	_buffer = (struct rte_eth_dev_tx_buffer *) rte_zmalloc_socket("inject_buffer", RTE_ETH_TX_BUFFER_SIZE(INJECT_BURST_SIZE), 0, rte_eth_dev_socket_id(port));
+	if(_buffer == nullptr)
+		throw Poco::Exception("Unable to allocate the tx buffer for the injector");
+	rte_eth_tx_buffer_init(_buffer, INJECT_BURST_SIZE);
+	// неотправленные пакеты освобождаются и учитываются в _dropped
+	rte_eth_tx_buffer_set_err_callback(_buffer, rte_eth_tx_buffer_count_callback, &_dropped);
+}
+
+PacketInjector::~PacketInjector()
+{
+	flush();
+	rte_free(_buffer);
+}
+
+void PacketInjector::send(const uint8_t *frame, const uint8_t *l3, int ip_version, bool to_client, uint32_t acknum, uint32_t seqnum, const char *param, size_t param_length, int f_reset, int f_psh)
+{
+	size_t l2_len = l3 - frame;
+	size_t l3_len = (ip_version == 4) ? sizeof(struct ipv4_hdr) : sizeof(struct ipv6_hdr);
+	size_t hdr_len = l2_len + l3_len + sizeof(struct tcp_hdr);
+	struct rte_mbuf *m = rte_pktmbuf_alloc(_pool);
+	if(m == nullptr)
+	{
+		_no_mbufs++;
+		return;
+	}
+	if(rte_pktmbuf_tailroom(m) < hdr_len)
+	{
+		rte_pktmbuf_free(m);
+		_no_mbufs++;
+		return;
+	}
+	uint8_t *pkt = rte_pktmbuf_mtod(m, uint8_t *);
+	// ответ пишется из шаблона сразу после заголовков, rst без данных
+	uint32_t payload_sum = 0;
+	size_t length = 0;
+	if(!f_reset)
+		length = _template.build((char *)pkt + hdr_len, std::min((size_t)(_parameters.mtu - l3_len - sizeof(struct tcp_hdr)), (size_t)(rte_pktmbuf_tailroom(m) - hdr_len)), param, param_length, payload_sum);
+	rte_pktmbuf_append(m, hdr_len + length);
+	// L2 вместе с тегами vlan как в исходном пакете
+	memcpy(pkt, frame, l2_len);
+	if(to_client)
+	{
+		struct ether_hdr *eth = (struct ether_hdr *) pkt;
+		ether_addr_copy(&((const struct ether_hdr *) frame)->s_addr, &eth->d_addr);
+		ether_addr_copy(&((const struct ether_hdr *) frame)->d_addr, &eth->s_addr);
+	}
+	struct tcp_hdr *tcph = (struct tcp_hdr *)(pkt + l2_len + l3_len);
+	const struct tcphdr *orig_tcph = (const struct tcphdr *)(l3 + (ip_version == 4 ? (((const struct ipv4_hdr *) l3)->version_ihl & IPV4_HDR_IHL_MASK) * IPV4_IHL_MULTIPLIER : l3_len));
+	tcph->src_port = to_client ? orig_tcph->dest : orig_tcph->source;
+	tcph->dst_port = to_client ? orig_tcph->source : orig_tcph->dest;
+	tcph->sent_seq = to_client ? acknum : seqnum;
+	tcph->recv_ack = to_client ? seqnum : acknum;
+	tcph->data_off = (sizeof(struct tcp_hdr) / 4) << 4;
+	if(f_reset)
+	{
+		tcph->tcp_flags = TH_RST | TH_ACK;
+		tcph->rx_win = 0;
+	} else {
+		tcph->tcp_flags = TH_FIN | TH_ACK | (f_psh ? TH_PUSH : 0);
+		tcph->rx_win = rte_cpu_to_be_16(5840);
+	}
+	tcph->cksum = 0;
+	tcph->tcp_urp = 0;
+
+	m->l2_len = l2_len;
+	m->l3_len = l3_len;
+	if(ip_version == 4)
+	{
+		const struct ipv4_hdr *orig = (const struct ipv4_hdr *) l3;
+		struct ipv4_hdr *iph = (struct ipv4_hdr *)(pkt + l2_len);
+		iph->version_ihl = 0x45;
+		iph->type_of_service = 0;
+		iph->total_length = rte_cpu_to_be_16(l3_len + sizeof(struct tcp_hdr) + length);
+		iph->packet_id = rte_cpu_to_be_16(_ip_id++);
+		iph->fragment_offset = 0;
+		iph->time_to_live = _parameters.ttl;
+		iph->next_proto_id = IPPROTO_TCP;
+		iph->hdr_checksum = 0;
+		iph->src_addr = to_client ? orig->dst_addr : orig->src_addr;
+		iph->dst_addr = to_client ? orig->src_addr : orig->dst_addr;
+		if(_hw_cksum)
+		{
+			m->ol_flags = PKT_TX_IPV4 | PKT_TX_IP_CKSUM | PKT_TX_TCP_CKSUM;
+			tcph->cksum = rte_ipv4_phdr_cksum(iph, m->ol_flags);
+		} else {
+			tcph->cksum = RedirectTemplate::tcpChecksum(rte_ipv4_phdr_cksum(iph, 0), tcph, sizeof(struct tcp_hdr), payload_sum);
+			iph->hdr_checksum = rte_ipv4_cksum(iph);
+		}
+	} else {
+		const struct ipv6_hdr *orig = (const struct ipv6_hdr *) l3;
+		struct ipv6_hdr *iph6 = (struct ipv6_hdr *)(pkt + l2_len);
+		iph6->vtc_flow = rte_cpu_to_be_32(6 << 28);
+		iph6->payload_len = rte_cpu_to_be_16(sizeof(struct tcp_hdr) + length);
+		iph6->proto = IPPROTO_TCP;
+		iph6->hop_limits = _parameters.ip6_hops;
+		memcpy(iph6->src_addr, to_client ? orig->dst_addr : orig->src_addr, sizeof(iph6->src_addr));
+		memcpy(iph6->dst_addr, to_client ? orig->src_addr : orig->dst_addr, sizeof(iph6->dst_addr));
+		if(_hw_cksum)
+		{
+			m->ol_flags = PKT_TX_IPV6 | PKT_TX_TCP_CKSUM;
+			tcph->cksum = rte_ipv6_phdr_cksum(iph6, m->ol_flags);
+		} else {
+			tcph->cksum = RedirectTemplate::tcpChecksum(rte_ipv6_phdr_cksum(iph6, 0), tcph, sizeof(struct tcp_hdr), payload_sum);
+		}
+	}
+	_sent += rte_eth_tx_buffer(_port, _queue, _buffer, m);
+}
+
+void PacketInjector::addLatency()
+{
+	uint64_t now = rte_rdtsc();
+	for(unsigned i = 0; i < _stamps_count; i++)
+		_latency.add(now > _stamps[i] ? now - _stamps[i] : 0);
+	_stamps_count = 0;
+}
+
+void PacketInjector::stamp(uint64_t timestamp)
+{
+	// каждый ответ - хотя бы один пакет, поэтому при заполнении массива
+	// буфер уже переполнялся и ранние ответы переданы порту
+	if(_stamps_count == INJECT_BURST_SIZE)
+		addLatency();
+	_stamps[_stamps_count++] = timestamp;
+}
+
+void PacketInjector::redirect(const uint8_t *frame, const uint8_t *l3, int ip_version, uint32_t acknum, uint32_t seqnum, int f_psh, const char *param, size_t param_length, uint64_t timestamp)
+{
+	send(frame, l3, ip_version, true, acknum, seqnum, param, param_length, 0, f_psh);
+	if(_parameters.send_rst_to_server)
+		send(frame, l3, ip_version, false, acknum, seqnum, nullptr, 0, 1, 0);
+	stamp(timestamp);
+}
+
+void PacketInjector::reset(const uint8_t *frame, const uint8_t *l3, int ip_version, uint32_t acknum, uint32_t seqnum, uint64_t timestamp)
+{
+	const struct tcphdr *orig_tcph = (const struct tcphdr *)(l3 + (ip_version == 4 ? (((const struct ipv4_hdr *) l3)->version_ihl & IPV4_HDR_IHL_MASK) * IPV4_IHL_MULTIPLIER : sizeof(struct ipv6_hdr)));
+	uint16_t window = rte_be_to_cpu_16(orig_tcph->window);
+	// серия rst со сдвигом seq, вся серия уходит одной пачкой через буфер передачи
+	CSender::rstSeries(_parameters.rst_burst, window, _parameters.send_rst_to_server, acknum, seqnum,
+		[&](bool to_client, uint32_t ack, uint32_t seq)
+		{
+			send(frame, l3, ip_version, to_client, ack, seq, nullptr, 0, 1, 0);
+		});
+	stamp(timestamp);
+}
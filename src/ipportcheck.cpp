@@ -0,0 +1,261 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+
+
+/*
+ * extfilter-ipportcheck: таблица ip:port.
+ * - отдельные порты, диапазоны (bitmap) и все порты адреса против простой модели, ipv4 и ipv6;
+ * - образ: serialize() -> fromImage() ищет так же, усеченный образ отвергается,
+ *   поврежденный отвергается или ищет без выхода за границы.
+ * Возвращает 1, если хотя бы одна проверка не прошла.
+*/
+
+#include <string>
+#include <vector>
+#include <map>
+#include <random>
+#include <memory>
+#include <string.h>
+#include <arpa/inet.h>
+#include <Poco/Exception.h>
+#include "ipporttable.h"
+#include "check.h"
+
+// модель таблицы: адрес (16 байт, ipv4 как ::ffff:a.b.c.d) -> порты
+struct model_entry
+{
+	bool any;
+	std::vector<std::pair<uint16_t, uint16_t>> ranges;
+	model_entry() : any(false) {}
+};
+
+typedef std::map<std::string, model_entry> model;
+
+struct probe
+{
+	uint8_t addr[16];
+	bool ipv4;
+	uint16_t port;
+};
+
+static std::string mapped(const uint8_t *addr, bool ipv4)
+{
+	uint8_t key[16];
+	if(ipv4)
+	{
+		memset(key, 0, 10);
+		key[10] = 0xff;
+		key[11] = 0xff;
+		memcpy(key + 12, addr, 4);
+	} else {
+		memcpy(key, addr, 16);
+	}
+	return std::string((const char *) key, 16);
+}
+
+static bool modelLookup(const model &m, const probe &p)
+{
+	auto it = m.find(mapped(p.addr, p.ipv4));
+	if(it == m.end())
+		return false;
+	if(it->second.any)
+		return true;
+	for(auto &r : it->second.ranges)
+	{
+		if(p.port >= r.first && p.port <= r.second)
+			return true;
+	}
+	return false;
+}
+
+static bool tableLookup(const IPPortTable &table, const probe &p)
+{
+	if(p.ipv4)
+	{
+		uint32_t ip;
+		memcpy(&ip, p.addr, 4);
+		return table.lookup4(ip, p.port);
+	}
+	return table.lookup6(p.addr, p.port);
+}
+
+static void randomAddress(std::mt19937 &rng, uint8_t *addr, bool &ipv4)
+{
+	// мало разных адресов, чтобы у адреса было несколько записей и проверки попадали в них
+	ipv4 = rng() % 2;
+	memset(addr, 0, 16);
+	if(ipv4)
+	{
+		addr[0] = 10;
+		addr[3] = rng() % 200;
+	} else {
+		addr[0] = 0x20;
+		addr[1] = 0x01;
+		addr[15] = rng() % 200;
+	}
+}
+
+static uint16_t randomPort(std::mt19937 &rng)
+{
+	// порты около границ диапазонов и bitmap'ов
+	static const uint16_t ports[] = { 1, 63, 64, 80, 443, 8080, 65472, 65535 };
+	if(rng() % 2)
+		return ports[rng() % (sizeof(ports) / sizeof(ports[0]))] + (rng() % 3) - 1;
+	return rng() % 65536;
+}
+
+static std::vector<probe> makeProbes(std::mt19937 &rng, size_t count)
+{
+	std::vector<probe> probes(count);
+	for(auto &p : probes)
+	{
+		randomAddress(rng, p.addr, p.ipv4);
+		p.port = randomPort(rng);
+	}
+	return probes;
+}
+
+static IPPortTable *loadImage(const std::string &image)
+{
+	// образ в памяти снимка выровнен на 8 байт
+	std::shared_ptr<std::vector<uint64_t>> buffer = std::make_shared<std::vector<uint64_t>>(image.size() / 8 + 1);
+	memcpy(buffer->data(), image.data(), image.size());
+	return IPPortTable::fromImage(buffer->data(), image.size(), buffer);
+}
+
+static void checkTable(std::unique_ptr<IPPortTable> &table, std::vector<probe> &probes)
+{
+	std::mt19937 rng(4);
+	model m;
+	table.reset(new IPPortTable());
+	for(int i = 0; i < 600; i++)
+	{
+		uint8_t addr[16];
+		bool ipv4;
+		randomAddress(rng, addr, ipv4);
+		model_entry &e = m[mapped(addr, ipv4)];
+		uint16_t from, to;
+		switch(rng() % 10)
+		{
+			case 0:
+				from = 0;
+				to = 0;
+				break;
+			case 1:
+			case 2:
+			case 3:
+				from = randomPort(rng);
+				to = from + rng() % 2000;
+				if(to < from)
+					to = 65535;
+				break;
+			default:
+				from = randomPort(rng);
+				if(from == 0)
+					from = 1;
+				to = (rng() % 2) ? from : 0; // конец диапазона не больше начала - один порт
+				break;
+		}
+		if(from == 0)
+			e.any = true;
+		else
+			e.ranges.push_back(std::make_pair(from, to > from ? to : from));
+		table->add(addr, ipv4 ? 4 : 16, from, to);
+	}
+	table->build();
+	expect(table->size() > 0 && table->bitmaps() > 0, "IPPortTable has entries and bitmaps");
+
+	probes = makeProbes(rng, 200000);
+	size_t hits = 0;
+	for(auto &p : probes)
+	{
+		bool expected = modelLookup(m, p);
+		hits += expected;
+		if(tableLookup(*table, p) != expected)
+		{
+			char text[INET6_ADDRSTRLEN];
+			inet_ntop(p.ipv4 ? AF_INET : AF_INET6, p.addr, text, sizeof(text));
+			expect(false, std::string("IPPortTable lookup of ") + text + " port " + std::to_string(p.port) + " matches the model");
+		}
+	}
+	expect(hits > 0 && hits < probes.size(), "lookups have hits and misses");
+
+	IPPortTable empty;
+	empty.build();
+	expect(!tableLookup(empty, probes[0]), "empty IPPortTable finds nothing");
+	std::cout << "ip:port table: " << table->size() << " entries, " << table->bitmaps() << " bitmaps, " << hits << " hits of " << probes.size() << " lookups" << std::endl;
+}
+
+static void checkImage(const IPPortTable &table, const std::vector<probe> &probes)
+{
+	std::string image;
+	table.serialize(image);
+	std::unique_ptr<IPPortTable> loaded(loadImage(image));
+	expect(loaded->size() == table.size() && loaded->bitmaps() == table.bitmaps(), "IPPortTable image keeps the size");
+	bool same = true;
+	for(auto &p : probes)
+		same &= (tableLookup(*loaded, p) == tableLookup(table, p));
+	expect(same, "IPPortTable from the image matches the original");
+
+	size_t truncated = 0;
+	for(size_t size = 0; size < image.size(); size += 1 + image.size() / 500)
+	{
+		try
+		{
+			std::unique_ptr<IPPortTable> t(loadImage(image.substr(0, size)));
+		} catch (Poco::Exception &)
+		{
+			truncated++;
+			continue;
+		}
+		expect(false, "truncated IPPortTable image of " + std::to_string(size) + " bytes is rejected");
+	}
+
+	// поврежденный образ должен отвергаться или искать без выхода за границы и зацикливания
+	std::mt19937 rng(5);
+	size_t rejected = 0;
+	for(int i = 0; i < 2000; i++)
+	{
+		std::string bad(image);
+		size_t pos = rng() % image.size();
+		bad[pos] ^= 1 << (rng() % 8);
+		std::unique_ptr<IPPortTable> t;
+		try
+		{
+			t.reset(loadImage(bad));
+		} catch (Poco::Exception &)
+		{
+			rejected++;
+			continue;
+		}
+		for(size_t n = 0; n < 100; n++)
+			tableLookup(*t, probes[n]);
+	}
+	std::cout << "image: " << image.size() << " bytes, rejected " << truncated << " truncated and " << rejected << " of 2000 corrupted images" << std::endl;
+}
+
+int main()
+{
+	std::unique_ptr<IPPortTable> table;
+	std::vector<probe> probes;
+	checkTable(table, probes);
+	checkImage(*table, probes);
+	return checkResult();
+}
@@ -0,0 +1,171 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#include <Poco/Exception.h>
+#include "ipporttable.h"
+
+#define IPPORT_MIN_SLOTS 16
+
+IPPortTable::IPPortTable() :
+	_slots_ptr(nullptr),
+	_bitmaps_ptr(nullptr),
+	_bitmaps_words(0),
+	_mask(0),
+	_count(0)
+{
+}
+
+IPPortTable::~IPPortTable()
+{
+}
+
+void IPPortTable::add(const void *address, int length, uint16_t port_from, uint16_t port_to)
+{
+	std::vector<uint8_t> key(16);
+	if(length == 4)
+		map_ipv4(address, key.data());
+	else
+		memcpy(key.data(), address, 16);
+	pending_entry &e = _pending[key];
+	if(port_from == 0)
+		e.any = true;
+	else if(port_to <= port_from)
+		e.ports.insert(port_from);
+	else
+		e.ranges.push_back(std::make_pair(port_from, port_to));
+}
+
+void IPPortTable::insert(const uint8_t *addr, uint32_t port, uint32_t value)
+{
+	uint64_t i = hash(addr, port) & _mask;
+	while(_slots[i].port != IPPORT_EMPTY_SLOT)
+	{
+		if(_slots[i].port == port && memcmp(_slots[i].addr, addr, 16) == 0)
+			return;
+		i = (i + 1) & _mask;
+	}
+	memcpy(_slots[i].addr, addr, 16);
+	_slots[i].port = port;
+	_slots[i].value = value;
+	_count++;
+}
+
+void IPPortTable::build()
+{
+	size_t entries = 0;
+	for(auto &it : _pending)
+	{
+		const pending_entry &e = it.second;
+		if(e.any)
+			entries++;
+		else
+			entries += e.ports.size() + (e.ranges.empty() ? 0 : 1);
+	}
+	size_t size = IPPORT_MIN_SLOTS;
+	while(size < entries * 2)
+		size <<= 1;
+	slot empty;
+	memset(&empty, 0, sizeof(empty));
+	empty.port = IPPORT_EMPTY_SLOT;
+	_slots.assign(size, empty);
+	_mask = size - 1;
+	_count = 0;
+	_bitmaps.clear();
+
+	for(auto &it : _pending)
+	{
+		const uint8_t *addr = it.first.data();
+		const pending_entry &e = it.second;
+		if(e.any)
+		{
+			// все порты перекрывают отдельные порты и диапазоны
+			insert(addr, IPPORT_ANY, 0);
+			continue;
+		}
+		for(auto port : e.ports)
+			insert(addr, port, 0);
+		if(!e.ranges.empty())
+		{
+			size_t first = _bitmaps.size();
+			_bitmaps.resize(first + IPPORT_BITMAP_WORDS, 0);
+			for(auto &r : e.ranges)
+			{
+				for(uint32_t port = r.first; port <= r.second; port++)
+					_bitmaps[first + (port >> 6)] |= 1ULL << (port & 63);
+			}
+			insert(addr, IPPORT_ANY, first / IPPORT_BITMAP_WORDS + 1);
+		}
+	}
+	_pending.clear();
+	_slots_ptr = _slots.data();
+	_bitmaps_ptr = _bitmaps.data();
+	_bitmaps_words = _bitmaps.size();
+}
+
+void IPPortTable::serialize(std::string &out) const
+{
+	image_header h;
+	memset(&h, 0, sizeof(h));
+	h.magic = IPPORT_IMAGE_MAGIC;
+	h.slots = _slots_ptr ? _mask + 1 : 0;
+	h.bitmaps_words = _bitmaps_words;
+	h.count = _count;
+	out.append((const char *) &h, sizeof(h));
+	out.append((const char *) _slots_ptr, h.slots * sizeof(slot));
+	out.append((const char *) _bitmaps_ptr, h.bitmaps_words * sizeof(uint64_t));
+}
+
+IPPortTable *IPPortTable::fromImage(const void *image, size_t size, std::shared_ptr<const void> keepalive)
+{
+	const uint8_t *p = (const uint8_t *) image;
+	if(size < sizeof(image_header))
+		throw Poco::Exception("IP:port table image is too short");
+	const image_header *h = (const image_header *) p;
+	if(h->magic != IPPORT_IMAGE_MAGIC)
+		throw Poco::Exception("Bad IP:port table image magic");
+	if(h->slots & (h->slots - 1) || h->bitmaps_words % IPPORT_BITMAP_WORDS || h->count > h->slots)
+		throw Poco::Exception("IP:port table image is corrupted");
+	if(h->slots > size / sizeof(slot) || h->bitmaps_words > size / sizeof(uint64_t) ||
+		sizeof(image_header) + h->slots * sizeof(slot) + h->bitmaps_words * sizeof(uint64_t) > size)
+		throw Poco::Exception("IP:port table image is truncated");
+	IPPortTable *table = new IPPortTable();
+	table->_slots_ptr = (const slot *)(p + sizeof(image_header));
+	table->_bitmaps_ptr = (const uint64_t *)(p + sizeof(image_header) + h->slots * sizeof(slot));
+	table->_bitmaps_words = h->bitmaps_words;
+	table->_mask = h->slots ? h->slots - 1 : 0;
+	table->_count = h->slots ? h->count : 0;
+	table->_keepalive = keepalive;
+	// поиск останавливается на пустой ячейке, а номер bitmap не должен выходить за пределы образа
+	bool has_empty = (h->slots == 0);
+	bool corrupted = false;
+	for(uint64_t i = 0; i < h->slots && !corrupted; i++)
+	{
+		const slot &s = table->_slots_ptr[i];
+		if(s.port == IPPORT_EMPTY_SLOT)
+			has_empty = true;
+		else if(s.port == IPPORT_ANY && s.value > h->bitmaps_words / IPPORT_BITMAP_WORDS)
+			corrupted = true;
+	}
+	if(corrupted || !has_empty)
+	{
+		delete table;
+		throw Poco::Exception("IP:port table image is corrupted");
+	}
+	return table;
+}
@@ -0,0 +1,109 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+
+/*
+ * extfilter-learnedcheck: общая для worker'ов таблица выученных ip:port.
+ * - поколение списков и время жизни записи;
+ * - отсутствие разорванных записей при записи и чтении из нескольких потоков.
+ * Возвращает 1, если хотя бы одна проверка не прошла.
+*/
+
+#include <string>
+#include <vector>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <unistd.h>
+#include "learnedtable.h"
+#include "check.h"
+
+static uint32_t learnedLine(uint32_t addr, uint16_t port)
+{
+	return (addr * 2654435761U) ^ ((uint32_t) port << 16) ^ 0x5bd1e995;
+}
+
+static void checkLearnedTable()
+{
+	{
+		LearnedTable table(1024, 1000);
+		const uint8_t addr4[4] = { 10, 0, 0, 1 };
+		uint8_t addr6[16] = { 0 };
+		addr6[15] = 1;
+		uint32_t lineno = 0;
+		table.insert(addr4, 4, 443, 7, 1, 100);
+		expect(table.lookup(addr4, 4, 443, 1, 200, lineno) && lineno == 7, "LearnedTable finds the entry");
+		expect(!table.lookup(addr4, 4, 80, 1, 200, lineno), "LearnedTable compares the port");
+		expect(!table.lookup(addr4, 4, 443, 2, 200, lineno), "LearnedTable entry is valid for its generation only");
+		expect(!table.lookup(addr4, 4, 443, 1, 1100, lineno), "LearnedTable entry expires");
+		expect(!table.lookup(addr6, 16, 443, 1, 200, lineno), "LearnedTable separates ipv4 and ipv6");
+		expect(table.occupancy(200) == 1 && table.occupancy(1100) == 0, "LearnedTable occupancy");
+	}
+
+	// маленькая таблица: писатели постоянно вытесняют записи друг друга
+	LearnedTable table(64, 1ULL << 62);
+	std::atomic<bool> stop(false);
+	std::atomic<uint64_t> torn(0), hits(0);
+	std::vector<std::thread> threads;
+	for(int w = 0; w < 3; w++)
+	{
+		threads.emplace_back([&table, &stop, w]()
+		{
+			std::mt19937 rng(10 + w);
+			while(!stop.load(std::memory_order_relaxed))
+			{
+				uint32_t addr = rng() % 4096;
+				uint16_t port = 80 + rng() % 4;
+				table.insert(&addr, 4, port, learnedLine(addr, port), 1, 1);
+			}
+		});
+	}
+	for(int r = 0; r < 2; r++)
+	{
+		threads.emplace_back([&table, &stop, &torn, &hits, r]()
+		{
+			std::mt19937 rng(20 + r);
+			while(!stop.load(std::memory_order_relaxed))
+			{
+				uint32_t addr = rng() % 4096;
+				uint16_t port = 80 + rng() % 4;
+				uint32_t lineno;
+				if(table.lookup(&addr, 4, port, 1, 2, lineno))
+				{
+					hits.fetch_add(1, std::memory_order_relaxed);
+					if(lineno != learnedLine(addr, port))
+						torn.fetch_add(1, std::memory_order_relaxed);
+				}
+			}
+		});
+	}
+	usleep(500000);
+	stop.store(true);
+	for(auto &t : threads)
+		t.join();
+	expect(hits.load() > 0, "LearnedTable readers find the entries of the writers");
+	expect(torn.load() == 0, "LearnedTable readers never see a partially written entry");
+	std::cout << "learned table: " << hits.load() << " concurrent hits, " << torn.load() << " torn" << std::endl;
+}
+
+int main()
+{
+	checkLearnedTable();
+	return checkResult();
+}
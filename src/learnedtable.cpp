@@ -0,0 +1,91 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#include "learnedtable.h"
+
+LearnedTable::LearnedTable(size_t size, uint64_t ttl) :
+	_ttl(ttl)
+{
+	size_t n = 16;
+	while(n < size)
+		n <<= 1;
+	_slots = new slot[n];
+	for(size_t i = 0; i < n; i++)
+	{
+		_slots[i].seq.store(0, std::memory_order_relaxed);
+		memset(&_slots[i].data, 0, sizeof(slot_data));
+	}
+	_mask = n - 1;
+}
+
+LearnedTable::~LearnedTable()
+{
+	delete [] _slots;
+}
+
+void LearnedTable::insert(const void *addr, int length, uint16_t port, uint32_t lineno, uint32_t generation, uint64_t now)
+{
+	uint8_t key[16];
+	makeKey(addr, length, key);
+	uint64_t i = hash(key, port) & _mask;
+	// своя, свободная или устаревшая ячейка, иначе самая старая
+	slot *victim = nullptr;
+	uint64_t victim_expire = UINT64_MAX;
+	for(int p = 0; p < LEARNED_PROBES; p++, i = (i + 1) & _mask)
+	{
+		slot_data d;
+		if(!read(_slots[i], d))
+			continue;
+		if(d.expire != 0 && d.port == port && memcmp(d.addr, key, 16) == 0)
+		{
+			victim = &_slots[i];
+			break;
+		}
+		uint64_t expire = (d.expire <= now) ? 0 : d.expire;
+		if(expire < victim_expire)
+		{
+			victim = &_slots[i];
+			victim_expire = expire;
+		}
+	}
+	if(victim == nullptr)
+		return;
+	uint32_t seq = victim->seq.load(std::memory_order_relaxed);
+	if((seq & 1) || !victim->seq.compare_exchange_strong(seq, seq + 1, std::memory_order_acquire, std::memory_order_relaxed))
+		return;
+	std::atomic_thread_fence(std::memory_order_release);
+	memcpy(victim->data.addr, key, 16);
+	victim->data.port = port;
+	victim->data.lineno = lineno;
+	victim->data.generation = generation;
+	victim->data.expire = now + _ttl;
+	victim->seq.store(seq + 2, std::memory_order_release);
+}
+
+size_t LearnedTable::occupancy(uint64_t now) const
+{
+	size_t count = 0;
+	for(uint64_t i = 0; i <= _mask; i++)
+	{
+		slot_data d;
+		if(read(_slots[i], d) && d.expire > now)
+			count++;
+	}
+	return count;
+}
@@ -0,0 +1,59 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+
+/*
+ * extfilter-limitercheck: ограничение редиректов и rst одному абоненту.
+ * - размер пачки, интервал 1/rate и средняя скорость;
+ * - абоненты ограничиваются независимо, rate 0 не ограничивает.
+ * Возвращает 1, если хотя бы одна проверка не прошла.
+*/
+
+#include <string>
+#include "injectlimiter.h"
+#include "check.h"
+
+static void checkInjectLimiter()
+{
+	const uint64_t hz = 1000000;
+	InjectLimiter limiter(10, 3, hz);
+	const uint8_t a[4] = { 10, 0, 0, 1 }, b[4] = { 10, 0, 0, 2 };
+	uint64_t now = hz;
+	int burst = 0;
+	while(limiter.allow(a, 4, now) && burst < 100)
+		burst++;
+	expect(burst == 3, "InjectLimiter allows the burst of 3, allowed " + std::to_string(burst));
+	expect(limiter.allow(b, 4, now), "InjectLimiter limits the subscribers separately");
+	expect(!limiter.allow(a, 4, now + hz / 10 - 1) && limiter.allow(a, 4, now + hz / 10), "InjectLimiter allows the next injection after 1/rate");
+	uint64_t allowed = 0;
+	for(uint64_t t = 0; t < 10 * hz; t += hz / 1000)
+		allowed += limiter.allow(b, 4, 100 * hz + t);
+	expect(allowed >= 102 && allowed <= 103, "InjectLimiter keeps the rate, allowed " + std::to_string(allowed) + " in 10 seconds");
+	InjectLimiter unlimited(0, 0, hz);
+	bool all = true;
+	for(int i = 0; i < 1000; i++)
+		all &= unlimited.allow(a, 4, now);
+	expect(all, "InjectLimiter without the rate allows everything");
+}
+
+int main()
+{
+	checkInjectLimiter();
+	return checkResult();
+}
@@ -0,0 +1,418 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <exception>
+#include <functional>
+#include <algorithm>
+#include <iterator>
+#include <Poco/Exception.h>
+#include <Poco/NumberParser.h>
+#include <Poco/Net/IPAddress.h>
+#include "listloader.h"
+#include "ipporttable.h"
+#include "prefixlist.h"
+#include "snapshot.h"
+
+// минимальный размер куска файла для отдельного потока разбора
+#ifndef LISTLOADER_MIN_CHUNK
+#define LISTLOADER_MIN_CHUNK (256 * 1024)
+#endif
+
+namespace
+{
+
+/// Файл списка, отображенный в память только для чтения.
+class MappedFile
+{
+public:
+	MappedFile(const std::string &fn) : _data(nullptr), _size(0)
+	{
+		int fd = ::open(fn.c_str(), O_RDONLY);
+		if(fd < 0)
+			throw Poco::OpenFileException(fn);
+		struct stat st;
+		if(fstat(fd, &st) != 0)
+		{
+			::close(fd);
+			throw Poco::FileException("Unable to stat " + fn);
+		}
+		if(st.st_size > 0)
+		{
+			void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+			if(data == MAP_FAILED)
+			{
+				::close(fd);
+				throw Poco::FileException("Unable to mmap " + fn);
+			}
+			_data = (const char *) data;
+			_size = st.st_size;
+			madvise(data, _size, MADV_SEQUENTIAL);
+		}
+		::close(fd);
+	}
+
+	~MappedFile()
+	{
+		if(_data)
+			munmap((void *) _data, _size);
+	}
+
+	inline const char *data() const
+	{
+		return _data;
+	}
+
+	inline size_t size() const
+	{
+		return _size;
+	}
+
+private:
+	MappedFile(const MappedFile &);
+	MappedFile &operator=(const MappedFile &);
+
+	const char *_data;
+	size_t _size;
+};
+
+/// Кусок файла из целых строк.
+struct chunk
+{
+	const char *begin;
+	const char *end;
+	int first_line; // номер первой строки куска в файле
+};
+
+/// Потоки разбора идут на ядрах, к которым привязан вызывающий поток (в extFilter это ядра, не занятые DPDK).
+unsigned parseThreads()
+{
+	cpu_set_t set;
+	if(sched_getaffinity(0, sizeof(set), &set) == 0 && CPU_COUNT(&set) > 0)
+		return CPU_COUNT(&set);
+	return 1;
+}
+
+/// Call fn for every chunk, chunks are processed in parallel. The first exception is rethrown.
+void runChunks(size_t chunks, const std::function<void(size_t)> &fn)
+{
+	if(chunks <= 1)
+	{
+		if(chunks)
+			fn(0);
+		return;
+	}
+	std::vector<std::exception_ptr> errors(chunks);
+	auto run = [&fn, &errors](size_t i)
+	{
+		try
+		{
+			fn(i);
+		} catch (...)
+		{
+			errors[i] = std::current_exception();
+		}
+	};
+	std::vector<std::thread> threads;
+	for(size_t i = 1; i < chunks; i++)
+		threads.emplace_back(run, i);
+	run(0);
+	for(auto &t : threads)
+		t.join();
+	for(auto &e : errors)
+	{
+		if(e)
+			std::rethrow_exception(e);
+	}
+}
+
+/// Split the file on the line boundaries and number the lines of the chunks.
+std::vector<chunk> splitChunks(const MappedFile &file)
+{
+	std::vector<chunk> chunks;
+	size_t size = file.size();
+	if(size == 0)
+		return chunks;
+	size_t count = std::min<size_t>(parseThreads(), std::max<size_t>(1, size / LISTLOADER_MIN_CHUNK));
+	const char *p = file.data();
+	const char *end = file.data() + size;
+	for(size_t i = 0; i < count && p < end; i++)
+	{
+		const char *e = (i + 1 == count) ? end : std::min(end, p + size / count);
+		if(e < end)
+		{
+			const char *nl = (const char *) memchr(e, '\n', end - e);
+			e = nl ? nl + 1 : end;
+		}
+		chunk c;
+		c.begin = p;
+		c.end = e;
+		c.first_line = 0;
+		chunks.push_back(c);
+		p = e;
+	}
+	// номера строк нужны для сообщений и метаданных шаблонов, поэтому сначала считаем строки в кусках
+	std::vector<int> lines(chunks.size());
+	runChunks(chunks.size(), [&chunks, &lines](size_t i)
+	{
+		lines[i] = std::count(chunks[i].begin, chunks[i].end, '\n');
+	});
+	int line = 1;
+	for(size_t i = 0; i < chunks.size(); i++)
+	{
+		chunks[i].first_line = line;
+		line += lines[i];
+	}
+	return chunks;
+}
+
+/// Call fn(line, length, lineno) for every line of the chunk except empty lines and comments. Line is not copied.
+template<typename F>
+void forEachLine(const chunk &c, F fn)
+{
+	int lineno = c.first_line;
+	for(const char *p = c.begin; p < c.end; lineno++)
+	{
+		const char *nl = (const char *) memchr(p, '\n', c.end - p);
+		const char *e = nl ? nl : c.end;
+		if(e > p && *p != '#' && *p != ';')
+			fn(p, (size_t)(e - p), lineno);
+		p = e + 1;
+	}
+}
+
+/// Move the results of the chunks to out in the file order.
+template<typename T>
+void appendChunks(std::vector<std::vector<T>> &parsed, std::vector<T> &out)
+{
+	size_t total = out.size();
+	for(auto &v : parsed)
+		total += v.size();
+	out.reserve(total);
+	for(auto &v : parsed)
+	{
+		out.insert(out.end(), std::make_move_iterator(v.begin()), std::make_move_iterator(v.end()));
+		std::vector<T>().swap(v);
+	}
+}
+
+/// Адрес из списка ip:port.
+struct host_record
+{
+	Poco::Net::IPAddress ip;
+	uint16_t port_from;
+	uint16_t port_to;
+};
+
+}
+
+ListLoader::ListLoader(Poco::Logger &logger) :
+	_logger(logger)
+{
+}
+
+void ListLoader::parseDomains(const std::string &fn, entry_lists list, std::vector<list_entry> &entries, bool lower)
+{
+	_logger.debug("Loading domains from file %s",fn);
+	MappedFile file(fn);
+	std::vector<chunk> chunks = splitChunks(file);
+	std::vector<std::vector<list_entry>> parsed(chunks.size());
+	uint8_t exact_flag = (list == E_LIST_SSL) ? E_FLAG_SSL_EXACT : E_FLAG_DOMAIN_EXACT;
+	uint8_t wildcard_flag = (list == E_LIST_SSL) ? E_FLAG_SSL_WILDCARD : E_FLAG_DOMAIN_WILDCARD;
+	runChunks(chunks.size(), [&](size_t i)
+	{
+		forEachLine(chunks[i], [&](const char *line, size_t length, int lineno)
+		{
+			list_entry e;
+			memset(&e.data, 0, sizeof(e.data));
+			const char *star = (const char *) memmem(line, length, "*.", 2);
+			e.data.flags = exact_flag;
+			if(star)
+			{
+				e.data.flags = wildcard_flag;
+				e.pattern.assign(star + 2, line + length);
+			} else {
+				e.pattern.assign(line, length);
+			}
+			if(e.pattern.empty())
+			{
+				_logger.error("Failed to add empty domain from line %d from file %s",lineno,fn);
+				return;
+			}
+			if(lower)
+			{
+				for(auto &c : e.pattern)
+					c = tolower((unsigned char) c);
+			}
+			e.data.lineno = lineno;
+			e.id = 0;
+			e.profile = 0;
+			parsed[i].push_back(std::move(e));
+		});
+	});
+	appendChunks(parsed, entries);
+	_logger.debug("Finish loading domains");
+}
+
+void ListLoader::parseURLs(const std::string &fn, std::vector<list_entry> &entries)
+{
+	_logger.debug("Loading URLS from file %s",fn);
+	MappedFile file(fn);
+	std::vector<chunk> chunks = splitChunks(file);
+	std::vector<std::vector<list_entry>> parsed(chunks.size());
+	runChunks(chunks.size(), [&](size_t i)
+	{
+		forEachLine(chunks[i], [&](const char *line, size_t length, int lineno)
+		{
+			list_entry e;
+			memset(&e.data, 0, sizeof(e.data));
+			e.pattern.assign(line, length);
+			e.data.flags = E_FLAG_URL;
+			e.data.lineno = lineno;
+			e.id = 0;
+			e.profile = 0;
+			parsed[i].push_back(std::move(e));
+		});
+	});
+	appendChunks(parsed, entries);
+	_logger.debug("Finish loading URLS");
+}
+
+void ListLoader::loadSSLIP(const std::string &fn, IPPrefixList *list)
+{
+	_logger.debug("Loading SSL ips from file %s",fn);
+	MappedFile file(fn);
+	std::vector<chunk> chunks = splitChunks(file);
+	std::vector<IPPrefixList> parsed(chunks.size());
+	runChunks(chunks.size(), [&](size_t i)
+	{
+		forEachLine(chunks[i], [&](const char *line, size_t length, int lineno)
+		{
+			std::string str(line, length);
+			if(!parsed[i].add(str))
+			{
+				_logger.information("Unable to add IP address %s from line %d to the SSL IPs list", str, lineno);
+			}
+		});
+	});
+	for(auto &p : parsed)
+		list->append(p);
+	_logger.debug("Finish loading SSL ips");
+}
+
+void ListLoader::loadHosts(const std::string &fn, IPPortTable *table, IPPrefixList *nets)
+{
+	_logger.debug("Loading ip:port from file %s",fn);
+	MappedFile file(fn);
+	std::vector<chunk> chunks = splitChunks(file);
+	std::vector<std::vector<host_record>> parsed(chunks.size());
+	std::vector<IPPrefixList> parsed_nets(chunks.size());
+	runChunks(chunks.size(), [&](size_t i)
+	{
+		forEachLine(chunks[i], [&](const char *line, size_t length, int lineno)
+		{
+			// форматы: ip, ip:port, ip:port1-port2, [ipv6]:port, ipv6, сеть/маска
+			const char *end = line + length;
+			const char *ip_begin = line;
+			const char *ip_end = end;
+			const char *port = nullptr;
+			if(*line == '[')
+			{
+				const char *bracket = (const char *) memchr(line, ']', length);
+				if(bracket == nullptr)
+				{
+					_logger.information("Bad IPv6 address in line %d from file %s", lineno, fn);
+					return;
+				}
+				ip_begin = line + 1;
+				ip_end = bracket;
+				if(bracket + 1 < end && bracket[1] == ':')
+					port = bracket + 2;
+			} else {
+				const char *colon = (const char *) memchr(line, ':', length);
+				if(colon != nullptr && memchr(colon + 1, ':', end - colon - 1) == nullptr)
+				{
+					ip_end = colon;
+					port = colon + 1;
+				}
+			}
+			std::string ip(ip_begin, ip_end);
+			unsigned int port_from=0;
+			unsigned int port_to=0;
+			if(port && port < end)
+			{
+				const char *dash = (const char *) memchr(port, '-', end - port);
+				bool ok;
+				if(dash != nullptr)
+					ok=Poco::NumberParser::tryParseUnsigned(std::string(port, dash), port_from) && Poco::NumberParser::tryParseUnsigned(std::string(dash + 1, end), port_to) && port_to >= port_from;
+				else
+					ok=Poco::NumberParser::tryParseUnsigned(std::string(port, end), port_from);
+				if(!ok || port_from == 0 || port_from > 65535 || port_to > 65535)
+				{
+					_logger.information("Bad port '%s' in line %d from file %s", std::string(port, end), lineno, fn);
+					return;
+				}
+			}
+			if(ip.find('/') != std::string::npos)
+			{
+				// сеть блокируется целиком, порты для сетей не поддерживаются
+				if(port_from)
+				{
+					_logger.warning("Ports are not supported for networks, line %d ignored", lineno);
+				} else if(!parsed_nets[i].add(ip))
+				{
+					_logger.information("Unable to add network %s from line %d to the IP:port list", ip, lineno);
+				}
+				return;
+			}
+			host_record r;
+			if(!Poco::Net::IPAddress::tryParse(ip, r.ip))
+			{
+				_logger.information("Unable to add IP address %s from line %d to the IP:port list", ip, lineno);
+				return;
+			}
+			r.port_from = port_from;
+			r.port_to = port_to;
+			parsed[i].push_back(r);
+			_logger.debug("Inserted ip: %s port: '%s' from line %d", ip, port ? std::string(port, end) : std::string(), lineno);
+		});
+	});
+	// таблица заполняется одним потоком в порядке файла
+	for(size_t i = 0; i < chunks.size(); i++)
+	{
+		for(auto &r : parsed[i])
+			table->add(r.ip.addr(), r.ip.length(), r.port_from, r.port_to);
+		nets->append(parsed_nets[i]);
+	}
+	table->build();
+	_logger.debug("Finish ip:port");
+}
+
+uint64_t ListLoader::fileHash(const std::string &fn)
+{
+	MappedFile file(fn);
+	return snapshot_checksum(file.data(), file.size());
+}
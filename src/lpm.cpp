@@ -0,0 +1,98 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#include <atomic>
+#include <Poco/Exception.h>
+#include <rte_lcore.h>
+#include "lpm.h"
+
+// имена таблиц в DPDK должны быть уникальными, а при перезагрузке старая и новая таблицы существуют одновременно
+static std::atomic<unsigned int> lpm_counter(0);
+
+LpmTable::LpmTable(const std::string &name) :
+	_name(name),
+	_lpm4(nullptr),
+	_lpm6(nullptr),
+	_rules4(0),
+	_rules6(0)
+{
+}
+
+LpmTable::~LpmTable()
+{
+	if(_lpm4)
+		rte_lpm_free(_lpm4);
+	if(_lpm6)
+		rte_lpm6_free(_lpm6);
+}
+
+void LpmTable::build(const IPPrefixList &list)
+{
+	unsigned int id = lpm_counter++;
+	const std::vector<IPPrefixList::prefix4> &prefixes4 = list.prefixes4();
+	const std::vector<IPPrefixList::prefix6> &prefixes6 = list.prefixes6();
+	if(!prefixes4.empty())
+	{
+		// каждый префикс длиннее /24 может занять отдельную группу tbl8
+		uint32_t tbl8s = 1;
+		for(auto &p : prefixes4)
+		{
+			if(p.depth > 24)
+				tbl8s++;
+		}
+		struct rte_lpm_config config;
+		config.max_rules = prefixes4.size();
+		config.number_tbl8s = tbl8s;
+		config.flags = 0;
+		std::string name(_name + "4_" + std::to_string(id));
+		_lpm4 = rte_lpm_create(name.c_str(), rte_socket_id(), &config);
+		if(_lpm4 == nullptr)
+			throw Poco::Exception("Unable to create lpm table " + name);
+		for(auto &p : prefixes4)
+		{
+			if(rte_lpm_add(_lpm4, p.ip, p.depth, p.value) != 0)
+				throw Poco::Exception("Unable to add prefix to the lpm table " + name);
+		}
+		_rules4 = prefixes4.size();
+	}
+	if(!prefixes6.empty())
+	{
+		// первые 24 бита адресуются напрямую, далее по группе tbl8 на каждые 8 бит
+		uint32_t tbl8s = 1;
+		for(auto &p : prefixes6)
+		{
+			if(p.depth > 24)
+				tbl8s += (p.depth - 24 + 7) / 8;
+		}
+		struct rte_lpm6_config config;
+		config.max_rules = prefixes6.size();
+		config.number_tbl8s = tbl8s;
+		config.flags = 0;
+		std::string name(_name + "6_" + std::to_string(id));
+		_lpm6 = rte_lpm6_create(name.c_str(), rte_socket_id(), &config);
+		if(_lpm6 == nullptr)
+			throw Poco::Exception("Unable to create lpm6 table " + name);
+		for(auto &p : prefixes6)
+		{
+			if(rte_lpm6_add(_lpm6, (uint8_t *) p.ip, p.depth, p.value) != 0)
+				throw Poco::Exception("Unable to add prefix to the lpm6 table " + name);
+		}
+		_rules6 = prefixes6.size();
+	}
+}
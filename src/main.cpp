@@ -6,20 +6,39 @@
 #include <Poco/FileStream.h>
 #include <Poco/TaskManager.h>
 #include <Poco/StringTokenizer.h>
+#include <Poco/Timestamp.h>
+#include <Poco/Mutex.h>
 #include <rte_config.h>
 #include <rte_malloc.h>
 #include <rte_cycles.h>
+#include <rte_lcore.h>
 #include <rte_ethdev.h>
 
 #include <iostream>
 #include <vector>
 #include <sstream>
+#include <algorithm>
 #include <iomanip>
+#include <fstream>
+#include <thread>
+#include <functional>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/resource.h>
 #include "worker.h"
 #include "main.h"
 
-#include "AhoCorasickPlus.h"
-#include "patr.h"
+#include "flatac.h"
+#include "urlindex.h"
+#include "lpm.h"
+#include "ipporttable.h"
+#include "prefixlist.h"
+#include "listloader.h"
+#include "snapshot.h"
+#include "patterndb.h"
+#include "learnedtable.h"
+#include "injector.h"
 #include "qdpi.h"
 #include "sendertask.h"
 #include "statistictask.h"
@@ -60,9 +79,9 @@ uint8_t m_RSSKey[40] = {
 	0x6D, 0x5A, 0x6D, 0x5A, 0x6D, 0x5A, 0x6D, 0x5A
 };
 
-int extFilter::initPort(int port, struct rte_mempool *mbuf_pool, struct ether_addr *addr)
+int extFilter::initPort(int port, struct rte_mempool *mbuf_pool, struct ether_addr *addr, uint16_t txRings, bool *hw_cksum)
 {
-	const uint16_t rxRings = 1, txRings = 1;
+	const uint16_t rxRings = 1;
 	uint16_t q;
 	struct rte_eth_conf portConf;
 	memset(&portConf,0,sizeof(rte_eth_conf));
@@ -88,9 +107,18 @@ int extFilter::initPort(int port, struct rte_mempool *mbuf_pool, struct ether_ad
 			return retval;
 	}
 
+	// контрольные суммы ip и tcp считает карта, если умеет
+	struct rte_eth_dev_info dev_info;
+	rte_eth_dev_info_get(port, &dev_info);
+	struct rte_eth_txconf txconf = dev_info.default_txconf;
+	bool cksum = hw_cksum && (dev_info.tx_offload_capa & DEV_TX_OFFLOAD_IPV4_CKSUM) && (dev_info.tx_offload_capa & DEV_TX_OFFLOAD_TCP_CKSUM);
+	if(cksum)
+		txconf.txq_flags &= ~ETH_TXQ_FLAGS_NOOFFLOADS;
+	if(hw_cksum)
+		*hw_cksum = cksum;
 	for (q = 0; q < txRings; q++)
 	{
-		retval = rte_eth_tx_queue_setup(port, q, TX_RING_SIZE, rte_eth_dev_socket_id(port), NULL);
+		retval = rte_eth_tx_queue_setup(port, q, TX_RING_SIZE, rte_eth_dev_socket_id(port), cksum ? &txconf : NULL);
 		if (retval < 0)
 			return retval;
 	}
@@ -153,11 +181,48 @@ void extFilter::initialize(Application& self)
 	_flowhash_size_per_worker=rte_align32pow2(_flowhash_size/_num_of_workers);
 
 	_num_of_senders=config().getInt("num_of_senders", 1);
+	if(_num_of_senders < 1)
+		throw Poco::InvalidArgumentException("num_of_senders must be positive");
+	int sender_ring_size=config().getInt("sender_ring_size", SENDER_RING_SIZE);
+	if(sender_ring_size <= 0)
+		throw Poco::InvalidArgumentException("sender_ring_size must be positive");
+	_sender_ring_size=sender_ring_size;
+	_sender_lcores=config().getBool("sender_lcores", false);
+	_inject_dedup_window=config().getInt("inject_dedup_window", 1000);
+	_inject_rate=config().getInt("inject_rate", 0);
+	_inject_burst=config().getInt("inject_burst", 10);
+	if(_inject_dedup_window < 0 || _inject_rate < 0 || _inject_burst <= 0)
+		throw Poco::InvalidArgumentException("inject_dedup_window and inject_rate must not be negative, inject_burst must be positive");
+	_inject_port=config().getInt("inject_port", -1);
+	_bridge_port=config().getInt("bridge_port", -1);
+	int bridge_max_backlog=config().getInt("bridge_max_backlog", 8192);
+	if(bridge_max_backlog <= 0)
+		throw Poco::InvalidArgumentException("bridge_max_backlog must be positive");
+	_bridge_max_backlog=bridge_max_backlog;
+	_capture_path=config().getString("capture_path","");
+	int capture_file_size=config().getInt("capture_file_size", 100);
+	_capture_files=config().getInt("capture_files", 10);
+	int capture_rate=config().getInt("capture_rate", 1024);
+	int capture_ring_size=config().getInt("capture_ring_size", CAPTURE_RING_SIZE);
+	if(capture_file_size <= 0 || _capture_files < 0 || capture_rate <= 0 || capture_ring_size <= 0)
+		throw Poco::InvalidArgumentException("capture_file_size, capture_rate and capture_ring_size must be positive, capture_files must not be negative");
+	_capture_file_size=(uint64_t)capture_file_size * 1024 * 1024;
+	_capture_rate=(uint64_t)capture_rate * 1024;
+	_capture_ring_size=capture_ring_size;
+	_block_log_path=config().getString("block_log_path","");
+	int block_log_file_size=config().getInt("block_log_file_size", 100);
+	_block_log_files=config().getInt("block_log_files", 10);
+	int block_log_ring_size=config().getInt("block_log_ring_size", BLOCK_LOG_RING_SIZE);
+	if(block_log_file_size <= 0 || _block_log_files < 0 || block_log_ring_size <= 0)
+		throw Poco::InvalidArgumentException("block_log_file_size and block_log_ring_size must be positive, block_log_files must not be negative");
+	_block_log_file_size=(uint64_t)block_log_file_size * 1024 * 1024;
+	_block_log_ring_size=block_log_ring_size;
 	_lower_host=config().getBool("lower_host", false);
 	_match_url_exactly=config().getBool("match_url_exactly", false);
 	_block_undetected_ssl=config().getBool("block_undetected_ssl", false);
 	_http_redirect=config().getBool("http_redirect", true);
 	_url_normalization=config().getBool("url_normalization", true);
+	_fast_url_normalization=config().getBool("fast_url_normalization", false);
 	_remove_dot=config().getBool("remove_dot", true);
 	_statistic_interval=config().getInt("statistic_interval", 0);
 	_nbRxQueues = 1;
@@ -172,6 +237,18 @@ void extFilter::initialize(Application& self)
 	_sslIpsFile=config().getString("sslips","");
 	_sslFile=config().getString("ssllist","");
 	_hostsFile=config().getString("hostlist","");
+	_snapshotFile=config().getString("snapshot","");
+	_watch_lists=config().getBool("watch_lists", true);
+	_reload_debounce=config().getInt("reload_debounce", 2000);
+	for(int i=0; i < G_LIST_MAX; i++)
+	{
+		_listsHash[i]=0;
+		_listsLoaded[i]=false;
+	}
+	loadProfiles(config(), _profiles, &_profileMap);
+	for(size_t i=1; i < _profiles.size(); i++)
+		logger().information("Profile %s: domains %s, urls %s, ssl %s", _profiles[i].name, _profiles[i].domainsFile, _profiles[i].urlsFile, _profiles[i].sslFile);
+	_patternsBuilder.reset(new PatternDBBuilder(false, _match_url_exactly, _profiles.size()));
 	_statisticsFile=config().getString("statisticsfile","");
 
 	std::string http_code=config().getString("http_code","");
@@ -184,6 +261,9 @@ void extFilter::initialize(Application& self)
 	_sender_params.redirect_url=config().getString("redirect_url","");
 	_sender_params.send_rst_to_server=config().getBool("rst_to_server",false);
 	_sender_params.mtu=config().getInt("out_mtu",1500);
+	_sender_params.rst_burst=config().getInt("rst_burst",1);
+	if(_sender_params.rst_burst < 1 || _sender_params.rst_burst > RST_BURST_MAX)
+		throw Poco::InvalidArgumentException("rst_burst must be between 1 and " + std::to_string(RST_BURST_MAX));
 
 	std::string add_p_type=config().getString("url_additional_info","none");
 	std::transform(add_p_type.begin(), add_p_type.end(), add_p_type.begin(), ::tolower);
@@ -223,6 +303,9 @@ void extFilter::initialize(Application& self)
 
 	_protocolsFile=config().getString("protocols","");
 
+	if(_bridge_port >= 0 && (_dpdkPortVec.size() != 1 || _dpdkPortVec[0] == _bridge_port))
+		throw Poco::InvalidArgumentException("bridge_port requires exactly one other dpdk_port to pair with");
+
 	int coreMaskToUse=config().getInt("core_mask", 0);
 
 	// initialize DPDK
@@ -235,20 +318,29 @@ void extFilter::initialize(Application& self)
 	dpdkParamsStream << "--master-lcore ";
 	dpdkParamsStream << "0";
 
+	// виртуальные устройства (net_ring, net_pcap) для проверки без сетевых карт, через ';'
+	std::string dpdk_vdev=config().getString("dpdk_vdev","");
+	if(!dpdk_vdev.empty())
+	{
+		Poco::StringTokenizer vdevTokenizer(dpdk_vdev, ";", Poco::StringTokenizer::TOK_TRIM | Poco::StringTokenizer::TOK_IGNORE_EMPTY);
+		for(Poco::StringTokenizer::Iterator itr=vdevTokenizer.begin(); itr!=vdevTokenizer.end(); ++itr)
+			dpdkParamsStream << " --vdev " << *itr;
+	}
 
-	int initDpdkArgc=7;
-	std::string dpdkParamsArray[initDpdkArgc];
+	std::vector<std::string> dpdkParamsArray;
+	std::string dpdkParam;
+	while (dpdkParamsStream >> dpdkParam)
+		dpdkParamsArray.push_back(dpdkParam);
+	int initDpdkArgc=dpdkParamsArray.size();
 	char** initDpdkArgv = new char*[initDpdkArgc];
 	int i = 0;
-	while (dpdkParamsStream.good() && i < initDpdkArgc)
+	for (i = 0; i < initDpdkArgc; i++)
 	{
-		dpdkParamsStream >> dpdkParamsArray[i];
 		initDpdkArgv[i] = new char[dpdkParamsArray[i].size()+1];
 		strcpy(initDpdkArgv[i], dpdkParamsArray[i].c_str());
-		i++;
 	}
-
-	char* lastParam = initDpdkArgv[i-1];
+	// rte_eal_init переставляет аргументы, освобождаем по сохраненным указателям
+	std::vector<char*> dpdkArgs(initDpdkArgv, initDpdkArgv + initDpdkArgc);
 
 	for (i = 0; i < initDpdkArgc; i++)
 	{
@@ -262,17 +354,26 @@ void extFilter::initialize(Application& self)
 	if (ret < 0)
 		throw Poco::Exception("Can't initialize EAL - invalid EAL arguments");
 
-	for (i = 0; i < initDpdkArgc-1; i++)
+	for (auto arg : dpdkArgs)
 	{
-		delete [] initDpdkArgv[i];
+		delete [] arg;
 	}
-	delete [] lastParam;
 
 	delete [] initDpdkArgv;
 
 	// init value...
 	_tsc_hz = rte_get_tsc_hz();
 
+	if(config().getBool("learn_blocked", false))
+	{
+		int learn_size=config().getInt("learn_table_size", 65536);
+		int learn_ttl=config().getInt("learn_ttl", 600);
+		if(learn_size <= 0 || learn_ttl <= 0)
+			throw Poco::InvalidArgumentException("learn_table_size and learn_ttl must be positive");
+		_learned.reset(new LearnedTable(learn_size, (uint64_t)learn_ttl * _tsc_hz));
+		logger().information("Learning blocked ip:port destinations, table size %z, ttl %d s", _learned->size(), learn_ttl);
+	}
+
 }
 
 void extFilter::uninitialize()
@@ -415,6 +516,14 @@ int extFilter::main(const ArgVec& args)
 			return Poco::Util::Application::EXIT_CONFIG;
 		}
 
+		// отправители на ядрах dpdk нужны только без inject_port
+		int sender_lcores = (_sender_lcores && _inject_port < 0) ? std::min(_num_of_senders, _num_of_workers) : 0;
+		if(_num_of_readers + _num_of_workers + sender_lcores > nb_lcores-1)
+		{
+			logger().fatal("Number of cores (%d) is not enought for starting reader, worker and sender threads (%d). Check the configuration.", (int) nb_lcores, int (_num_of_readers + _num_of_workers + sender_lcores));
+			return Poco::Util::Application::EXIT_CONFIG;
+		}
+
 		bool isPoolSizePowerOfTwoMinusOne = !(_BufPoolSize == 0) && !((_BufPoolSize+1) & (_BufPoolSize));
 		if (!isPoolSizePowerOfTwoMinusOne)
 		{
@@ -442,21 +551,77 @@ int extFilter::main(const ArgVec& args)
 			return Poco::Util::Application::EXIT_CONFIG;
 		}
 
+		// в разрыве mbuf'ы еще и ждут отправки в очередях передачи обоих портов
+		int bridge_queues = (_bridge_port >= 0) ? _num_of_workers + 1 : 0;
+		if(_bridge_port >= nb_ports)
+		{
+			logger().fatal("Bridge port %d is not available", _bridge_port);
+			return Poco::Util::Application::EXIT_CONFIG;
+		}
 		struct rte_mempool *mbuf_pool = rte_pktmbuf_pool_create("MBUF_POOL",
-			_BufPoolSize*_dpdkPortVec.size(),
+			_BufPoolSize*(_dpdkPortVec.size() + (bridge_queues ? 1 : 0)) + bridge_queues * 2 * (TX_RING_SIZE + BRIDGE_BURST_SIZE),
 			MBUF_CACHE_SIZE, // cache size
 			0,
 			RTE_MBUF_DEFAULT_BUF_SIZE, rte_socket_id());
 
-		for (std::vector<int>::iterator iter = _dpdkPortVec.begin(); iter != _dpdkPortVec.end(); iter++)
+		// ответы могут уходить через очереди передачи порта захвата или отдельного порта, по очереди на worker
+		struct rte_mempool *inject_pool = nullptr;
+		bool inject_cksum = false;
+		if(_inject_port >= 0)
+		{
+			if(_inject_port >= nb_ports)
+			{
+				logger().fatal("Injection port %d is not available", _inject_port);
+				return Poco::Util::Application::EXIT_CONFIG;
+			}
+			inject_pool = rte_pktmbuf_pool_create("INJECT_POOL",
+				rte_align32pow2(_num_of_workers * (TX_RING_SIZE + INJECT_BURST_SIZE) + RX_RING_SIZE) - 1,
+				INJECT_MBUF_CACHE,
+				0,
+				RTE_MBUF_DEFAULT_BUF_SIZE, rte_socket_id());
+			if(inject_pool == nullptr)
+			{
+				logger().fatal("Unable to create mbuf pool for the injection");
+				return Poco::Util::Application::EXIT_CONFIG;
+			}
+		}
+
+		// порты пары в разрыве: очередь передачи на каждый worker и одна для reader'а
+		std::vector<int> ports(_dpdkPortVec);
+		if(_bridge_port >= 0)
+			ports.push_back(_bridge_port);
+		for (std::vector<int>::iterator iter = ports.begin(); iter != ports.end(); iter++)
 		{
 			struct ether_addr addr;
-			if(initPort(*iter, mbuf_pool, &addr) != 0)
+			bool inject = (*iter == _inject_port);
+			uint16_t txRings = bridge_queues ? bridge_queues : (inject ? _num_of_workers : 1);
+			if(initPort(*iter, mbuf_pool, &addr, txRings, inject ? &inject_cksum : nullptr) != 0)
 			{
 				logger().fatal("Cannot initialize port %d", *iter);
 				return Poco::Util::Application::EXIT_CONFIG;
 			}
 		}
+		if(_bridge_port >= 0)
+			logger().information("Inline mode: forwarding between dpdk ports %d and %d, bypassing analysis above %" PRIu64 " packets in the workers", _dpdkPortVec[0], _bridge_port, _bridge_max_backlog);
+		std::vector<std::unique_ptr<BridgeForwarder>> bridges;
+		if(_inject_port >= 0 && std::find(ports.begin(), ports.end(), _inject_port) == ports.end())
+		{
+			struct ether_addr addr;
+			if(initPort(_inject_port, inject_pool, &addr, _num_of_workers, &inject_cksum) != 0)
+			{
+				logger().fatal("Cannot initialize injection port %d", _inject_port);
+				return Poco::Util::Application::EXIT_CONFIG;
+			}
+		}
+		if(_inject_port >= 0)
+			logger().information("Sending redirects and resets through dpdk port %d, checksum offload %s", _inject_port, std::string(inject_cksum ? "enabled" : "disabled"));
+		std::vector<std::unique_ptr<PacketInjector>> injectors;
+		// кольцо запросов к SenderTask на каждый worker, если нет inject_port
+		std::vector<std::unique_ptr<SenderRing>> senderRings;
+		// кольцо пакетов для PcapWriter на каждый worker, если задан capture_path
+		std::vector<std::unique_ptr<CaptureRing>> captureRings;
+		// кольцо записей о блокировках для BlockLogWriter на каждый worker, если задан block_log_path
+		std::vector<std::unique_ptr<BlockEventRing>> blockLogRings;
 
 
 		WorkerConfig workerConfigArr[nb_lcores-1];
@@ -475,45 +640,83 @@ int extFilter::main(const ArgVec& args)
 			std::string workerName("ReaderThread " + std::to_string(i));
 			logger().debug("Preparing thread '%s'", workerName);
 			workerConfigArr[i].port = _dpdkPortVec[0];
+			if(_bridge_port >= 0)
+			{
+				bridges.emplace_back(new BridgeForwarder(_dpdkPortVec[0], _bridge_port, _num_of_workers));
+				workerConfigArr[i].bridge = bridges.back().get();
+				workerConfigArr[i].bridge_port = _bridge_port;
+				workerConfigArr[i].bridge_max_backlog = _bridge_max_backlog;
+			}
 			ReaderThread* newWorker = new ReaderThread(workerName, workerConfigArr[i], distributor);
 			workerThreadVec.push_back(newWorker);
 		}
+		ListsGeneration gen;
+		buildGeneration(openSnapshot().get(), gen);
+		if(!gen.errors.empty())
+			throw Poco::Exception("Unable to load lists: " + gen.errors[0]);
+		// поколение только читается, поэтому таблицы ip общие для всех worker'ов
+		LpmTable *sslIPs=gen.sslIPs;
+		IPPortTable *ipPortTable=gen.ipPortTable;
+		LpmTable *ipPortNets=gen.ipPortNets;
+		gen.sslIPs=nullptr;
+		gen.ipPortTable=nullptr;
+		gen.ipPortNets=nullptr;
+		std::unique_ptr<PatternDB> patternsDB(gen.patternsDB);
+		gen.patternsDB=nullptr;
 		int num_of_workers=_num_of_workers;
 		int worker_id=0;
 		while(num_of_workers)
 		{
-			if(!_domainsFile.empty() && !_urlsFile.empty())
+			// поколение только читается, worker'ы получают копии с общими частями
+			if(patternsDB)
+				workerConfigArr[i].patternsDB = new PatternDB(*patternsDB);
+			if(_profiles.size() > 1)
+				workerConfigArr[i].profiles = &_profileMap;
+			if(sslIPs)
 			{
-				workerConfigArr[i].atm = new AhoCorasickPlus();
-				workerConfigArr[i].entriesData = new EntriesData();
-				loadDomainsURLs(_domainsFile, _urlsFile, workerConfigArr[i].atm, workerConfigArr[i].entriesData);
-				workerConfigArr[i].atm->finalize();
+				workerConfigArr[i].block_undetected_ssl = true;
+				workerConfigArr[i].sslIPs = sslIPs;
 			}
-			if(!_sslIpsFile.empty() && _block_undetected_ssl)
+			if(ipPortTable)
 			{
-				workerConfigArr[i].block_undetected_ssl = true;
-				workerConfigArr[i].sslIPs = new Patricia();
-				loadSSLIP(_sslIpsFile, workerConfigArr[i].sslIPs);
+				workerConfigArr[i].ipPortTable = ipPortTable;
+				workerConfigArr[i].ipPortNets = ipPortNets;
 			}
-			if(!_sslFile.empty())
+			if(!_capture_path.empty())
 			{
-				workerConfigArr[i].atmSSLDomains = new AhoCorasickPlus();
-				workerConfigArr[i].SSLdomainsMatchType = new DomainsMatchType;
-				loadDomains(_sslFile, workerConfigArr[i].atmSSLDomains, workerConfigArr[i].SSLdomainsMatchType);
-				workerConfigArr[i].atmSSLDomains->finalize();
+				captureRings.emplace_back(new CaptureRing(_capture_ring_size));
+				workerConfigArr[i].captureRing = captureRings.back().get();
+				// общий лимит делится между worker'ами, чтобы им не нужен был общий счетчик
+				workerConfigArr[i].capture_rate = _capture_rate / _num_of_workers;
 			}
-			if(!_hostsFile.empty())
+			if(!_block_log_path.empty())
 			{
-				workerConfigArr[i].ipportMap = new IPPortMap;
-				workerConfigArr[i].ipPortMap = new Patricia();
-				loadHosts(_hostsFile, workerConfigArr[i].ipportMap, workerConfigArr[i].ipPortMap);
+				blockLogRings.emplace_back(new BlockEventRing(_block_log_ring_size));
+				workerConfigArr[i].blockLog = blockLogRings.back().get();
 			}
-//			workerConfigArr[i].PathToWritePackets = "thread"+std::to_string(i)+".pcap";
 			workerConfigArr[i].match_url_exactly = _match_url_exactly;
 			workerConfigArr[i].lower_host = _lower_host;
 			workerConfigArr[i].http_redirect = _http_redirect;
 			workerConfigArr[i].url_normalization = _url_normalization;
+			workerConfigArr[i].fast_url_normalization = _fast_url_normalization;
 			workerConfigArr[i].remove_dot = _remove_dot;
+			workerConfigArr[i].learned = _learned.get();
+			if(_bridge_port >= 0)
+			{
+				bridges.emplace_back(new BridgeForwarder(_dpdkPortVec[0], _bridge_port, worker_id));
+				workerConfigArr[i].bridge = bridges.back().get();
+			}
+			workerConfigArr[i].inject_dedup_cycles = (uint64_t)_inject_dedup_window * _tsc_hz / 1000;
+			workerConfigArr[i].inject_rate = _inject_rate;
+			workerConfigArr[i].inject_burst = _inject_burst;
+			if(inject_pool)
+			{
+				injectors.emplace_back(new PacketInjector(_inject_port, worker_id, inject_pool, _sender_params, inject_cksum));
+				workerConfigArr[i].injector = injectors.back().get();
+			} else {
+				senderRings.emplace_back(new SenderRing(_sender_ring_size));
+				workerConfigArr[i].senderRing = senderRings.back().get();
+			}
 			workerConfigArr[i].add_p_type = _add_p_type;
 			workerConfigArr[i].ndpi_struct = init_ndpi();
 			if (!workerConfigArr[i].ndpi_struct)
@@ -538,9 +741,50 @@ int extFilter::main(const ArgVec& args)
 			worker_id++;
 		}
 
+		// каждое кольцо читает ровно один отправитель
+		std::vector<std::unique_ptr<RingSender>> ringSenders;
+		std::vector<RingSender*> senders;
+		for(int i=0; i < _num_of_senders && i < (int)senderRings.size(); i++)
+		{
+			std::vector<SenderRing*> rings;
+			for(size_t r=i; r < senderRings.size(); r += _num_of_senders)
+				rings.push_back(senderRings[r].get());
+			ringSenders.emplace_back(new RingSender(_sender_params, i+1, rings));
+			senders.push_back(ringSenders.back().get());
+			// кольца создавались по одному на worker, по порядку, worker'ы еще не запущены
+			if(!sender_lcores)
+			{
+				for(size_t r=i; r < senderRings.size(); r += _num_of_senders)
+					workerConfigArr[_num_of_readers + r].senderWakeup = ringSenders.back()->wakeup();
+			}
+		}
+
 		Poco::TaskManager tm;
-		for(int i=1; i <= _num_of_senders; i++)
-			tm.start(new SenderTask(_sender_params,i));
+		for(auto sender : senders)
+		{
+			if(sender_lcores)
+				workerThreadVec.push_back(new SenderThread(sender));
+			else
+				tm.start(new SenderTask(sender));
+		}
+		if(sender_lcores)
+			logger().information("Starting %z sender threads on dedicated cores", senders.size());
+		if(!captureRings.empty())
+		{
+			std::vector<CaptureRing*> rings;
+			for(auto &ring : captureRings)
+				rings.push_back(ring.get());
+			tm.start(new PcapWriter(rings, _capture_path, _capture_file_size, _capture_files));
+			logger().information("Capturing blocked packets to %s-*.pcap, limit %" PRIu64 " bytes per second", _capture_path, _capture_rate);
+		}
+		if(!blockLogRings.empty())
+		{
+			std::vector<BlockEventRing*> rings;
+			for(auto &ring : blockLogRings)
+				rings.push_back(ring.get());
+			tm.start(new BlockLogWriter(rings, _block_log_path, _block_log_file_size, _block_log_files));
+			logger().information("Writing block events to %s-*.blk", _block_log_path);
+		}
 
 		logger().debug("Starting worker threads...");
 
@@ -573,7 +817,7 @@ int extFilter::main(const ArgVec& args)
 			}
 		}
 
-		tm.start(new StatisticTask(_statistic_interval, workerThreadVec, _statisticsFile));
+		tm.start(new StatisticTask(_statistic_interval, workerThreadVec, senders, _statisticsFile));
 		tm.start(new ReloadTask(this, workerThreadVec));
 		waitForTerminationRequest();
 
@@ -586,7 +830,6 @@ int extFilter::main(const ArgVec& args)
 //		pcpp::DpdkDeviceList::getInstance().stopDpdkWorkerThreads();
 
 		tm.cancelAll();
-		SenderTask::queue.wakeUpAll();
 		tm.joinAll();
 		// stop worker threads
 
@@ -600,292 +843,289 @@ int extFilter::main(const ArgVec& args)
 	return Poco::Util::Application::EXIT_OK;
 }
 
-void extFilter::loadDomainsURLs(std::string &domains, std::string &urls, AhoCorasickPlus *dm_atm, EntriesData *ed)
+std::shared_ptr<Snapshot> extFilter::openSnapshot()
+{
+	if(_snapshotFile.empty())
+		return std::shared_ptr<Snapshot>();
+	Poco::Timestamp start;
+	std::shared_ptr<Snapshot> snapshot=Snapshot::open(_snapshotFile);
+	logger().information("Mapped snapshot %s (%z bytes) in %d ms", _snapshotFile, snapshot->size(), (int)(start.elapsed() / 1000));
+	if(_match_url_exactly)
+		logger().information("URL index is not stored in the snapshot, exact urls are matched by the automaton");
+	return snapshot;
+}
+
+PatternDB *extFilter::createPatterns(Snapshot *snapshot)
 {
-	logger().debug("Loading domains from file %s",domains);
-	Poco::FileInputStream df(domains);
-	int entry_id=0;
-	if(df.good())
+	if(snapshot)
 	{
-		int lineno=0;
-		while(!df.eof())
-		{
-			lineno++;
-			std::string str;
-			getline(df,str);
-			if(!str.empty())
-			{
-				if(str[0] == '#' || str[0] == ';')
-					continue;
-				AhoCorasickPlus::EnumReturnStatus status;
-				AhoCorasickPlus::PatternId patId = entry_id;
-				std::size_t pos = str.find("*.");
-				bool exact_match=true;
-				std::string insert=str;
-				if(pos != std::string::npos)
-				{
-					exact_match=false;
-					insert=str.substr(pos+2,str.length()-2);
-				}
-				status = dm_atm->addPattern(insert, patId);
-				if (status != AhoCorasickPlus::RETURNSTATUS_SUCCESS)
-				{
-					if(status == AhoCorasickPlus::RETURNSTATUS_DUPLICATE_PATTERN)
-					{
-						logger().warning("Pattern '%s' already present in the database from file %s",insert,domains);
-						continue;
-					} else {
-						logger().error("Failed to add '%s' from line %d from file %s",insert,lineno,domains);
-					}
-				} else {
-					entry_data e;
-					e.type = E_TYPE_DOMAIN;
-					e.match_exactly = exact_match;
-					e.lineno = lineno;
-					std::pair<EntriesData::Iterator,bool> res=ed->insert(EntriesData::ValueType(entry_id,e));
-					if(!res.second)
-					{
-						logger().fatal("Logic error: found duplicate in the EntriesData. Domain '%s' line %d from file '%s'", str, lineno, domains);
-						throw Poco::Exception("Logic error: found duplicate in the EntriesData.");
-					}
-				}
-			}
-			entry_id++;
-		}
-	} else
-		throw Poco::OpenFileException(domains);
-	df.close();
-	logger().debug("Finish loading domains");
-	logger().debug("Loading URLS from file %s",urls);
-	Poco::FileInputStream uf(urls);
-	if(uf.good())
-	{
-		int lineno=0;
-		while(!uf.eof())
+		if(!snapshot->has(S_SECTION_PATTERNS))
+			return nullptr;
+		std::unique_ptr<PatternDB> db(new PatternDB());
+		db->base.reset(snapshot->automaton(S_SECTION_PATTERNS));
+		db->entries.reset(snapshot->entries(S_SECTION_PATTERNS_ENTRIES));
+		if(db->entries->profiles() != _profiles.size())
+			throw Poco::DataFormatException("Snapshot is compiled for " + std::to_string(db->entries->profiles()) + " profiles, configured " + std::to_string(_profiles.size()));
+		return db.release();
+	}
+	bool configured=false;
+	for(auto &p : _profiles)
+		configured |= !p.empty();
+	if(!configured)
+		return nullptr;
+	Poco::Timestamp start;
+	ListLoader loader(logger());
+	std::vector<list_entry> entries;
+	// порядок важен: у шаблона из нескольких списков сохраняется строка первого вхождения
+	for(size_t i=0; i < _profiles.size(); i++)
+	{
+		const list_profile &p=_profiles[i];
+		size_t first=entries.size();
+		if(!p.domainsFile.empty() && !p.urlsFile.empty())
 		{
-			lineno++;
-			std::string str;
-			getline(uf,str);
-			if(!str.empty())
-			{
-				if(str[0] == '#' || str[0] == ';')
-					continue;
-				AhoCorasickPlus::EnumReturnStatus status;
-				AhoCorasickPlus::PatternId patId = entry_id;
-/*				std::string url = str;
-				std::size_t http_pos = url.find("http://");
-				if(http_pos == std::string::npos || http_pos > 0)
-				{
-					url.insert(0,"http://");
-				}*/
-				status = dm_atm->addPattern(str, patId);
-				if (status != AhoCorasickPlus::RETURNSTATUS_SUCCESS)
-				{
-					if(status == AhoCorasickPlus::RETURNSTATUS_DUPLICATE_PATTERN)
-					{
-						logger().warning("Pattern '%s' already present in the URL database from file %s",str,urls);
-						continue;
-					} else {
-						logger().error("Failed to add '%s' from line %d from file %s",str,lineno,urls);
-					}
-				} else {
-					entry_data e;
-					e.type = E_TYPE_URL;
-					e.match_exactly = false;
-					e.lineno = lineno;
-					std::pair<EntriesData::Iterator,bool> res=ed->insert(EntriesData::ValueType(entry_id,e));
-					if(!res.second)
-					{
-						logger().fatal("Logic error: found duplicate in the EntriesData. URL '%s' line %d from file '%s'", str, lineno, urls);
-						throw Poco::Exception("Logic error: found duplicate in the EntriesData.");
-					}
-				}
-			}
-			entry_id++;
+			loader.parseDomains(p.domainsFile, E_LIST_DOMAINS, entries);
+			loader.parseURLs(p.urlsFile, entries);
 		}
-	} else
-		throw Poco::OpenFileException(urls);
-	uf.close();
-	logger().debug("Finish loading URLS");
+		if(!p.sslFile.empty())
+			loader.parseDomains(p.sslFile, E_LIST_SSL, entries, _lower_host);
+		for(size_t k=first; k < entries.size(); k++)
+			entries[k].profile=i;
+	}
+	PatternDB *db=_patternsBuilder->update(entries, logger());
+	const PatternDBBuilder::stats &st=_patternsBuilder->lastStats();
+	logger().information("Compiled %z domains, urls and ssl domains of %z profiles from %z lines (%s build, added %z, removed %z, overlay %z) in %d ms", st.patterns, _profiles.size(), entries.size(), std::string(st.full ? "full" : "delta"), st.added, st.removed, st.overlay, (int)(start.elapsed() / 1000));
+	if(db->urlIndex)
+		logger().information("Loaded %z exact urls for %z hosts into the url index", db->urlIndex->size(), db->urlIndex->hostsCount());
+	return db;
 }
 
-void extFilter::loadURLs(std::string &fn, AhoCorasickPlus *dm_atm)
+LpmTable *extFilter::createSSLIPs(Snapshot *snapshot)
 {
-	logger().debug("Loading URLS from file %s",fn);
-	Poco::FileInputStream uf(fn);
-	if(uf.good())
+	if(!_block_undetected_ssl)
+		return nullptr;
+	IPPrefixList list;
+	if(snapshot)
+	{
+		if(!snapshot->has(S_SECTION_SSL_IPS))
+			return nullptr;
+		snapshot->prefixes(S_SECTION_SSL_IPS, list);
+	} else {
+		if(_sslIpsFile.empty())
+			return nullptr;
+		ListLoader loader(logger());
+		loader.loadSSLIP(_sslIpsFile, &list);
+	}
+	LpmTable *lpm=new LpmTable("sslips");
+	try
+	{
+		lpm->build(list);
+	} catch (Poco::Exception &)
 	{
-		int lineno=1;
-		while(!uf.eof())
+		delete lpm;
+		throw;
+	}
+	logger().information("Loaded %z IPv4 and %z IPv6 prefixes into the SSL IPs table", lpm->size4(), lpm->size6());
+	return lpm;
+}
+
+bool extFilter::createHosts(Snapshot *snapshot, IPPortTable *&table, LpmTable *&nets)
+{
+	table=nullptr;
+	nets=nullptr;
+	IPPrefixList list;
+	if(snapshot)
+	{
+		if(!snapshot->has(S_SECTION_HOSTS))
+			return false;
+		snapshot->prefixes(S_SECTION_HOSTS_NETS, list);
+		table=snapshot->ipPortTable(S_SECTION_HOSTS);
+	} else {
+		if(_hostsFile.empty())
+			return false;
+		table=new IPPortTable();
+		try
 		{
-			std::string str;
-			getline(uf,str);
-			if(!str.empty())
-			{
-				if(str[0] == '#' || str[0] == ';')
-					continue;
-				AhoCorasickPlus::EnumReturnStatus status;
-				AhoCorasickPlus::PatternId patId = lineno;
-				std::string url = str;
-				std::size_t http_pos = url.find("http://");
-				if(http_pos == std::string::npos || http_pos > 0)
-				{
-					url.insert(0,"http://");
-				}
-				status = dm_atm->addPattern(url, patId);
-				if (status!=AhoCorasickPlus::RETURNSTATUS_SUCCESS)
-				{
-					if(status == AhoCorasickPlus::RETURNSTATUS_DUPLICATE_PATTERN)
-					{
-						logger().warning("Pattern '%s' already present in the URL database from file %s",str,fn);
-					} else {
-						logger().error("Failed to add '%s' from line %d from file %s",str,lineno,fn);
-					}
-				}
-			}
-			lineno++;
+			ListLoader loader(logger());
+			loader.loadHosts(_hostsFile, table, &list);
+		} catch (Poco::Exception &)
+		{
+			delete table;
+			table=nullptr;
+			throw;
 		}
-	} else
-		throw Poco::OpenFileException(fn);
-	uf.close();
-	logger().debug("Finish loading URLS");
+	}
+	nets=new LpmTable("hosts");
+	try
+	{
+		nets->build(list);
+	} catch (Poco::Exception &)
+	{
+		delete table;
+		delete nets;
+		table=nullptr;
+		nets=nullptr;
+		throw;
+	}
+	logger().information("Loaded %z ip:port entries with %z port ranges and %z networks into the IP:port list", table->size(), table->bitmaps(), nets->size4() + nets->size6());
+	return true;
+}
+
+ListsGeneration::ListsGeneration() :
+	patternsDB(nullptr),
+	sslIPs(nullptr),
+	ipPortTable(nullptr),
+	ipPortNets(nullptr)
+{
 }
 
-void extFilter::loadDomains(std::string &fn, AhoCorasickPlus *dm_atm,DomainsMatchType *dm_map)
+ListsGeneration::~ListsGeneration()
 {
-	logger().debug("Loading domains from file %s",fn);
-	Poco::FileInputStream df(fn);
-	if(df.good())
+	delete patternsDB;
+	delete sslIPs;
+	delete ipPortTable;
+	delete ipPortNets;
+}
+
+/// Ядра, не занятые lcore'ами DPDK. Поток, запустивший rte_eal_init, привязан к master lcore,
+/// и созданные им потоки наследуют эту привязку, поэтому для параллельной сборки ее нужно расширить.
+/// Считается, что номер lcore совпадает с номером ядра (маска -c).
+static void spareCores(cpu_set_t &set)
+{
+	CPU_ZERO(&set);
+	unsigned int master = rte_get_master_lcore();
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	for(long cpu = 0; cpu < cpus && cpu < CPU_SETSIZE; cpu++)
+	{
+		if(cpu < RTE_MAX_LCORE && cpu != master && rte_lcore_is_enabled(cpu))
+			continue;
+		CPU_SET(cpu, &set);
+	}
+	if(CPU_COUNT(&set) == 0)
+		CPU_SET(master, &set);
+}
+
+uint64_t extFilter::listHash(Snapshot *snapshot, int list)
+{
+	// хэш источника списка: секций snapshot или текстовых файлов
+	auto hash = [snapshot](uint32_t section)
 	{
-		int lineno=1;
-		while(!df.eof())
+		return snapshot->sectionChecksum(section);
+	};
+	auto file = [](const std::string &fn)
+	{
+		return fn.empty() ? (uint64_t) 0 : ListLoader::fileHash(fn);
+	};
+	switch(list)
+	{
+		case G_LIST_PATTERNS:
 		{
-			std::string str;
-			getline(df,str);
-			if(!str.empty())
+			if(snapshot)
+				return hash(S_SECTION_PATTERNS) * 0x9E3779B97F4A7C15ULL + hash(S_SECTION_PATTERNS_ENTRIES);
+			uint64_t h=0;
+			for(auto &p : _profiles)
 			{
-				if(str[0] == '#' || str[0] == ';')
-					continue;
-				AhoCorasickPlus::EnumReturnStatus status;
-				AhoCorasickPlus::PatternId patId = lineno;
-				std::size_t pos = str.find("*.");
-				bool exact_match=true;
-				std::string insert=str;
-				if(pos != std::string::npos)
-				{
-					exact_match=false;
-					insert=str.substr(pos+2,str.length()-2);
-				}
-				status = dm_atm->addPattern(insert, patId);
-				if (status!=AhoCorasickPlus::RETURNSTATUS_SUCCESS)
-				{
-					if(status == AhoCorasickPlus::RETURNSTATUS_DUPLICATE_PATTERN)
-					{
-						logger().warning("Pattern '%s' already present in the database from file %s",insert,fn);
-					} else {
-						logger().error("Failed to add '%s' from line %d from file %s",insert,lineno,fn);
-					}
-				} else {
-					std::pair<DomainsMatchType::Iterator,bool> res=dm_map->insert(DomainsMatchType::ValueType(lineno,exact_match));
-					if(res.second)
-					{
-//						logger().debug("Inserted domain: '%s' from line %d from file %s",str,lineno,fn);
-					} else {
-						logger().debug("Updated domain: '%s' from line %d from file %s",str,lineno,fn);
-					}
-				}
+				if(!p.domainsFile.empty() && !p.urlsFile.empty())
+					h=(h * 0x9E3779B97F4A7C15ULL + file(p.domainsFile)) * 0x9E3779B97F4A7C15ULL + file(p.urlsFile);
+				h=h * 0x9E3779B97F4A7C15ULL + file(p.sslFile);
 			}
-			lineno++;
+			return h;
 		}
-	} else
-		throw Poco::OpenFileException(fn);
-	df.close();
-	logger().debug("Finish loading domains");
+		case G_LIST_SSL_IPS:
+			if(!_block_undetected_ssl)
+				return 0;
+			if(snapshot)
+				return hash(S_SECTION_SSL_IPS);
+			return file(_sslIpsFile);
+		case G_LIST_HOSTS:
+			if(snapshot)
+				return hash(S_SECTION_HOSTS) * 0x9E3779B97F4A7C15ULL + hash(S_SECTION_HOSTS_NETS);
+			return file(_hostsFile);
+	}
+	return 0;
 }
 
-void extFilter::loadSSLIP(const std::string &fn, Patricia *patricia)
+std::vector<std::string> extFilter::getListFiles()
 {
-	logger().debug("Loading SSL ips from file %s",fn);
-	Poco::FileInputStream hf(fn);
-	if(hf.good())
+	std::vector<std::string> files;
+	if(!_snapshotFile.empty())
+	{
+		files.push_back(_snapshotFile);
+		return files;
+	}
+	for(auto &p : _profiles)
 	{
-		int lineno=1;
-		while(!hf.eof())
+		if(!p.domainsFile.empty() && !p.urlsFile.empty())
 		{
-			std::string str;
-			getline(hf,str);
-			if(!str.empty())
-			{
-				if(str[0] == '#' || str[0] == ';')
-					continue;
-				if(!patricia->make_and_lookup(str))
-				{
-					logger().information("Unable to add IP address %s from line %d to the SSL IPs list", str, lineno);
-				}
-			}
-			lineno++;
+			files.push_back(p.domainsFile);
+			files.push_back(p.urlsFile);
 		}
-	} else
-		throw Poco::OpenFileException(fn);
-	hf.close();
-	logger().debug("Finish loading SSL ips");
+		if(!p.sslFile.empty())
+			files.push_back(p.sslFile);
+	}
+	if(_block_undetected_ssl && !_sslIpsFile.empty())
+		files.push_back(_sslIpsFile);
+	if(!_hostsFile.empty())
+		files.push_back(_hostsFile);
+	return files;
 }
 
-void extFilter::loadHosts(std::string &fn, IPPortMap *ippm, Patricia *patricia)
+void extFilter::buildGeneration(Snapshot *snapshot, ListsGeneration &gen, bool changed_only)
 {
-	logger().debug("Loading ip:port from file %s",fn);
-	Poco::FileInputStream hf(fn);
-	if(hf.good())
+	Poco::Timestamp start;
+	cpu_set_t cores;
+	spareCores(cores);
+	Poco::FastMutex errors_lock;
+	std::vector<std::thread> threads;
+	// списки независимы друг от друга, у каждого свой PatternDBBuilder, поэтому строятся одновременно
+	auto run = [&](int list, const std::string &name, std::function<void()> build)
 	{
-		int lineno=1;
-		while(!hf.eof())
+		threads.emplace_back([this, snapshot, changed_only, &gen, &errors_lock, &cores, list, name, build]()
 		{
-			std::string str;
-			getline(hf,str);
-			if(!str.empty())
+			// привязка до начала работы: ListLoader берет число потоков разбора из маски этого потока,
+			// и его потоки наследуют ее
+			pthread_setaffinity_np(pthread_self(), sizeof(cores), &cores);
+			std::string error;
+			try
 			{
-				if(str[0] == '#' || str[0] == ';')
-					continue;
-				std::size_t found=str.find(":");
-				std::string ip=str.substr(0, found);
-				std::string port;
-				unsigned short porti=0;
-				if(found != std::string::npos)
+				uint64_t hash = listHash(snapshot, list);
+				if(changed_only && _listsLoaded[list] && _listsHash[list] == hash)
 				{
-					port=str.substr(found+1,str.length());
-					logger().debug("IP is %s port %s",ip,port);
-					porti=atoi(port.c_str());
-				} else {
-					logger().debug("IP %s without port", ip);
+					logger().information("List of %s is not changed", name);
+					return;
 				}
-				Poco::Net::IPAddress ip_addr(ip);
-				IPPortMap::iterator it=ippm->find(ip_addr);
-				if(it == ippm->end())
-				{
-					std::set<unsigned short> ports;
-					if(porti)
-					{
-						logger().debug("Adding port %s to ip %s", port, ip);
-						ports.insert(porti);
-					}
-					ippm->insert(std::make_pair(ip_addr,ports));
-					logger().debug("Inserted ip: %s from line %d", ip, lineno);
-					if(!patricia->make_and_lookup(ip))
-					{
-						logger().information("Unable to add IP address %s from line %d to the IP:port list", ip, lineno);
-					}
-				} else {
-					logger().debug("Adding port %s from line %d to ip %s", port,lineno,ip);
-					it->second.insert(porti);
-				}
-				
+				build();
+				_listsHash[list] = hash;
+				_listsLoaded[list] = true;
+			} catch (Poco::Exception &excep)
+			{
+				error = excep.displayText();
+			} catch (std::exception &excep)
+			{
+				error = excep.what();
 			}
-			lineno++;
-		}
-	} else
-		throw Poco::OpenFileException(fn);
-	hf.close();
-	logger().debug("Finish ip:port");
+			if(!error.empty())
+			{
+				Poco::FastMutex::ScopedLock lock(errors_lock);
+				gen.errors.push_back(name + ": " + error);
+			}
+		});
+	};
+	run(G_LIST_PATTERNS, "domains, urls and ssl domains", [this, snapshot, &gen]() { gen.patternsDB = createPatterns(snapshot); });
+	run(G_LIST_SSL_IPS, "ssl ips", [this, snapshot, &gen]() { gen.sslIPs = createSSLIPs(snapshot); });
+	run(G_LIST_HOSTS, "hosts", [this, snapshot, &gen]() { createHosts(snapshot, gen.ipPortTable, gen.ipPortNets); });
+	for(auto &t : threads)
+		t.join();
+	for(auto &e : gen.errors)
+		logger().error("Unable to load %s", e);
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	size_t rss = 0;
+	std::ifstream statm("/proc/self/statm");
+	size_t vsize;
+	if(statm >> vsize >> rss)
+		rss = rss * sysconf(_SC_PAGESIZE) / (1024 * 1024);
+	logger().information("Built lists generation in %d ms on %d cores, RSS %z MB, peak RSS %z MB", (int)(start.elapsed() / 1000), CPU_COUNT(&cores), rss, (size_t)(usage.ru_maxrss / 1024));
 }
 
 POCO_SERVER_MAIN(extFilter)
@@ -0,0 +1,294 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#include <algorithm>
+#include "patterndb.h"
+#include "flatac.h"
+#include "urlindex.h"
+
+PatternDBBuilder::PatternDBBuilder(bool fold_case, bool url_index, unsigned profiles) :
+	_fold_case(fold_case),
+	_url_index(url_index),
+	_profiles(profiles ? profiles : 1),
+	_next_id(0),
+	_base_size(0),
+	_removed(0)
+{
+	memset(&_stats, 0, sizeof(_stats));
+}
+
+PatternDBBuilder::~PatternDBBuilder()
+{
+}
+
+void PatternDBBuilder::reset()
+{
+	_ids.clear();
+	_base.reset();
+	_overlay_patterns.clear();
+	_next_id = 0;
+	_base_size = 0;
+	_removed = 0;
+}
+
+std::vector<PatternDBBuilder::pattern> PatternDBBuilder::merge(std::vector<list_entry> &entries, std::vector<uint8_t> &profile_flags, Poco::Logger &logger)
+{
+	std::vector<pattern> patterns;
+	// шаблоны сравниваются по тексту: совпадение хэша разных шаблонов не должно их объединять
+	std::unordered_map<std::string, uint32_t> index;
+	index.reserve(entries.size());
+	patterns.reserve(entries.size());
+	profile_flags.clear();
+	for(auto &e : entries)
+	{
+		unsigned profile = (e.profile < _profiles) ? e.profile : 0;
+		auto r = index.emplace(e.pattern, patterns.size());
+		if(r.second)
+		{
+			pattern p;
+			p.entry = &e;
+			p.data = e.data;
+			p.id = FLATAC_NONE;
+			patterns.push_back(p);
+			if(_profiles > 1)
+			{
+				profile_flags.resize(patterns.size() * _profiles, 0);
+				profile_flags[r.first->second * _profiles + profile] = e.data.flags;
+			}
+		} else {
+			pattern &p = patterns[r.first->second];
+			uint8_t &flags = (_profiles > 1) ? profile_flags[r.first->second * _profiles + profile] : p.data.flags;
+			if(flags & e.data.flags)
+				logger.warning("Pattern '%s' from line %u already present in the list", e.pattern, e.data.lineno);
+			flags |= e.data.flags;
+			p.data.flags |= e.data.flags;
+		}
+		// до назначения id хранит номер уникального шаблона
+		e.id = r.first->second;
+	}
+	return patterns;
+}
+
+void PatternDBBuilder::assignIds(std::vector<list_entry> &entries, const std::vector<pattern> &patterns)
+{
+	for(auto &e : entries)
+		e.id = patterns[e.id].id;
+}
+
+std::string PatternDBBuilder::key(const pattern &p) const
+{
+	// номер строки и списки в ключ не входят: перемещение шаблона в файле или появление его
+	// в другом списке меняет только флаги, автомат остается прежним. Входит то, лежит ли шаблон в автомате.
+	std::string k;
+	k.reserve(p.entry->pattern.length() + 1);
+	k.push_back(inAutomaton(p.data) ? 'A' : 'U');
+	k.append(p.entry->pattern);
+	return k;
+}
+
+std::shared_ptr<EntriesData> PatternDBBuilder::newEntries() const
+{
+	std::shared_ptr<EntriesData> ed = std::make_shared<EntriesData>();
+	ed->setProfiles(_profiles);
+	return ed;
+}
+
+void PatternDBBuilder::insertEntry(EntriesData &ed, uint32_t id, const pattern &p, const std::vector<pattern> &patterns, const std::vector<uint8_t> &profile_flags) const
+{
+	ed.insert(id, p.data);
+	if(_profiles > 1)
+		ed.setProfileFlags(id, &profile_flags[(&p - patterns.data()) * _profiles]);
+}
+
+PatternDB *PatternDBBuilder::fullBuild(std::vector<list_entry> &entries, std::vector<pattern> &patterns, const std::vector<uint8_t> &profile_flags, Poco::Logger &logger)
+{
+	std::unordered_map<std::string, uint32_t> ids;
+	ids.reserve(patterns.size());
+	std::shared_ptr<FlatAC> base = std::make_shared<FlatAC>(_fold_case);
+	std::shared_ptr<EntriesData> ed = newEntries();
+	std::shared_ptr<URLIndex> url_index;
+	std::shared_ptr<URLHosts> url_hosts;
+	if(_url_index)
+		url_index = std::make_shared<URLIndex>();
+	else
+		url_hosts = std::make_shared<URLHosts>();
+	uint32_t id = 0;
+	for(auto &p : patterns)
+	{
+		const list_entry &e = *p.entry;
+		if(!ids.emplace(key(p), id).second)
+		{
+			logger.warning("Pattern '%s' from line %u already present in the list", e.pattern, e.data.lineno);
+			continue;
+		}
+		p.id = id;
+		insertEntry(*ed, id, p, patterns, profile_flags);
+		if(inURLIndex(p.data) && url_index->insert(e.pattern, id) != URLIndex::INSERT_SUCCESS)
+		{
+			logger.warning("URL '%s' from line %u already present in the URL index", e.pattern, e.data.lineno);
+			if(!inAutomaton(p.data))
+				ed->remove(id);
+		}
+		if(inAutomaton(p.data))
+			base->addPattern(e.pattern, id);
+		if(url_hosts && (p.data.flags & E_FLAG_URL))
+			url_hosts->insert(e.pattern);
+		id++;
+	}
+	std::vector<uint32_t> duplicates;
+	base->finalize(&duplicates);
+	for(auto dup : duplicates)
+	{
+		const entry_data *d = ed->find(dup);
+		if(d)
+			logger.warning("Pattern from line %u already present in the database", d->lineno);
+		ed->remove(dup);
+	}
+	ed->finalize();
+	if(url_index)
+		url_index->finalize();
+	if(url_hosts)
+		url_hosts->finalize();
+	assignIds(entries, patterns);
+
+	PatternDB *db = new PatternDB();
+	db->base = base;
+	db->entries = ed;
+	db->urlIndex = url_index;
+	db->urlHosts = url_hosts;
+
+	_ids.swap(ids);
+	_base = base;
+	_overlay_patterns.clear();
+	_next_id = id;
+	_base_size = id;
+	_removed = 0;
+	_stats.patterns = ed->size();
+	_stats.added = ed->size();
+	_stats.removed = 0;
+	_stats.overlay = 0;
+	_stats.full = true;
+	return db;
+}
+
+PatternDB *PatternDBBuilder::update(std::vector<list_entry> &entries, Poco::Logger &logger)
+{
+	std::vector<uint8_t> profile_flags;
+	std::vector<pattern> patterns = merge(entries, profile_flags, logger);
+	if(!_base)
+		return fullBuild(entries, patterns, profile_flags, logger);
+
+	std::unordered_map<std::string, uint32_t> ids;
+	ids.reserve(patterns.size());
+	std::shared_ptr<EntriesData> ed = newEntries();
+	std::shared_ptr<URLIndex> url_index;
+	std::shared_ptr<URLHosts> url_hosts;
+	if(_url_index)
+		url_index = std::make_shared<URLIndex>();
+	else
+		url_hosts = std::make_shared<URLHosts>();
+	std::vector<const pattern *> added;
+	uint32_t next_id = _next_id;
+	for(auto &p : patterns)
+	{
+		const list_entry &e = *p.entry;
+		std::string k = key(p);
+		auto it = _ids.find(k);
+		uint32_t id = (it != _ids.end()) ? it->second : next_id;
+		if(!ids.emplace(std::move(k), id).second)
+		{
+			logger.warning("Pattern '%s' from line %u already present in the list", e.pattern, e.data.lineno);
+			continue;
+		}
+		if(it == _ids.end())
+		{
+			next_id++;
+			added.push_back(&p);
+		}
+		p.id = id;
+		insertEntry(*ed, id, p, patterns, profile_flags);
+		// хэш точных url дешев, его пересобираем полностью
+		if(inURLIndex(p.data) && url_index->insert(e.pattern, id) != URLIndex::INSERT_SUCCESS)
+		{
+			logger.warning("URL '%s' from line %u already present in the URL index", e.pattern, e.data.lineno);
+			if(!inAutomaton(p.data))
+				ed->remove(id);
+		}
+		if(url_hosts && (p.data.flags & E_FLAG_URL))
+			url_hosts->insert(e.pattern);
+	}
+	size_t removed = _ids.size() - (ids.size() - added.size());
+
+	// в накладной автомат попадают ранее добавленные и не удаленные шаблоны плюс новые
+	std::vector<std::pair<std::string, uint32_t>> overlay_patterns;
+	for(auto &p : _overlay_patterns)
+	{
+		if(ed->find(p.second))
+			overlay_patterns.push_back(p);
+	}
+	for(auto p : added)
+	{
+		if(inAutomaton(p->data))
+			overlay_patterns.push_back(std::make_pair(p->entry->pattern, p->id));
+	}
+	if(overlay_patterns.size() > std::max((size_t) PATTERNDB_OVERLAY_MIN, _base_size / PATTERNDB_OVERLAY_RATIO) ||
+		_removed + removed > _base_size / PATTERNDB_REMOVED_RATIO)
+	{
+		logger.information("Too many changes since the last full build, rebuilding the automaton");
+		for(auto &p : patterns)
+			p.id = FLATAC_NONE;
+		return fullBuild(entries, patterns, profile_flags, logger);
+	}
+
+	std::shared_ptr<FlatAC> overlay;
+	if(!overlay_patterns.empty())
+	{
+		overlay = std::make_shared<FlatAC>(_fold_case);
+		for(auto &p : overlay_patterns)
+			overlay->addPattern(p.first, p.second);
+		std::vector<uint32_t> duplicates;
+		overlay->finalize(&duplicates);
+		for(auto dup : duplicates)
+			ed->remove(dup);
+	}
+	ed->finalize();
+	if(url_index)
+		url_index->finalize();
+	if(url_hosts)
+		url_hosts->finalize();
+	assignIds(entries, patterns);
+
+	PatternDB *db = new PatternDB();
+	db->base = _base;
+	db->overlay = overlay;
+	db->entries = ed;
+	db->urlIndex = url_index;
+	db->urlHosts = url_hosts;
+
+	_ids.swap(ids);
+	_overlay_patterns.swap(overlay_patterns);
+	_next_id = next_id;
+	_removed += removed;
+	_stats.patterns = ed->size();
+	_stats.added = added.size();
+	_stats.removed = removed;
+	_stats.overlay = _overlay_patterns.size();
+	_stats.full = false;
+	return db;
+}
@@ -0,0 +1,435 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+
+
+/*
+ * extfilter-patterndbcheck: обновление базы шаблонов (PatternDBBuilder::update).
+ * - после случайных добавлений и удалений поколение с накладным автоматом находит те же шаблоны
+ *   с теми же флагами (и флагами профилей), что и полная сборка того же списка;
+ * - удаленный и снова добавленный шаблон находится один раз;
+ * - полная сборка при переполнении накладного автомата или удалении половины базового;
+ * - шаблон, который переходит между URLIndex и автоматом (ключи 'U' и 'A');
+ * - флаги шаблона в каждом профиле, их объединение, перенос шаблона между профилями и образ EntriesData;
+ * - выбор профиля по vlan и порту.
+ * Возвращает 1, если хотя бы одна проверка не прошла.
+*/
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <tuple>
+#include <random>
+#include <memory>
+#include <unordered_map>
+#include <algorithm>
+#include <Poco/Logger.h>
+#include "patterndb.h"
+#include "flatac.h"
+#include "urlindex.h"
+#include "profiles.h"
+#include "check.h"
+
+// позиция за совпадением, шаблон, флаги, флаги по профилям
+typedef std::tuple<uint32_t, std::string, uint8_t, std::string> found;
+
+static std::string randomText(std::mt19937 &rng, const char *alphabet, size_t min_length, size_t max_length)
+{
+	size_t length = min_length + rng() % (max_length - min_length + 1);
+	std::string text;
+	size_t n = strlen(alphabet);
+	for(size_t i = 0; i < length; i++)
+		text += alphabet[rng() % n];
+	return text;
+}
+
+static list_entry makeEntry(const std::string &pattern, uint8_t flags, uint8_t profile, uint32_t lineno)
+{
+	list_entry e;
+	e.pattern = pattern;
+	memset(&e.data, 0, sizeof(e.data));
+	e.data.lineno = lineno;
+	e.data.flags = flags;
+	e.id = 0;
+	e.profile = profile;
+	return e;
+}
+
+/// Id -> pattern of the generation, ids are assigned by update().
+static std::unordered_map<uint32_t, std::string> patternsOf(const std::vector<list_entry> &entries)
+{
+	std::unordered_map<uint32_t, std::string> result;
+	for(auto &e : entries)
+	{
+		if(e.id != FLATAC_NONE)
+			result[e.id] = e.pattern;
+	}
+	return result;
+}
+
+static std::string profileFlags(const EntriesData &ed, uint32_t id)
+{
+	std::string flags;
+	for(unsigned p = 0; p < ed.profiles(); p++)
+		flags.push_back(ed.profileFlags(id, p));
+	return flags;
+}
+
+static void searchAutomaton(const FlatAC *ac, const PatternDB &db, const std::unordered_map<uint32_t, std::string> &patterns, const std::string &text, std::vector<found> &result)
+{
+	if(ac == nullptr)
+		return;
+	FlatAC::Cursor cursor;
+	FlatAC::Match match;
+	ac->search(cursor, text.data(), text.length());
+	while(ac->findNext(cursor, match))
+	{
+		// удаленные шаблоны остаются в базовом автомате, но их нет в entries
+		const entry_data *d = db.entries->find(match.id);
+		if(d == nullptr)
+			continue;
+		auto it = patterns.find(match.id);
+		result.push_back(found(match.position, it != patterns.end() ? it->second : "?", d->flags, profileFlags(*db.entries, match.id)));
+	}
+}
+
+/// Everything the worker can find in the generation for the text: automaton matches and the exact url.
+static std::vector<found> search(const PatternDB &db, const std::unordered_map<uint32_t, std::string> &patterns, const std::string &text)
+{
+	std::vector<found> result;
+	searchAutomaton(db.base.get(), db, patterns, text, result);
+	searchAutomaton(db.overlay.get(), db, patterns, text, result);
+	uint32_t id, probes;
+	if(db.urlIndex && db.urlIndex->find(text.data(), text.length(), id, probes))
+	{
+		const entry_data *d = db.entries->find(id);
+		auto it = patterns.find(id);
+		if(d)
+			result.push_back(found(0, it != patterns.end() ? it->second : "?", d->flags, profileFlags(*db.entries, id)));
+	}
+	std::sort(result.begin(), result.end());
+	return result;
+}
+
+static std::vector<found> search(const PatternDB &db, const std::vector<list_entry> &entries, const std::string &text)
+{
+	return search(db, patternsOf(entries), text);
+}
+
+static uint8_t randomFlags(std::mt19937 &rng, bool url)
+{
+	static const uint8_t domain_flags[] = { E_FLAG_DOMAIN_EXACT, E_FLAG_DOMAIN_WILDCARD, E_FLAG_SSL_EXACT, E_FLAG_SSL_WILDCARD };
+	if(url)
+		return E_FLAG_URL;
+	return domain_flags[rng() % 4];
+}
+
+/// Random add/remove sequence: every generation of the delta builder must find the same as the full build.
+static void checkEquivalence(bool url_index, unsigned profiles)
+{
+	std::string mode = std::string(url_index ? "url index" : "automaton") + ", " + std::to_string(profiles) + " profiles";
+	std::mt19937 rng(6 + profiles + (url_index ? 10 : 0));
+	Poco::Logger &logger = Poco::Logger::get("PatternDBCheck");
+
+	// тексты шаблонов: домены и url на тех же хостах, часть url совпадает с доменом, чтобы
+	// шаблон с флагами url и домена попадал в автомат и в режиме url index
+	std::vector<std::string> hosts;
+	std::set<std::string> unique;
+	while(unique.size() < 6000)
+		unique.insert(randomText(rng, "abcdef", 2, 7) + ".ru");
+	hosts.assign(unique.begin(), unique.end());
+
+	std::vector<list_entry> list;
+	uint32_t lineno = 1;
+	auto randomEntry = [&]() -> list_entry
+	{
+		const std::string &host = hosts[rng() % hosts.size()];
+		bool url = rng() % 3 == 0;
+		std::string pattern = url ? host + "/" + randomText(rng, "ab", 0, 3) : host;
+		if(!url && rng() % 20 == 0)
+			pattern = host + "/"; // тот же текст, что и у url
+		return makeEntry(pattern, randomFlags(rng, url), rng() % profiles, lineno++);
+	};
+	for(int i = 0; i < 8000; i++)
+		list.push_back(randomEntry());
+
+	std::vector<std::string> texts;
+	for(int i = 0; i < 1000; i++)
+	{
+		const std::string &host = hosts[rng() % hosts.size()];
+		std::string text = randomText(rng, "abc.", 0, 3) + host;
+		if(rng() % 2)
+			text += "/" + randomText(rng, "ab", 0, 3);
+		texts.push_back(text);
+	}
+
+	PatternDBBuilder delta(false, url_index, profiles);
+	std::vector<list_entry> removed;
+	size_t generations = 0, full_builds = 0, mismatches = 0;
+	for(int round = 0; round < 30; round++)
+	{
+		// в основном мелкие изменения, иногда замена большей части списка, чтобы пройти через полную сборку
+		if(round % 10 == 9)
+		{
+			size_t keep = list.size() * 4 / 10;
+			removed.insert(removed.end(), list.begin() + keep, list.end());
+			list.resize(keep);
+			for(int i = 0; i < 5000; i++)
+				list.push_back(randomEntry());
+		}
+		size_t changes = 1 + rng() % 300;
+		for(size_t c = 0; c < changes && !list.empty(); c++)
+		{
+			switch(rng() % 3)
+			{
+				case 0:
+				{
+					size_t i = rng() % list.size();
+					removed.push_back(list[i]);
+					list[i] = list.back();
+					list.pop_back();
+					break;
+				}
+				case 1:
+					list.push_back(randomEntry());
+					break;
+				default:
+					// возврат удаленного шаблона, возможно в другой профиль
+					if(!removed.empty())
+					{
+						size_t i = rng() % removed.size();
+						list.push_back(removed[i]);
+						list.back().profile = rng() % profiles;
+						removed[i] = removed.back();
+						removed.pop_back();
+					}
+					break;
+			}
+		}
+		std::shuffle(list.begin(), list.end(), rng);
+
+		std::vector<list_entry> delta_entries(list);
+		std::unique_ptr<PatternDB> delta_db(delta.update(delta_entries, logger));
+		PatternDBBuilder full(false, url_index, profiles);
+		std::vector<list_entry> full_entries(list);
+		std::unique_ptr<PatternDB> full_db(full.update(full_entries, logger));
+		generations++;
+		full_builds += delta.lastStats().full;
+		expect(delta.lastStats().patterns == full.lastStats().patterns, mode + ": generation " + std::to_string(round) + " has " + std::to_string(delta.lastStats().patterns) + " patterns, the full build " + std::to_string(full.lastStats().patterns));
+
+		std::unordered_map<uint32_t, std::string> delta_patterns = patternsOf(delta_entries);
+		std::unordered_map<uint32_t, std::string> full_patterns = patternsOf(full_entries);
+		for(auto &text : texts)
+		{
+			std::vector<found> delta_found = search(*delta_db, delta_patterns, text);
+			std::vector<found> full_found = search(*full_db, full_patterns, text);
+			if(delta_found != full_found && mismatches++ < 10)
+				expect(false, mode + ": generation " + std::to_string(round) + " finds in '" + text + "' " + std::to_string(delta_found.size()) + " patterns, the full build " + std::to_string(full_found.size()));
+		}
+	}
+	expect(mismatches == 0, mode + ": " + std::to_string(mismatches) + " texts differ from the full build");
+	expect(full_builds > 1 && full_builds < generations, mode + ": delta builds are used and the full build happens, " + std::to_string(full_builds) + " full builds");
+	std::cout << "delta vs full, " << mode << ": " << generations << " generations, " << full_builds << " full builds" << std::endl;
+}
+
+static std::vector<list_entry> numbered(const std::string &prefix, size_t count, uint8_t flags)
+{
+	std::vector<list_entry> entries;
+	for(size_t i = 0; i < count; i++)
+		entries.push_back(makeEntry(prefix + std::to_string(i) + ".ru", flags, 0, i + 1));
+	return entries;
+}
+
+static size_t countMatches(const PatternDB &db, const std::vector<list_entry> &entries, const std::string &text)
+{
+	return search(db, entries, text).size();
+}
+
+static void checkUpdates()
+{
+	Poco::Logger &logger = Poco::Logger::get("PatternDBCheck");
+	{
+		// базовый автомат на 20000 шаблонов: накладной ограничен PATTERNDB_OVERLAY_MIN
+		PatternDBBuilder builder;
+		std::vector<list_entry> base = numbered("base", 20000, E_FLAG_DOMAIN_EXACT);
+		std::vector<list_entry> entries(base);
+		std::unique_ptr<PatternDB> db(builder.update(entries, logger));
+		expect(builder.lastStats().full && builder.lastStats().patterns == 20000, "the first update is the full build");
+
+		entries = base;
+		db.reset(builder.update(entries, logger));
+		expect(!builder.lastStats().full && builder.lastStats().added == 0 && builder.lastStats().removed == 0 && !db->overlay, "unchanged list keeps the base automaton without the overlay");
+
+		// удаление и повторное добавление
+		std::vector<list_entry> without(base.begin() + 1, base.end());
+		entries = without;
+		db.reset(builder.update(entries, logger));
+		expect(!builder.lastStats().full && builder.lastStats().removed == 1 && builder.lastStats().patterns == 19999, "removal keeps the base automaton");
+		expect(countMatches(*db, entries, "base0.ru") == 0, "removed pattern is not found");
+		entries = base;
+		db.reset(builder.update(entries, logger));
+		expect(!builder.lastStats().full && builder.lastStats().added == 1 && builder.lastStats().overlay == 1, "re-added pattern goes to the overlay");
+		expect(countMatches(*db, entries, "base0.ru") == 1, "re-added pattern is found once");
+
+		// накладной автомат растет до порога, затем полная сборка
+		std::vector<list_entry> added = numbered("new", PATTERNDB_OVERLAY_MIN, E_FLAG_DOMAIN_EXACT);
+		entries = base;
+		entries.insert(entries.end(), added.begin(), added.end() - 1);
+		db.reset(builder.update(entries, logger));
+		expect(!builder.lastStats().full && builder.lastStats().overlay == PATTERNDB_OVERLAY_MIN, "overlay of PATTERNDB_OVERLAY_MIN patterns, " + std::to_string(builder.lastStats().overlay));
+		expect(countMatches(*db, entries, "new0.ru") == 1 && countMatches(*db, entries, "base0.ru") == 1, "overlay and base patterns are found");
+		entries = base;
+		entries.insert(entries.end(), added.begin(), added.end());
+		db.reset(builder.update(entries, logger));
+		expect(builder.lastStats().full && !db->overlay, "overlay above PATTERNDB_OVERLAY_MIN makes the full build");
+		expect(countMatches(*db, entries, "new0.ru") == 1 && countMatches(*db, entries, "base0.ru") == 1, "patterns are found after the full build");
+	}
+	{
+		// удаления копятся между обновлениями до половины базового автомата
+		PatternDBBuilder builder;
+		std::vector<list_entry> base = numbered("base", 1000, E_FLAG_DOMAIN_EXACT);
+		std::vector<list_entry> entries(base);
+		std::unique_ptr<PatternDB> db(builder.update(entries, logger));
+		entries.assign(base.begin() + 300, base.end());
+		db.reset(builder.update(entries, logger));
+		expect(!builder.lastStats().full, "removal of 30% keeps the base automaton");
+		entries.assign(base.begin() + 500, base.end());
+		db.reset(builder.update(entries, logger));
+		expect(!builder.lastStats().full, "removal of 50% keeps the base automaton");
+		entries.assign(base.begin() + 501, base.end());
+		db.reset(builder.update(entries, logger));
+		expect(builder.lastStats().full && builder.lastStats().patterns == 499, "removal of more than 50% makes the full build");
+	}
+	{
+		// с match_url_exactly url хранится в URLIndex (ключ 'U'), а тот же текст из списка доменов - в автомате ('A')
+		PatternDBBuilder builder(false, true);
+		std::vector<list_entry> base = numbered("base", 100, E_FLAG_DOMAIN_EXACT);
+		std::vector<list_entry> entries(base);
+		entries.push_back(makeEntry("site.ru/page", E_FLAG_URL, 0, 1000));
+		std::unique_ptr<PatternDB> db(builder.update(entries, logger));
+		std::vector<found> r = search(*db, entries, "site.ru/page");
+		expect(r.size() == 1 && std::get<0>(r[0]) == 0 && std::get<2>(r[0]) == E_FLAG_URL, "url is found in the URL index only");
+
+		entries = base;
+		entries.push_back(makeEntry("site.ru/page", E_FLAG_URL, 0, 1000));
+		entries.push_back(makeEntry("site.ru/page", E_FLAG_DOMAIN_EXACT, 0, 1001));
+		db.reset(builder.update(entries, logger));
+		expect(!builder.lastStats().full && builder.lastStats().added == 1 && builder.lastStats().removed == 1, "url that became a domain changes the key");
+		r = search(*db, entries, "site.ru/page");
+		expect(r.size() == 2 && std::get<2>(r[0]) == (E_FLAG_URL | E_FLAG_DOMAIN_EXACT) && std::get<2>(r[1]) == (E_FLAG_URL | E_FLAG_DOMAIN_EXACT), "pattern with url and domain flags is in the automaton and in the URL index");
+
+		entries = base;
+		entries.push_back(makeEntry("site.ru/page", E_FLAG_URL, 0, 1000));
+		db.reset(builder.update(entries, logger));
+		r = search(*db, entries, "site.ru/page");
+		expect(!builder.lastStats().full && r.size() == 1 && std::get<0>(r[0]) == 0, "url that is no longer a domain leaves the automaton");
+	}
+}
+
+static const entry_data *findPattern(const PatternDB &db, const std::vector<list_entry> &entries, const std::string &pattern, uint32_t &id)
+{
+	for(auto &e : entries)
+	{
+		if(e.pattern == pattern)
+		{
+			id = e.id;
+			return db.entries->find(id);
+		}
+	}
+	return nullptr;
+}
+
+static void checkProfiles()
+{
+	Poco::Logger &logger = Poco::Logger::get("PatternDBCheck");
+	PatternDBBuilder builder(false, false, 3);
+	std::vector<list_entry> list;
+	list.push_back(makeEntry("both.ru", E_FLAG_DOMAIN_EXACT, 0, 1));
+	list.push_back(makeEntry("both.ru", E_FLAG_SSL_EXACT, 2, 2));
+	list.push_back(makeEntry("twice.ru", E_FLAG_DOMAIN_EXACT, 1, 3));
+	list.push_back(makeEntry("twice.ru", E_FLAG_DOMAIN_WILDCARD, 1, 4));
+	list.push_back(makeEntry("other.ru", E_FLAG_DOMAIN_EXACT, 7, 5)); // нет такого профиля - профиль 0
+	std::vector<list_entry> entries(list);
+	std::unique_ptr<PatternDB> db(builder.update(entries, logger));
+	expect(db->entries->profiles() == 3, "entries keep 3 profiles");
+
+	uint32_t id;
+	const entry_data *d = findPattern(*db, entries, "both.ru", id);
+	expect(d && d->flags == (E_FLAG_DOMAIN_EXACT | E_FLAG_SSL_EXACT), "flags of the pattern are the union of the profiles");
+	expect(d && db->entries->profileFlags(id, 0) == E_FLAG_DOMAIN_EXACT && db->entries->profileFlags(id, 1) == 0 && db->entries->profileFlags(id, 2) == E_FLAG_SSL_EXACT, "pattern has its own flags in every profile");
+	expect(entries[0].id == entries[1].id, "pattern of several profiles is stored once");
+	d = findPattern(*db, entries, "twice.ru", id);
+	expect(d && db->entries->profileFlags(id, 1) == (E_FLAG_DOMAIN_EXACT | E_FLAG_DOMAIN_WILDCARD) && db->entries->profileFlags(id, 0) == 0, "flags of the same profile are combined");
+	d = findPattern(*db, entries, "other.ru", id);
+	expect(d && db->entries->profileFlags(id, 0) == E_FLAG_DOMAIN_EXACT, "pattern of the unknown profile goes to profile 0");
+
+	// образ снимка хранит флаги профилей
+	std::string image;
+	db->entries->serialize(image);
+	std::shared_ptr<std::vector<uint64_t>> buffer = std::make_shared<std::vector<uint64_t>>(image.size() / 8 + 1);
+	memcpy(buffer->data(), image.data(), image.size());
+	std::unique_ptr<EntriesData> loaded(EntriesData::fromImage(buffer->data(), image.size(), buffer));
+	bool same = loaded->profiles() == 3;
+	for(auto &e : entries)
+	{
+		for(unsigned p = 0; p < 3 && same; p++)
+			same = loaded->find(e.id) && loaded->profileFlags(e.id, p) == db->entries->profileFlags(e.id, p);
+	}
+	expect(same, "EntriesData image keeps the flags of the profiles");
+
+	// перенос шаблона в другой профиль меняет только флаги, автомат остается прежним
+	list[1].profile = 1;
+	entries = list;
+	db.reset(builder.update(entries, logger));
+	d = findPattern(*db, entries, "both.ru", id);
+	expect(!builder.lastStats().full && builder.lastStats().added == 0 && !db->overlay, "moving the pattern between profiles keeps the automaton");
+	expect(d && db->entries->profileFlags(id, 1) == E_FLAG_SSL_EXACT && db->entries->profileFlags(id, 2) == 0, "moved pattern has the flags of the new profile");
+	list.pop_back();
+	list.push_back(makeEntry("other.ru", E_FLAG_URL, 2, 5));
+	entries = list;
+	db.reset(builder.update(entries, logger));
+	d = findPattern(*db, entries, "other.ru", id);
+	expect(d && d->flags == E_FLAG_URL && db->entries->profileFlags(id, 0) == 0 && db->entries->profileFlags(id, 2) == E_FLAG_URL, "pattern moved to the other list and profile");
+
+	PatternDBBuilder single;
+	entries = list;
+	db.reset(single.update(entries, logger));
+	d = findPattern(*db, entries, "both.ru", id);
+	expect(d && db->entries->profiles() == 1 && db->entries->profileFlags(id, 0) == d->flags, "without profiles profile 0 has all flags");
+
+	ProfileMap map;
+	map.setPort(1, 1);
+	map.setVlan(100, 2);
+	expect(map.lookup(0, PROFILE_NO_VLAN) == 0, "port without a profile selects profile 0");
+	expect(map.lookup(1, PROFILE_NO_VLAN) == 1, "profile is selected by the port");
+	expect(map.lookup(1, 100) == 2 && map.lookup(0, 100) == 2, "vlan has priority over the port");
+	expect(map.lookup(1, 101) == 1, "port is used when the vlan has no profile");
+}
+
+int main()
+{
+	checkUpdates();
+	checkProfiles();
+	checkEquivalence(false, 1);
+	checkEquivalence(true, 1);
+	checkEquivalence(false, 3);
+	checkEquivalence(true, 3);
+	return checkResult();
+}
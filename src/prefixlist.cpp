@@ -0,0 +1,109 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <Poco/Exception.h>
+#include <Poco/NumberParser.h>
+#include <Poco/Net/IPAddress.h>
+#include "prefixlist.h"
+
+bool IPPrefixList::add(const std::string &description, uint8_t value)
+{
+	Poco::Net::IPAddress address;
+	int depth = -1;
+	std::size_t slash = description.find('/');
+	if(slash != std::string::npos)
+	{
+		if(!Poco::Net::IPAddress::tryParse(description.substr(0, slash), address))
+			return false;
+		if(!Poco::NumberParser::tryParse(description.substr(slash + 1), depth))
+			return false;
+	} else {
+		if(!Poco::Net::IPAddress::tryParse(description, address))
+			return false;
+	}
+	if(address.family() == Poco::Net::IPAddress::IPv4)
+		return add(address.addr(), AF_INET, depth < 0 ? 32 : depth, value);
+	return add(address.addr(), AF_INET6, depth < 0 ? 128 : depth, value);
+}
+
+bool IPPrefixList::add(const void *address, int family, int depth, uint8_t value)
+{
+	if(family == AF_INET)
+	{
+		if(depth < 1 || depth > 32)
+			return false;
+		prefix4 p;
+		memset(&p, 0, sizeof(p));
+		p.ip = ntohl(*(const uint32_t *) address);
+		p.depth = depth;
+		p.value = value;
+		_prefixes4.push_back(p);
+		return true;
+	}
+	if(family == AF_INET6)
+	{
+		if(depth < 1 || depth > 128)
+			return false;
+		prefix6 p;
+		memset(&p, 0, sizeof(p));
+		memcpy(p.ip, address, sizeof(p.ip));
+		p.depth = depth;
+		p.value = value;
+		_prefixes6.push_back(p);
+		return true;
+	}
+	return false;
+}
+
+void IPPrefixList::append(const IPPrefixList &other)
+{
+	_prefixes4.insert(_prefixes4.end(), other._prefixes4.begin(), other._prefixes4.end());
+	_prefixes6.insert(_prefixes6.end(), other._prefixes6.begin(), other._prefixes6.end());
+}
+
+void IPPrefixList::serialize(std::string &out) const
+{
+	image_header h;
+	memset(&h, 0, sizeof(h));
+	h.magic = PREFIXLIST_IMAGE_MAGIC;
+	h.count4 = _prefixes4.size();
+	h.count6 = _prefixes6.size();
+	out.append((const char *) &h, sizeof(h));
+	out.append((const char *) _prefixes4.data(), _prefixes4.size() * sizeof(prefix4));
+	out.append((const char *) _prefixes6.data(), _prefixes6.size() * sizeof(prefix6));
+}
+
+void IPPrefixList::deserialize(const void *image, size_t size)
+{
+	const uint8_t *p = (const uint8_t *) image;
+	if(size < sizeof(image_header))
+		throw Poco::Exception("Prefix list image is too short");
+	const image_header *h = (const image_header *) p;
+	if(h->magic != PREFIXLIST_IMAGE_MAGIC)
+		throw Poco::Exception("Bad prefix list image magic");
+	if(sizeof(image_header) + (uint64_t) h->count4 * sizeof(prefix4) + (uint64_t) h->count6 * sizeof(prefix6) > size)
+		throw Poco::Exception("Prefix list image is truncated");
+	const prefix4 *p4 = (const prefix4 *)(p + sizeof(image_header));
+	const prefix6 *p6 = (const prefix6 *)(p4 + h->count4);
+	_prefixes4.assign(p4, p4 + h->count4);
+	_prefixes6.assign(p6, p6 + h->count6);
+}
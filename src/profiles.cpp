@@ -0,0 +1,71 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#include <algorithm>
+#include <Poco/StringTokenizer.h>
+#include <Poco/NumberParser.h>
+#include <Poco/Exception.h>
+#include "profiles.h"
+
+void loadProfiles(const Poco::Util::AbstractConfiguration &config, std::vector<list_profile> &profiles, ProfileMap *map)
+{
+	profiles.clear();
+	list_profile main;
+	main.name = "default";
+	main.domainsFile = config.getString("domainlist", "");
+	main.urlsFile = config.getString("urllist", "");
+	main.sslFile = config.getString("ssllist", "");
+	profiles.push_back(main);
+
+	Poco::Util::AbstractConfiguration::Keys names;
+	config.keys("profile", names);
+	if(names.size() + 1 > MAX_PROFILES)
+		throw Poco::InvalidArgumentException("Too many profiles, maximum is " + std::to_string(MAX_PROFILES - 1));
+	// порядок профилей одинаков в extFilter и extfilter-compile, от него зависят флаги в snapshot
+	std::sort(names.begin(), names.end());
+	for(auto &name : names)
+	{
+		std::string prefix = "profile." + name + ".";
+		list_profile p;
+		p.name = name;
+		p.domainsFile = config.getString(prefix + "domainlist", "");
+		p.urlsFile = config.getString(prefix + "urllist", "");
+		p.sslFile = config.getString(prefix + "ssllist", "");
+		uint8_t id = profiles.size();
+		profiles.push_back(p);
+		if(map == nullptr)
+			continue;
+		Poco::StringTokenizer vlans(config.getString(prefix + "vlans", ""), ",", Poco::StringTokenizer::TOK_TRIM | Poco::StringTokenizer::TOK_IGNORE_EMPTY);
+		for(auto &v : vlans)
+		{
+			unsigned int vlan;
+			if(!Poco::NumberParser::tryParseUnsigned(v, vlan) || vlan >= PROFILE_VLANS)
+				throw Poco::InvalidArgumentException("Bad vlan '" + v + "' in the profile " + name);
+			map->setVlan(vlan, id);
+		}
+		Poco::StringTokenizer ports(config.getString(prefix + "ports", ""), ",", Poco::StringTokenizer::TOK_TRIM | Poco::StringTokenizer::TOK_IGNORE_EMPTY);
+		for(auto &v : ports)
+		{
+			unsigned int port;
+			if(!Poco::NumberParser::tryParseUnsigned(v, port) || port >= PROFILE_MAX_PORTS)
+				throw Poco::InvalidArgumentException("Bad port '" + v + "' in the profile " + name);
+			map->setPort(port, id);
+		}
+	}
+}
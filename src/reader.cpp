@@ -27,7 +27,8 @@ bool ReaderThread::run(uint32_t coreId)
 //	m_CoreId = coreId;
 	m_Stop = false;
 	uint16_t nb_rx;
-	struct rte_mbuf *bufs[EXTFILTER_CAPTURE_BURST_SIZE];
+	struct rte_mbuf *bufs[EXTFILTER_CAPTURE_BURST_SIZE * 2];
+	BridgeForwarder *bridge = m_WorkerConfig.bridge;
 
 	_logger.debug("Starting reading thread on core %u", coreId);
 
@@ -39,16 +40,32 @@ bool ReaderThread::run(uint32_t coreId)
 			continue;
 		}
 		nb_rx = rte_eth_rx_burst(m_WorkerConfig.port, 0, bufs, EXTFILTER_CAPTURE_BURST_SIZE);
+		if(bridge)
+			nb_rx += rte_eth_rx_burst(m_WorkerConfig.bridge_port, 0, bufs + nb_rx, EXTFILTER_CAPTURE_BURST_SIZE);
 		if (likely(nb_rx > 0))
 		{
-			int processed_pkts=rte_distributor_process(_distr->getDistributor(), bufs, nb_rx);
 			m_ThreadStats.total_packets += nb_rx;
+			// worker'ы не успевают - в разрыве пропускаем трафик без анализа (fail-open)
+			if(bridge && _distr->backlog(m_ThreadStats.enqueued_packets) > m_WorkerConfig.bridge_max_backlog)
+			{
+				for(uint16_t i = 0; i < nb_rx; i++)
+					bridge->forward(bufs[i]);
+				m_ThreadStats.bridge_bypassed += nb_rx;
+				continue;
+			}
+			int processed_pkts=rte_distributor_process(_distr->getDistributor(), bufs, nb_rx);
 			m_ThreadStats.enqueued_packets += processed_pkts;
 			m_ThreadStats.missed_packets += nb_rx-processed_pkts;
 			while(processed_pkts < nb_rx)
 			{
-				rte_pktmbuf_free(bufs[processed_pkts++]);
+				if(bridge)
+					bridge->forward(bufs[processed_pkts++]);
+				else
+					rte_pktmbuf_free(bufs[processed_pkts++]);
 			}
+		} else if(bridge)
+		{
+			bridge->flush();
 		}
 	}
 	rte_distributor_process(_distr->getDistributor(), NULL, 0);
@@ -0,0 +1,59 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#include <string.h>
+#include "redirecttemplate.h"
+
+RedirectTemplate::RedirectTemplate(const std::string &code, const std::string &redirect_url) :
+	_prefix("HTTP/1.1 " + code + "\r\nLocation: " + redirect_url),
+	_suffix("\r\nConnection: close\r\n"),
+	_with_param(!redirect_url.empty() && redirect_url[redirect_url.length()-1] == '?')
+{
+	_header = _prefix + _suffix;
+	_header_sum = __rte_raw_cksum(_header.data(), _header.length(), 0);
+	_prefix_sum = __rte_raw_cksum(_prefix.data(), _prefix.length(), 0);
+	_suffix_sum = __rte_raw_cksum(_suffix.data(), _suffix.length(), 0);
+}
+
+size_t RedirectTemplate::build(char *dst, size_t max, const char *param, size_t param_length, uint32_t &sum) const
+{
+	size_t length = _prefix.length() + param_length + _suffix.length();
+	if(!_with_param || !param_length || length > max)
+	{
+		// параметр не нужен или не помещается в пакет
+		if(_header.length() > max)
+		{
+			sum = 0;
+			return 0;
+		}
+		memcpy(dst, _header.data(), _header.length());
+		sum = _header_sum;
+		return _header.length();
+	}
+	memcpy(dst, _prefix.data(), _prefix.length());
+	memcpy(dst + _prefix.length(), param, param_length);
+	memcpy(dst + _prefix.length() + param_length, _suffix.data(), _suffix.length());
+	uint64_t s = _prefix_sum;
+	s += placeSum(__rte_raw_cksum(param, param_length, 0), _prefix.length());
+	s += placeSum(_suffix_sum, _prefix.length() + param_length);
+	s = (s & 0xffffffff) + (s >> 32);
+	s = (s & 0xffffffff) + (s >> 32);
+	sum = (uint32_t) s;
+	return length;
+}
@@ -17,10 +17,19 @@
 *
 */
 
+#include <unistd.h>
+#include <errno.h>
+#include <sys/inotify.h>
+#include <Poco/Path.h>
 #include "dtypes.h"
 #include "reloadtask.h"
 #include "main.h"
-#include "AhoCorasickPlus.h"
+#include "flatac.h"
+#include "urlindex.h"
+#include "lpm.h"
+#include "ipporttable.h"
+#include "snapshot.h"
+#include "patterndb.h"
 #include "worker.h"
 
 
@@ -31,14 +40,75 @@ ReloadTask::ReloadTask(extFilter *parent, std::vector<DpdkWorkerThread*> &worker
 	Task("ReloadTask"),
 	_parent(parent),
 	_logger(Poco::Logger::get("ReloadTask")),
-	workerThreadVec(workerThreadVector)
+	workerThreadVec(workerThreadVector),
+	_inotify_fd(-1),
+	_changed(false)
 {
-
+	if(_parent->getWatchLists())
+		watchLists();
 }
 
 
 ReloadTask::~ReloadTask()
 {
+	if(_inotify_fd >= 0)
+		close(_inotify_fd);
+}
+
+void ReloadTask::watchLists()
+{
+	_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if(_inotify_fd < 0)
+	{
+		_logger.error("Unable to init inotify, errno %d. Lists will be reloaded only by the signal", errno);
+		return;
+	}
+	std::vector<std::string> files = _parent->getListFiles();
+	for(auto &fn : files)
+	{
+		Poco::Path path(fn);
+		path.makeAbsolute();
+		std::string dir = path.parent().toString();
+		int wd = inotify_add_watch(_inotify_fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+		if(wd < 0)
+		{
+			_logger.error("Unable to watch directory %s, errno %d", dir, errno);
+			continue;
+		}
+		_watches[wd].insert(path.getFileName());
+		_logger.information("Watching list file %s", path.toString());
+	}
+}
+
+bool ReloadTask::listsChanged()
+{
+	if(_inotify_fd < 0)
+		return false;
+	char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	ssize_t len;
+	while((len = read(_inotify_fd, buf, sizeof(buf))) > 0)
+	{
+		for(char *ptr = buf; ptr < buf + len; ptr += sizeof(struct inotify_event) + ((struct inotify_event *) ptr)->len)
+		{
+			const struct inotify_event *event = (const struct inotify_event *) ptr;
+			if(event->len == 0)
+				continue;
+			auto it = _watches.find(event->wd);
+			if(it != _watches.end() && it->second.count(event->name))
+			{
+				_logger.debug("List file %s is changed", std::string(event->name));
+				_changed = true;
+				_last_change.update();
+			}
+		}
+	}
+	// ждем окончания серии записей, extfilter-maker переписывает все файлы подряд
+	if(_changed && _last_change.elapsed() >= (Poco::Timestamp::TimeDiff) _parent->getReloadDebounce() * 1000)
+	{
+		_changed = false;
+		return true;
+	}
+	return false;
 }
 
 void ReloadTask::runTask()
@@ -49,110 +119,88 @@ void ReloadTask::runTask()
 		if(_event.tryWait(300))
 		{
 			_logger.information("Reloading data from files...");
-			for(std::vector<DpdkWorkerThread*>::iterator it=workerThreadVec.begin(); it != workerThreadVec.end(); it++)
-			{
-				if(dynamic_cast<WorkerThread*>(*it) == nullptr)
-					continue;
-				WorkerConfig& config=(static_cast<WorkerThread*>(*it))->getConfig();
-				AhoCorasickPlus *to_del_atm;
-				DomainsMatchType *to_del_dm;
-				AhoCorasickPlus *atm_new;
-				DomainsMatchType *dm_new;
-				EntriesData *datas_new;
-				if(!_parent->getSSLFile().empty())
-				{
-					atm_new = new AhoCorasickPlus();
-					dm_new = new DomainsMatchType;
-					try
-					{
-						_parent->loadDomains(_parent->getSSLFile(), atm_new, dm_new);
-						atm_new->finalize();
-						config.atmSSLDomainsLock.lock();
-						to_del_atm = config.atmSSLDomains;
-						to_del_dm = config.SSLdomainsMatchType;
-						config.atmSSLDomains = atm_new;
-						config.SSLdomainsMatchType = dm_new;
-						config.atmSSLDomainsLock.unlock();
-						delete to_del_atm;
-						delete to_del_dm;
-						_logger.information("Reloaded data for ssl domains list for core %u", (*it)->getCoreId());
-					} catch (Poco::Exception &excep)
-					{
-						_logger.error("Got exception while reload ssl data: %s", excep.displayText());
-						delete atm_new;
-						delete dm_new;
-					}
-				}
-				if(!_parent->getDomainsFile().empty() && !_parent->getURLsFile().empty())
-				{
-					atm_new = new AhoCorasickPlus();
-					datas_new = new EntriesData();
-					EntriesData *datas_del;
-					try
-					{
-						_parent->loadDomainsURLs(_parent->getDomainsFile(), _parent->getURLsFile(), atm_new, datas_new);
-						atm_new->finalize();
-						config.atmLock.lock();
-						to_del_atm = config.atm;
-						config.atm = atm_new;
-						datas_del = config.entriesData;
-						config.entriesData = datas_new;
-						config.atmLock.unlock();
-						delete to_del_atm;
-						delete datas_del;
-						_logger.information("Reloaded data for domains and urls list for core %u", (*it)->getCoreId());
-					} catch (Poco::Exception &excep)
-					{
-						_logger.error("Got exception while reload domains and urls data: %s", excep.displayText());
-						delete atm_new;
-						delete datas_new;
-					}
-				}
-				if(!_parent->getHostsFile().empty())
-				{
-					IPPortMap *ip_port_map = new IPPortMap;
-					Patricia *newp = new Patricia();
-					try
-					{
-						IPPortMap *old;
-						Patricia *old_p;
-						_parent->loadHosts(_parent->getHostsFile(),ip_port_map,newp);
-						config.ipportMapLock.lock();
-						old = config.ipportMap;
-						old_p = config.ipPortMap;
-						config.ipportMap = ip_port_map;
-						config.ipPortMap = newp;
-						config.ipportMapLock.unlock();
-						delete old;
-						delete old_p;
-						_logger.information("Reloaded data for ip port list for core %u", (*it)->getCoreId());
-					} catch (Poco::Exception &excep)
-					{
-						_logger.error("Got exception while reload ip port data: %s", excep.displayText());
-						delete ip_port_map;
-					}
-				}
-				if(!_parent->getSSLIpsFile().empty() && config.block_undetected_ssl)
-				{
-					Patricia *ssl_ips = new Patricia;
-					try
-					{
-						_parent->loadSSLIP(_parent->getSSLIpsFile(),ssl_ips);
-						Patricia *ssl_ips_old;
-						config.sslIPsLock.lock();
-						ssl_ips_old = config.sslIPs;
-						config.sslIPs = ssl_ips;
-						config.sslIPsLock.unlock();
-						delete ssl_ips_old;
-						_logger.information("Reloaded data for ssl ip list for core %u", (*it)->getCoreId());
-					} catch (Poco::Exception &excep)
-					{
-						_logger.error("Got exception while reload ip ssl data: %s", excep.displayText());
-						delete ssl_ips;
-					}
-				}
-			}
+			_changed = false;
+			reloadLists();
+		} else if(listsChanged())
+		{
+			_logger.information("List files are changed, reloading data from files...");
+			reloadLists();
 		}
 	}
 	_logger.debug("Stopping reload task...");
 }
+
+void ReloadTask::reloadLists()
+{
+	std::shared_ptr<Snapshot> snapshot;
+	try
+	{
+		snapshot = _parent->openSnapshot();
+	} catch (Poco::Exception &excep)
+	{
+		_logger.error("Got exception while open snapshot: %s", excep.displayText());
+		return;
+	}
+	// новое поколение строится один раз, worker'ы получают копии PatternDB с общими частями
+	// и общие таблицы ip. Не изменившиеся и не загрузившиеся списки остаются прежними.
+	ListsGeneration gen;
+	_parent->buildGeneration(snapshot.get(), gen, true);
+	std::unique_ptr<PatternDB> patterns_db(gen.patternsDB);
+	IPPortTable *ip_port_table = gen.ipPortTable;
+	LpmTable *ip_port_nets = gen.ipPortNets;
+	LpmTable *ssl_ips = gen.sslIPs;
+	gen.patternsDB = nullptr;
+	gen.ipPortTable = nullptr;
+	gen.ipPortNets = nullptr;
+	gen.sslIPs = nullptr;
+	IPPortTable *old_ip_port_table = nullptr;
+	LpmTable *old_ip_port_nets = nullptr;
+	LpmTable *old_ssl_ips = nullptr;
+	for(std::vector<DpdkWorkerThread*>::iterator it=workerThreadVec.begin(); it != workerThreadVec.end(); it++)
+	{
+		if(dynamic_cast<WorkerThread*>(*it) == nullptr)
+			continue;
+		WorkerConfig& config=(static_cast<WorkerThread*>(*it))->getConfig();
+		PatternDB *to_del_db;
+		if(patterns_db)
+		{
+			PatternDB *db_new = new PatternDB(*patterns_db);
+			config.atmLock.lock();
+			to_del_db = config.patternsDB;
+			config.patternsDB = db_new;
+			// результаты в кэше worker'а относятся к старому поколению
+			config.patterns_generation++;
+			config.atmLock.unlock();
+			delete to_del_db;
+			_logger.information("Reloaded data for domains, urls and ssl domains lists for core %u", (*it)->getCoreId());
+		}
+		if(ip_port_table)
+		{
+			config.ipportMapLock.lock();
+			old_ip_port_table = config.ipPortTable;
+			old_ip_port_nets = config.ipPortNets;
+			config.ipPortTable = ip_port_table;
+			config.ipPortNets = ip_port_nets;
+			// сбрасываем результаты, закэшированные во flow
+			config.ipport_generation++;
+			config.ipportMapLock.unlock();
+			_logger.information("Reloaded data for ip port list for core %u", (*it)->getCoreId());
+		}
+		if(ssl_ips)
+		{
+			config.sslIPsLock.lock();
+			old_ssl_ips = config.sslIPs;
+			config.sslIPs = ssl_ips;
+			config.sslIPsLock.unlock();
+			_logger.information("Reloaded data for ssl ip list for core %u", (*it)->getCoreId());
+		}
+	}
+	// старые таблицы ip общие для всех worker'ов, удаляем после замены у всех
+	if(ip_port_table)
+	{
+		delete old_ip_port_table;
+		delete old_ip_port_nets;
+	}
+	if(ssl_ips)
+		delete old_ssl_ips;
+}
@@ -497,7 +497,8 @@ int multifast_replace (AC_TRIE_t *thiz, AC_TEXT_t *instr,
      */
     while (position_r < instr->length)
     {
-        if (!(next = node_find_next_bs(current, instr->astring[position_r])))
+        if (!(next = node_find_next_bs(current, 
+                thiz->alphabet_map[(unsigned char) instr->astring[position_r]])))
         {
             /* Failed to follow a pattern */
             if(current->failure_node)
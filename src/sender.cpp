@@ -20,6 +20,7 @@
 #include "sender.h"
 #include <unistd.h>
 #include <netinet/ip6.h>
+#include <algorithm>
 #include <Poco/FileStream.h>
 #include <rte_config.h>
 #include <rte_ip.h>
@@ -42,14 +43,18 @@ struct ipv6_pseudo_hdr
 		   nexthdr: 8;
 };
 
-CSender::CSender(struct params &prm) : _logger(Poco::Logger::get("CSender")), _parameters(prm)
+CSender::CSender(struct params &prm) : _batch4(new batch), _batch6(new batch), _packets(0), _syscalls(0), _logger(Poco::Logger::get("CSender")), _parameters(prm), _template(prm.code, prm.redirect_url)
 {
 	this->s = ::socket( PF_INET, SOCK_RAW, IPPROTO_RAW );
+	this->s6 = -1;
+	initBatch(*_batch4, s);
+	initBatch(*_batch6, s6);
 	if( s == -1 ) {
 		_logger.error("Failed to create IPv4 socket!");
 		return;
 	}
 	this->s6 = ::socket( PF_INET6, SOCK_RAW, IPPROTO_RAW );
+	_batch6->sock = s6;
 	if( s6 == -1 ) {
 		_logger.error("Failed to create IPv6 socket!");
 		return;
@@ -63,23 +68,77 @@ CSender::CSender(struct params &prm) : _logger(Poco::Logger::get("CSender")), _p
 		return;
 	}
 
-	this->rHeader = "HTTP/1.1 "+_parameters.code+"\r\nLocation: " + _parameters.redirect_url + "\r\nConnection: close\r\n";
-	_logger.debug("Default header is %s", rHeader);
+	_logger.debug("Default header is %s", _template.header());
 }
 
 CSender::~CSender()
 {
+	flush();
 	::close(s);
 	::close(s6);
 }
 
-void CSender::sendPacket(Poco::Net::IPAddress &ip_from, Poco::Net::IPAddress &ip_to, int port_from, int port_to, uint32_t acknum, uint32_t seqnum, std::string &dt, int f_reset, int f_psh)
+void CSender::initBatch(batch &b, int sock)
 {
-	char datagram[4096], *data;
-	
-	// zero out the packet buffer
-	memset(datagram, 0, sizeof(datagram));
-	
+	b.sock = sock;
+	b.count = 0;
+	memset(b.msgs, 0, sizeof(b.msgs));
+	for(int i = 0; i < SENDER_MMSG_BATCH; i++)
+	{
+		b.iov[i].iov_base = b.frames[i];
+		b.iov[i].iov_len = 0;
+		b.msgs[i].msg_hdr.msg_iov = &b.iov[i];
+		b.msgs[i].msg_hdr.msg_iovlen = 1;
+		b.msgs[i].msg_hdr.msg_name = &b.addrs[i];
+	}
+}
+
+void CSender::flush(batch &b)
+{
+	unsigned int sent = 0;
+	while(sent < b.count)
+	{
+		int res = ::sendmmsg(b.sock, &b.msgs[sent], b.count - sent, 0);
+		_syscalls++;
+		if(res < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			// пакет, на котором произошла ошибка, пропускаем, остальные пробуем отправить
+			char addr[INET6_ADDRSTRLEN];
+			if(b.addrs[sent].sin.sin_family == AF_INET)
+				inet_ntop(AF_INET, &b.addrs[sent].sin.sin_addr, addr, sizeof(addr));
+			else
+				inet_ntop(AF_INET6, &b.addrs[sent].sin6.sin6_addr, addr, sizeof(addr));
+			_logger.error("sendmmsg() failed to %s errno: %d", std::string(addr), errno);
+			sent++;
+			continue;
+		}
+		sent += res;
+		_packets += res;
+	}
+	b.count = 0;
+}
+
+void CSender::flush()
+{
+	if(_batch4->count)
+		flush(*_batch4);
+	if(_batch6->count)
+		flush(*_batch6);
+}
+
+void CSender::sendPacket(Poco::Net::IPAddress &ip_from, Poco::Net::IPAddress &ip_to, int port_from, int port_to, uint32_t acknum, uint32_t seqnum, const char *param, size_t param_length, int f_reset, int f_psh)
+{
+	char *data;
+	bool ipv4 = (ip_from.family() == Poco::Net::IPAddress::IPv4);
+	batch &b = ipv4 ? *_batch4 : *_batch6;
+	if(b.count == SENDER_MMSG_BATCH)
+		flush(b);
+	// пакет строится сразу в кадре пачки, обнуляются только заголовки
+	char *datagram = b.frames[b.count];
+	memset(datagram, 0, (ipv4 ? sizeof(struct iphdr) : sizeof(struct ip6_hdr)) + sizeof(struct tcphdr));
+
 	// IP header
 	struct iphdr *iph = (struct iphdr *) datagram;
 	struct ip6_hdr *iph6 = (struct ip6_hdr *) datagram;
@@ -87,23 +146,20 @@ void CSender::sendPacket(Poco::Net::IPAddress &ip_from, Poco::Net::IPAddress &ip
 	// TCP header
 	struct tcphdr *tcph = (struct tcphdr *) (datagram + (ip_from.family() == Poco::Net::IPAddress::IPv4 ? sizeof(struct iphdr) : sizeof(struct ip6_hdr)));
 
-	struct sockaddr_in sin;
-	struct sockaddr_in6 sin6;
-	int payloadlen=dt.size();
-	if(payloadlen > (_parameters.mtu - (ip_from.family() == Poco::Net::IPAddress::IPv4 ? sizeof(struct iphdr) : sizeof(struct ip6_hdr)) + sizeof(struct tcphdr) - 12))
-	{
-		_logger.warning("Size of the outgoing packet bigger than the MTU. Removing all additional data in the redirect packet.");
-		dt = rHeader;
-		payloadlen = rHeader.size();
-	}
-	// Data part
+	struct sockaddr_in &sin = b.addrs[b.count].sin;
+	struct sockaddr_in6 &sin6 = b.addrs[b.count].sin6;
+	// Data part, rst без данных
 	data = (char *)tcph + sizeof(struct tcphdr);
-	memcpy(data,dt.c_str(),payloadlen);
+	size_t max_payload = std::min((size_t)_parameters.mtu, (size_t)SENDER_FRAME_SIZE) - (data - datagram);
+	uint32_t payload_sum = 0;
+	int payloadlen = f_reset ? 0 : _template.build(data, max_payload, param, param_length, payload_sum);
 
-	_logger.debug("Trying to send packet to %s port %d", ip_to.toString(), port_to);
+	if(_logger.debug())
+		_logger.debug("Trying to send packet to %s port %d", ip_to.toString(), port_to);
 
 	if(ip_from.family() == Poco::Net::IPAddress::IPv4)
 	{
+		memset(&sin, 0, sizeof(sin));
 		sin.sin_family = AF_INET;
 		sin.sin_port = htons(port_to);
 		sin.sin_addr.s_addr=((in_addr *)ip_to.addr())->s_addr;
@@ -120,6 +176,7 @@ void CSender::sendPacket(Poco::Net::IPAddress &ip_from, Poco::Net::IPAddress &ip
 		iph->saddr = ((in_addr *)ip_from.addr())->s_addr;
 		iph->daddr = sin.sin_addr.s_addr;
 	} else {
+		memset(&sin6, 0, sizeof(sin6));
 		sin6.sin6_family = AF_INET6;
 		sin6.sin6_port = 0; // not filled in ipv6
 		memcpy(&sin6.sin6_addr,ip_to.addr(),sizeof(sin6.sin6_addr));
@@ -164,53 +221,41 @@ void CSender::sendPacket(Poco::Net::IPAddress &ip_from, Poco::Net::IPAddress &ip
 	if(ip_from.family() == Poco::Net::IPAddress::IPv4)
 	{
 		iph->tot_len = rte_cpu_to_be_16(iph->tot_len);
-		tcph->check = rte_ipv4_udptcp_cksum((const ipv4_hdr*)iph,tcph);
+		tcph->check = RedirectTemplate::tcpChecksum(rte_ipv4_phdr_cksum((const ipv4_hdr*)iph, 0), tcph, sizeof(struct tcphdr), payload_sum);
 		iph->tot_len = rte_be_to_cpu_16(iph->tot_len);
-		// Send the packet
-		if( ::sendto( this->s, datagram, iph->tot_len, 0, (struct sockaddr *)&sin, sizeof(sin)) < 0 )
-		{
-			_logger.error("sendto() failed to %s:%d errno: %d",ip_to.toString(), port_to, errno);
-		}
+		b.iov[b.count].iov_len = iph->tot_len;
+		b.msgs[b.count].msg_hdr.msg_namelen = sizeof(sin);
 	} else {
-		tcph->check = rte_ipv6_udptcp_cksum((const ipv6_hdr*)iph6,tcph);
-
-		// Send the packet
-		if( ::sendto( this->s6, datagram, (sizeof(struct ip6_hdr) + sizeof(struct tcphdr) + payloadlen), 0, (struct sockaddr *)&sin6, sizeof(sin6)) < 0 )
-		{
-			_logger.error("sendto() failed to [%s]:%d errno: %d",ip_to.toString(), port_to, errno);
-		}
+		tcph->check = RedirectTemplate::tcpChecksum(rte_ipv6_phdr_cksum((const ipv6_hdr*)iph6, 0), tcph, sizeof(struct tcphdr), payload_sum);
+		b.iov[b.count].iov_len = sizeof(struct ip6_hdr) + sizeof(struct tcphdr) + payloadlen;
+		b.msgs[b.count].msg_hdr.msg_namelen = sizeof(sin6);
 	}
+	// отправка в flush(), когда пачка заполнится или у SenderTask кончатся запросы
+	b.count++;
 
 	return;
 }
 
-//void CSender::sendPacket(char *ip_from, char *ip_to, int port_from, int port_to, uint32_t acknum, uint32_t seqnum)
-void CSender::Redirect(int user_port, int dst_port, Poco::Net::IPAddress &user_ip, Poco::Net::IPAddress &dst_ip, uint32_t acknum, uint32_t seqnum, int f_psh, std::string &additional_param )
+void CSender::Redirect(int user_port, int dst_port, Poco::Net::IPAddress &user_ip, Poco::Net::IPAddress &dst_ip, uint32_t acknum, uint32_t seqnum, int f_psh, const char *additional_param, size_t param_length)
 {
-	// формируем дополнительные параметры
-	std::string tstr = rHeader;
-	if(!additional_param.empty() && _parameters.redirect_url[_parameters.redirect_url.length()-1] == '?')
-	{
-		tstr = "HTTP/1.1 "+_parameters.code+"\r\nLocation: " + _parameters.redirect_url + additional_param + "\r\nConnection: close\r\n";
-	}
-	this->sendPacket(dst_ip, user_ip, dst_port, user_port, acknum, seqnum, tstr, 0, f_psh);
-	
+	// ответ собирается из шаблона, дополнительные параметры добавляет шаблон
+	this->sendPacket(dst_ip, user_ip, dst_port, user_port, acknum, seqnum, additional_param, param_length, 0, f_psh);
+
 	// And reset session with server
 	if(_parameters.send_rst_to_server)
-	{
-		std::string empty_str;
-		this->sendPacket(user_ip, dst_ip, user_port, dst_port, seqnum, acknum, empty_str, 1, 0);
-	}
+		this->sendPacket(user_ip, dst_ip, user_port, dst_port, seqnum, acknum, nullptr, 0, 1, 0);
 	return;
 }
 
-void CSender::SendRST(int user_port, int dst_port, Poco::Net::IPAddress &user_ip, Poco::Net::IPAddress &dst_ip, uint32_t acknum, uint32_t seqnum, int f_psh)
+void CSender::SendRST(int user_port, int dst_port, Poco::Net::IPAddress &user_ip, Poco::Net::IPAddress &dst_ip, uint32_t acknum, uint32_t seqnum, int f_psh, uint16_t window)
 {
-	std::string empty_str;
-	// send rst to the client
-	this->sendPacket(dst_ip, user_ip, dst_port, user_port, acknum, seqnum, empty_str, 1, 0);
-	// send rst to the server
-	if(_parameters.send_rst_to_server)
-		this->sendPacket(user_ip, dst_ip, user_port, dst_port, seqnum, acknum, empty_str, 1, 0);
+	// серия rst со сдвигом seq на случай, если клиент уже ушел вперед. Вся серия уходит в одной пачке sendmmsg
+	rstSeries(_parameters.rst_burst, window, _parameters.send_rst_to_server, acknum, seqnum,
+		[&](bool to_client, uint32_t ack, uint32_t seq)
+		{
+			if(to_client)
+				this->sendPacket(dst_ip, user_ip, dst_port, user_port, ack, seq, nullptr, 0, 1, 0);
+			else
+				this->sendPacket(user_ip, dst_ip, user_port, dst_port, seq, ack, nullptr, 0, 1, 0);
+		});
 }
-
@@ -17,46 +17,153 @@
 *
 */
 
+#include <unistd.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <Poco/Exception.h>
+#include <rte_config.h>
+#include <rte_cycles.h>
 #include "sendertask.h"
 
 #include "sender.h"
 
-Poco::NotificationQueue SenderTask::queue;
+SenderWakeup::SenderWakeup():
+	_sleeping(false)
+{
+	_fd=eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if(_fd < 0)
+		throw Poco::Exception("Unable to create eventfd for the sender");
+}
 
-SenderTask::SenderTask(struct CSender::params &prm, int instance):
-	Task("SenderTask"),
-	sender(new CSender(prm)),
-	_logger(Poco::Logger::get("SenderTask"+std::to_string(instance)))
+SenderWakeup::~SenderWakeup()
+{
+	close(_fd);
+}
+
+void SenderWakeup::wait(int timeout)
+{
+	struct pollfd pfd;
+	pfd.fd=_fd;
+	pfd.events=POLLIN;
+	pfd.revents=0;
+	if(::poll(&pfd, 1, timeout) > 0)
+	{
+		uint64_t count;
+		ssize_t r=read(_fd, &count, sizeof(count));
+		(void)r;
+	}
+	_sleeping.store(false, std::memory_order_relaxed);
+}
+
+RingSender::RingSender(struct CSender::params &prm, int instance, const std::vector<SenderRing *> &rings):
+	_sender(new CSender(prm)),
+	_instance(instance),
+	_rings(rings),
+	_latency(rte_get_tsc_hz())
 {
+	_stamps.reserve(SENDER_BATCH * rings.size());
+}
 
+void RingSender::send(const inject_request &req)
+{
+	int length = (req.ip_version == 4) ? 4 : 16;
+	Poco::Net::IPAddress user_ip(req.user_ip, length);
+	Poco::Net::IPAddress dst_ip(req.dst_ip, length);
+	if(req.is_rst)
+	{
+		_sender->SendRST(req.user_port, req.dst_port, user_ip, dst_ip, req.acknum, req.seqnum, req.f_psh, req.window);
+	} else {
+		_sender->Redirect(req.user_port, req.dst_port, user_ip, dst_ip, req.acknum, req.seqnum, req.f_psh, req.param, req.param_length);
+	}
+	_stamps.push_back(req.timestamp);
+}
+
+size_t RingSender::poll()
+{
+	size_t processed = 0;
+	for(auto ring : _rings)
+	{
+		size_t n = ring->readable();
+		if(n > SENDER_BATCH)
+			n = SENDER_BATCH;
+		for(size_t i = 0; i < n; i++)
+			send(ring->at(i));
+		ring->release(n);
+		processed += n;
+	}
+	if(processed)
+	{
+		_sender->flush();
+		// задержка считается до передачи пакетов ядру, tsc синхронен на всех ядрах
+		uint64_t now = rte_rdtsc();
+		for(auto stamp : _stamps)
+			_latency.add(now > stamp ? now - stamp : 0);
+		_stamps.clear();
+	}
+	return processed;
 }
 
+void RingSender::wait(int timeout)
+{
+	_wakeup.prepare();
+	for(auto ring : _rings)
+	{
+		if(ring->readable())
+		{
+			_wakeup.cancel();
+			return;
+		}
+	}
+	_wakeup.wait(timeout);
+}
 
-SenderTask::~SenderTask()
+SenderTask::SenderTask(RingSender *sender):
+	Task("SenderTask"),
+	_sender(sender),
+	_logger(Poco::Logger::get("SenderTask"+std::to_string(sender->instance())))
 {
-	delete sender;
 }
 
 void SenderTask::runTask()
 {
 	_logger.debug("Starting SenderTask...");
 
+	// несколько пустых проходов подряд до сна, чтобы не будить поток на каждом запросе пачки
+	int idle=0;
 	while(!isCancelled())
 	{
-		Poco::Notification::Ptr pNf(queue.waitDequeueNotification());
-		if (pNf)
+		if(_sender->poll())
 		{
-			RedirectNotification::Ptr pRedirectNf = pNf.cast<RedirectNotification>();
-			if (pRedirectNf)
-			{
-				if(pRedirectNf->is_rst())
-					sender->SendRST(pRedirectNf->user_port(), pRedirectNf->dst_port(),pRedirectNf->user_ip(),pRedirectNf->dst_ip(), pRedirectNf->acknum(), pRedirectNf->seqnum(), pRedirectNf->f_psh());
-				else
-					sender->Redirect(pRedirectNf->user_port(), pRedirectNf->dst_port(),pRedirectNf->user_ip(),pRedirectNf->dst_ip(), pRedirectNf->acknum(), pRedirectNf->seqnum(), pRedirectNf->f_psh(), pRedirectNf->additional_param());
-			}
+			idle=0;
+		} else if(++idle < SENDER_IDLE_POLLS) {
+			rte_pause();
+		} else {
+			_sender->wait(SENDER_WAIT_TIMEOUT);
+			idle=0;
 		}
 	}
 
-	_logger.debug("Stopping SenderTask...");
+	_logger.information("Stopping SenderTask, sent %" PRIu64 " packets in %" PRIu64 " system calls", _sender->sender().packets(), _sender->sender().syscalls());
+}
+
+SenderThread::SenderThread(RingSender *sender):
+	_sender(sender),
+	m_Stop(true),
+	_logger(Poco::Logger::get("SenderThread"+std::to_string(sender->instance())))
+{
 }
 
+bool SenderThread::run(uint32_t coreId)
+{
+	setCoreId(coreId);
+	m_Stop = false;
+	_logger.debug("Starting sender thread on core %u", coreId);
+	while(!m_Stop)
+	{
+		if(!_sender->poll())
+			rte_pause();
+	}
+	_logger.information("Stopping sender thread on core %u, sent %" PRIu64 " packets in %" PRIu64 " system calls", coreId, _sender->sender().packets(), _sender->sender().syscalls());
+	return true;
+}
@@ -0,0 +1,245 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <Poco/Exception.h>
+#include "snapshot.h"
+#include "flatac.h"
+#include "dtypes.h"
+#include "ipporttable.h"
+#include "prefixlist.h"
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+uint64_t snapshot_checksum(const void *data, size_t size)
+{
+	const uint8_t *p = (const uint8_t *) data;
+	uint64_t h = 0x27D4EB2F165667C5ULL ^ size;
+	size_t i = 0;
+	for(; i + 8 <= size; i += 8)
+	{
+		uint64_t w;
+		memcpy(&w, p + i, 8);
+		h ^= rotl64(w * 0xC2B2AE3D27D4EB4FULL, 31) * 0x9E3779B97F4A7C15ULL;
+		h = rotl64(h, 27) * 0x9E3779B97F4A7C15ULL + 0x85EBCA77C2B2AE63ULL;
+	}
+	for(; i < size; i++)
+	{
+		h ^= p[i] * 0x27D4EB2F165667C5ULL;
+		h = rotl64(h, 11) * 0x9E3779B97F4A7C15ULL;
+	}
+	h ^= h >> 33;
+	h *= 0xC2B2AE3D27D4EB4FULL;
+	h ^= h >> 29;
+	return h;
+}
+
+static inline uint64_t align_section(uint64_t offset)
+{
+	return (offset + SNAPSHOT_SECTION_ALIGN - 1) & ~((uint64_t) SNAPSHOT_SECTION_ALIGN - 1);
+}
+
+std::string &SnapshotWriter::addSection(uint32_t type)
+{
+	if(_sections.size() >= SNAPSHOT_MAX_SECTIONS)
+		throw Poco::Exception("Too many sections in the snapshot");
+	_sections.push_back(std::make_pair(type, std::string()));
+	return _sections.back().second;
+}
+
+void SnapshotWriter::write(const std::string &path)
+{
+	snapshot_header h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, SNAPSHOT_MAGIC, sizeof(h.magic));
+	h.version = SNAPSHOT_VERSION;
+	h.sections = _sections.size();
+	h.created = time(NULL);
+	uint64_t offset = align_section(sizeof(h));
+	for(size_t i = 0; i < _sections.size(); i++)
+	{
+		h.section[i].type = _sections[i].first;
+		h.section[i].offset = offset;
+		h.section[i].size = _sections[i].second.size();
+		offset = align_section(offset + h.section[i].size);
+	}
+	h.size = offset;
+
+	std::string image(h.size, '\0');
+	for(size_t i = 0; i < _sections.size(); i++)
+		memcpy(&image[h.section[i].offset], _sections[i].second.data(), _sections[i].second.size());
+	h.checksum = snapshot_checksum(image.data() + sizeof(h), image.size() - sizeof(h));
+	memcpy(&image[0], &h, sizeof(h));
+
+	std::string tmp_path(path + ".tmp");
+	int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0)
+		throw Poco::OpenFileException(tmp_path);
+	size_t written = 0;
+	while(written < image.size())
+	{
+		ssize_t r = ::write(fd, image.data() + written, image.size() - written);
+		if(r < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			::close(fd);
+			::unlink(tmp_path.c_str());
+			throw Poco::WriteFileException(tmp_path);
+		}
+		written += r;
+	}
+	if(::fsync(fd) != 0 || ::close(fd) != 0)
+	{
+		::unlink(tmp_path.c_str());
+		throw Poco::WriteFileException(tmp_path);
+	}
+	if(::rename(tmp_path.c_str(), path.c_str()) != 0)
+	{
+		::unlink(tmp_path.c_str());
+		throw Poco::FileException("Unable to rename " + tmp_path + " to " + path);
+	}
+}
+
+Snapshot::Snapshot() :
+	_data(nullptr),
+	_size(0)
+{
+}
+
+Snapshot::~Snapshot()
+{
+	if(_data)
+		munmap(_data, _size);
+}
+
+std::shared_ptr<Snapshot> Snapshot::open(const std::string &path)
+{
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if(fd < 0)
+		throw Poco::OpenFileException(path);
+	struct stat st;
+	if(fstat(fd, &st) != 0)
+	{
+		::close(fd);
+		throw Poco::FileException("Unable to stat " + path);
+	}
+	if((size_t) st.st_size < sizeof(snapshot_header))
+	{
+		::close(fd);
+		throw Poco::DataFormatException("Snapshot " + path + " is too short");
+	}
+	// страницы подгружаются сразу, чтобы worker'ы не получали page fault при поиске
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+	::close(fd);
+	if(data == MAP_FAILED)
+		throw Poco::FileException("Unable to mmap " + path);
+	std::shared_ptr<Snapshot> snapshot(new Snapshot());
+	snapshot->_data = data;
+	snapshot->_size = st.st_size;
+
+	const snapshot_header *h = snapshot->header();
+	if(memcmp(h->magic, SNAPSHOT_MAGIC, sizeof(h->magic)) != 0)
+		throw Poco::DataFormatException("Bad magic in the snapshot " + path);
+	if(h->version != SNAPSHOT_VERSION)
+		throw Poco::DataFormatException("Unsupported version " + std::to_string(h->version) + " of the snapshot " + path);
+	if(h->size != snapshot->_size || h->sections > SNAPSHOT_MAX_SECTIONS)
+		throw Poco::DataFormatException("Bad header of the snapshot " + path);
+	for(uint32_t i = 0; i < h->sections; i++)
+	{
+		const snapshot_section &s = h->section[i];
+		if(s.offset % SNAPSHOT_SECTION_ALIGN || s.offset < sizeof(snapshot_header) || s.offset > h->size || s.size > h->size - s.offset)
+			throw Poco::DataFormatException("Bad section in the snapshot " + path);
+	}
+	uint64_t checksum = snapshot_checksum((const uint8_t *) data + sizeof(snapshot_header), snapshot->_size - sizeof(snapshot_header));
+	if(checksum != h->checksum)
+		throw Poco::DataFormatException("Checksum mismatch in the snapshot " + path);
+	return snapshot;
+}
+
+bool Snapshot::has(uint32_t type) const
+{
+	const snapshot_header *h = header();
+	for(uint32_t i = 0; i < h->sections; i++)
+	{
+		if(h->section[i].type == type)
+			return true;
+	}
+	return false;
+}
+
+const void *Snapshot::section(uint32_t type, size_t &size) const
+{
+	const snapshot_header *h = header();
+	for(uint32_t i = 0; i < h->sections; i++)
+	{
+		if(h->section[i].type == type)
+		{
+			size = h->section[i].size;
+			return (const uint8_t *) _data + h->section[i].offset;
+		}
+	}
+	throw Poco::NotFoundException("Section " + std::to_string(type) + " not found in the snapshot");
+}
+
+uint64_t Snapshot::sectionChecksum(uint32_t type) const
+{
+	if(!has(type))
+		return 0;
+	size_t size;
+	const void *data = section(type, size);
+	return snapshot_checksum(data, size);
+}
+
+FlatAC *Snapshot::automaton(uint32_t type)
+{
+	size_t size;
+	const void *data = section(type, size);
+	return FlatAC::fromImage(data, size, shared_from_this());
+}
+
+EntriesData *Snapshot::entries(uint32_t type)
+{
+	size_t size;
+	const void *data = section(type, size);
+	return EntriesData::fromImage(data, size, shared_from_this());
+}
+
+IPPortTable *Snapshot::ipPortTable(uint32_t type)
+{
+	size_t size;
+	const void *data = section(type, size);
+	return IPPortTable::fromImage(data, size, shared_from_this());
+}
+
+void Snapshot::prefixes(uint32_t type, IPPrefixList &list) const
+{
+	size_t size;
+	const void *data = section(type, size);
+	list.deserialize(data, size);
+}
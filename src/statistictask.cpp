@@ -25,20 +25,24 @@
 #include <Poco/FileStream.h>
 #include <rte_config.h>
 #include <rte_common.h>
+#include <rte_cycles.h>
 #include <rte_ethdev.h>
 
 #include "statistictask.h"
 #include "stats.h"
 #include "worker.h"
+#include "learnedtable.h"
+#include "sendertask.h"
 
 static struct timeval begin_time;
 
 static std::map<int,uint64_t> map_last_pkts;
 
-StatisticTask::StatisticTask(int sec, std::vector<DpdkWorkerThread*> &workerThreadVector, std::string &statisticsFile):
+StatisticTask::StatisticTask(int sec, std::vector<DpdkWorkerThread*> &workerThreadVector, const std::vector<RingSender*> &senders, std::string &statisticsFile):
 	Task("StatisticTask"),
 	_sec(sec),
 	workerThreadVec(workerThreadVector),
+	_senders(senders),
 	_statisticsFile(statisticsFile)
 {
 }
@@ -114,6 +118,34 @@ void StatisticTask::OutStatistic()
 	uint64_t ipv4_short_packets=0;
 	uint64_t ndpi_ipv6_flows_count=0;
 	uint64_t ndpi_ipv4_flows_count=0;
+	uint64_t url_index_lookups=0;
+	uint64_t url_index_hits=0;
+	uint64_t url_index_probes=0;
+	uint64_t verdict_cache_lookups=0;
+	uint64_t verdict_cache_hits=0;
+	uint64_t learned_lookups=0;
+	uint64_t learned_hits=0;
+	uint64_t learned_inserts=0;
+	const LearnedTable *learned=nullptr;
+	uint64_t injected_packets=0;
+	uint64_t inject_drops=0;
+	bool inject=false;
+	uint64_t sender_ring_depth=0;
+	uint64_t sender_ring_drops=0;
+	bool sender_rings=false;
+	uint64_t inject_duplicates=0;
+	uint64_t inject_rate_limited=0;
+	uint64_t bridge_forwarded=0;
+	uint64_t bridge_dropped=0;
+	uint64_t bridge_tx_dropped=0;
+	bool bridge=false;
+	uint64_t captured_packets=0;
+	uint64_t capture_rate_limited=0;
+	uint64_t capture_ring_drops=0;
+	bool capture=false;
+	uint64_t block_events=0;
+	uint64_t block_log_drops=0;
+	bool block_log=false;
 
 	Poco::FileOutputStream os;
 	if(!_statisticsFile.empty())
@@ -159,12 +191,74 @@ void StatisticTask::OutStatistic()
 			ipv4_short_packets += stats.ipv4_short_packets;
 			ndpi_ipv6_flows_count += stats.ndpi_ipv6_flows_count;
 			ndpi_ipv4_flows_count += stats.ndpi_ipv4_flows_count;
+			url_index_lookups += stats.url_index_lookups;
+			url_index_hits += stats.url_index_hits;
+			url_index_probes += stats.url_index_probes;
+			verdict_cache_lookups += stats.verdict_cache_lookups;
+			verdict_cache_hits += stats.verdict_cache_hits;
+			learned_lookups += stats.learned_lookups;
+			learned_hits += stats.learned_hits;
+			learned_inserts += stats.learned_inserts;
+			inject_duplicates += stats.inject_duplicates;
+			inject_rate_limited += stats.inject_rate_limited;
+			learned=(static_cast<WorkerThread*>(*it))->getConfig().learned;
+			const PacketInjector *injector=(static_cast<WorkerThread*>(*it))->getConfig().injector;
+			if(injector)
+			{
+				inject=true;
+				injected_packets += injector->sent();
+				inject_drops += injector->dropped();
+				app.logger().information("Thread injected packets: %" PRIu64 ", dropped: %" PRIu64, injector->sent(), injector->dropped());
+				const LatencyHistogram &latency=injector->latency();
+				if(latency.count())
+					app.logger().information("Thread packet to injection latency: requests: %" PRIu64 ", p50 < %" PRIu64 " us, p99 < %" PRIu64 " us, p99.9 < %" PRIu64 " us", latency.count(), latency.percentile(50), latency.percentile(99), latency.percentile(99.9));
+			}
+			const BridgeForwarder *forwarder=(static_cast<WorkerThread*>(*it))->getConfig().bridge;
+			if(forwarder)
+			{
+				bridge=true;
+				bridge_forwarded += forwarder->forwarded();
+				bridge_dropped += stats.bridge_dropped;
+				bridge_tx_dropped += forwarder->dropped();
+				app.logger().information("Thread bridge forwarded packets: %" PRIu64 ", dropped blocked packets: %" PRIu64 ", tx dropped: %" PRIu64, forwarder->forwarded(), stats.bridge_dropped, forwarder->dropped());
+			}
+			const SenderRing *ring=(static_cast<WorkerThread*>(*it))->getConfig().senderRing;
+			if(ring)
+			{
+				sender_rings=true;
+				sender_ring_depth += ring->depth();
+				sender_ring_drops += ring->drops();
+				app.logger().information("Thread sender ring depth: %z of %z, dropped requests: %" PRIu64, ring->depth(), ring->size(), ring->drops());
+			}
+			const CaptureRing *capture_ring=(static_cast<WorkerThread*>(*it))->getConfig().captureRing;
+			if(capture_ring)
+			{
+				capture=true;
+				captured_packets += stats.captured_packets;
+				capture_rate_limited += stats.capture_rate_limited;
+				capture_ring_drops += capture_ring->drops();
+				app.logger().information("Thread captured packets: %" PRIu64 ", over the rate limit: %" PRIu64 ", capture ring drops: %" PRIu64, stats.captured_packets, stats.capture_rate_limited, capture_ring->drops());
+			}
+			const BlockEventRing *block_ring=(static_cast<WorkerThread*>(*it))->getConfig().blockLog;
+			if(block_ring)
+			{
+				block_log=true;
+				block_events += stats.block_events;
+				block_log_drops += block_ring->drops();
+				app.logger().information("Thread block events: %" PRIu64 ", block log ring drops: %" PRIu64, stats.block_events, block_ring->drops());
+			}
 
 			app.logger().information("Thread seen packets: %" PRIu64 ", IP packets: %" PRIu64 " (IPv4 packets: %" PRIu64 ", IPv6 packets: %" PRIu64 "), seen bytes: %" PRIu64 ", Average packet size: %" PRIu32 " bytes, Traffic throughput: %s pps", stats.total_packets, stats.ip_packets, stats.ipv4_packets, stats.ipv6_packets, stats.total_bytes, avg_pkt_size, formatPackets(t));
 			app.logger().information("Thread IPv4 fragments: %" PRIu64 ", IPv6 fragments: %" PRIu64 ", IPv4 short packets: %" PRIu64, stats.ipv4_fragments, stats.ipv6_fragments, stats.ipv4_short_packets);
 			app.logger().information("Thread matched by ip/port: %" PRIu64 ", matched by ssl: %" PRIu64 ", matched by ssl/ip: %" PRIu64 ", matched by domain: %" PRIu64 ", matched by url: %" PRIu64, stats.matched_ip_port, stats.matched_ssl, stats.matched_ssl_ip, stats.matched_domains, stats.matched_urls);
 			app.logger().information("Thread redirected domains: %" PRIu64 ", redirected urls: %" PRIu64 ", rst sended: %" PRIu64, stats.redirected_domains,stats.redirected_urls,stats.sended_rst);
 			app.logger().information("Thread active flows: %" PRIu64 " (IPv4 flows: %" PRIu64 " IPv6 flows: %" PRIu64 "), expired flows: %" PRIu64 ", already detected blocked: %" PRIu64, stats.ndpi_flows_count, stats.ndpi_ipv4_flows_count, stats.ndpi_ipv6_flows_count, stats.ndpi_flows_deleted, stats.already_detected_blocked);
+			if(stats.inject_duplicates || stats.inject_rate_limited)
+				app.logger().information("Thread suppressed duplicate injections: %" PRIu64 ", rate limited injections: %" PRIu64, stats.inject_duplicates, stats.inject_rate_limited);
+			if(stats.url_index_lookups)
+				app.logger().information("Thread url index lookups: %" PRIu64 ", hits: %" PRIu64 ", average probe length: %.2f", stats.url_index_lookups, stats.url_index_hits, (double)stats.url_index_probes/(double)stats.url_index_lookups);
+			if(stats.verdict_cache_lookups)
+				app.logger().information("Thread verdict cache lookups: %" PRIu64 ", hits: %" PRIu64 " (%.2f%%)", stats.verdict_cache_lookups, stats.verdict_cache_hits, (double)stats.verdict_cache_hits*100./(double)stats.verdict_cache_lookups);
 			if(!_statisticsFile.empty())
 			{
 				std::string worker_name("worker.core."+std::to_string(core));
@@ -183,6 +277,50 @@ void StatisticTask::OutStatistic()
 				os << worker_name << ".ipv4_fragments=" << stats.ipv4_fragments << std::endl;
 				os << worker_name << ".ipv6_fragments=" << stats.ipv6_fragments << std::endl;
 				os << worker_name << ".ipv4_short_packets=" << stats.ipv4_short_packets << std::endl;
+				os << worker_name << ".url_index_lookups=" << stats.url_index_lookups << std::endl;
+				os << worker_name << ".url_index_hits=" << stats.url_index_hits << std::endl;
+				os << worker_name << ".url_index_probes=" << stats.url_index_probes << std::endl;
+				os << worker_name << ".verdict_cache_lookups=" << stats.verdict_cache_lookups << std::endl;
+				os << worker_name << ".verdict_cache_hits=" << stats.verdict_cache_hits << std::endl;
+				os << worker_name << ".learned_lookups=" << stats.learned_lookups << std::endl;
+				os << worker_name << ".learned_hits=" << stats.learned_hits << std::endl;
+				os << worker_name << ".learned_inserts=" << stats.learned_inserts << std::endl;
+				os << worker_name << ".inject_duplicates=" << stats.inject_duplicates << std::endl;
+				os << worker_name << ".inject_rate_limited=" << stats.inject_rate_limited << std::endl;
+				if(injector)
+				{
+					const LatencyHistogram &latency=injector->latency();
+					os << worker_name << ".injected_packets=" << injector->sent() << std::endl;
+					os << worker_name << ".inject_drops=" << injector->dropped() << std::endl;
+					os << worker_name << ".inject_requests=" << latency.count() << std::endl;
+					for(int i=0; i < LATENCY_BUCKETS; i++)
+					{
+						if(latency.bucket(i))
+							os << worker_name << ".inject_latency_lt_" << LatencyHistogram::bound(i) << "us=" << latency.bucket(i) << std::endl;
+					}
+				}
+				if(forwarder)
+				{
+					os << worker_name << ".bridge_forwarded=" << forwarder->forwarded() << std::endl;
+					os << worker_name << ".bridge_dropped=" << stats.bridge_dropped << std::endl;
+					os << worker_name << ".bridge_tx_dropped=" << forwarder->dropped() << std::endl;
+				}
+				if(ring)
+				{
+					os << worker_name << ".sender_ring_depth=" << ring->depth() << std::endl;
+					os << worker_name << ".sender_ring_drops=" << ring->drops() << std::endl;
+				}
+				if(capture_ring)
+				{
+					os << worker_name << ".captured_packets=" << stats.captured_packets << std::endl;
+					os << worker_name << ".capture_rate_limited=" << stats.capture_rate_limited << std::endl;
+					os << worker_name << ".capture_ring_drops=" << capture_ring->drops() << std::endl;
+				}
+				if(block_ring)
+				{
+					os << worker_name << ".block_events=" << stats.block_events << std::endl;
+					os << worker_name << ".block_log_drops=" << block_ring->drops() << std::endl;
+				}
 			}
 		}
 		if(dynamic_cast<ReaderThread*>(*it) != nullptr)
@@ -214,6 +352,27 @@ void StatisticTask::OutStatistic()
 				os << worker_name << ".enqueued_packets=" << stats.enqueued_packets << std::endl;
 				os << worker_name << ".missed_packets=" << stats.missed_packets << std::endl;
 			}
+			if(config.bridge)
+			{
+				// в разрыве reader пересылает пакеты, пропущенные без анализа
+				bridge=true;
+				bridge_forwarded += config.bridge->forwarded();
+				bridge_tx_dropped += config.bridge->dropped();
+				rte_eth_stats_get(config.bridge_port, &rteStats);
+				app.logger().information("Port %d input packets: %" PRIu64 ", input errors: %" PRIu64 ", mbuf errors: %" PRIu64, config.bridge_port, rteStats.ipackets, rteStats.ierrors, rteStats.rx_nombuf);
+				app.logger().information("Reader thread on core %d bypassed analysis packets: %" PRIu64 ", forwarded: %" PRIu64 ", tx dropped: %" PRIu64, core, stats.bridge_bypassed, config.bridge->forwarded(), config.bridge->dropped());
+				if(!_statisticsFile.empty())
+				{
+					std::string port_name("port."+std::to_string(config.bridge_port));
+					os << port_name << ".input_packets=" << rteStats.ipackets << std::endl;
+					os << port_name << ".input_errors=" << rteStats.ierrors << std::endl;
+					os << port_name << ".rx_nombuf=" << rteStats.rx_nombuf << std::endl;
+					std::string worker_name("reader.core."+std::to_string(core));
+					os << worker_name << ".bridge_bypassed=" << stats.bridge_bypassed << std::endl;
+					os << worker_name << ".bridge_forwarded=" << config.bridge->forwarded() << std::endl;
+					os << worker_name << ".bridge_tx_dropped=" << config.bridge->dropped() << std::endl;
+				}
+			}
 			r_received_packets += stats.total_packets;
 			r_enqueued_packets += stats.enqueued_packets;
 			r_missed_packets += stats.missed_packets;
@@ -225,6 +384,28 @@ void StatisticTask::OutStatistic()
 	app.logger().information("All worker threads matched by ip/port: %" PRIu64 ", matched by ssl: %" PRIu64 ", matched by ssl/ip: %" PRIu64 ", matched by domain: %" PRIu64 ",  matched by url: %" PRIu64, matched_ip_port, matched_ssl, matched_ssl_ip, matched_domains, matched_urls);
 	app.logger().information("All worker threads redirected domains: %" PRIu64 ", redirected urls: %" PRIu64 ", rst sended: %" PRIu64, redirected_domains, redirected_urls, sended_rst);
 	app.logger().information("All worker threads active flows: %" PRIu64 "(IPv4 flows: %" PRIu64 " IPv6 flows: %" PRIu64 "), expired flows: %" PRIu64, active_flows, ndpi_ipv4_flows_count, ndpi_ipv6_flows_count, deleted_flows);
+	if(url_index_lookups)
+		app.logger().information("All worker threads url index lookups: %" PRIu64 ", hits: %" PRIu64 ", average probe length: %.2f", url_index_lookups, url_index_hits, (double)url_index_probes/(double)url_index_lookups);
+	if(verdict_cache_lookups)
+		app.logger().information("All worker threads verdict cache lookups: %" PRIu64 ", hits: %" PRIu64 " (%.2f%%)", verdict_cache_lookups, verdict_cache_hits, (double)verdict_cache_hits*100./(double)verdict_cache_lookups);
+	if(inject)
+		app.logger().information("All worker threads injected packets: %" PRIu64 ", dropped: %" PRIu64, injected_packets, inject_drops);
+	if(bridge)
+		app.logger().information("All threads bridge forwarded packets: %" PRIu64 ", dropped blocked packets: %" PRIu64 ", tx dropped: %" PRIu64, bridge_forwarded, bridge_dropped, bridge_tx_dropped);
+	if(inject_duplicates || inject_rate_limited)
+		app.logger().information("All worker threads suppressed duplicate injections: %" PRIu64 ", rate limited injections: %" PRIu64, inject_duplicates, inject_rate_limited);
+	if(sender_rings)
+		app.logger().information("All worker threads sender rings depth: %" PRIu64 ", dropped requests: %" PRIu64, sender_ring_depth, sender_ring_drops);
+	if(capture)
+		app.logger().information("All worker threads captured packets: %" PRIu64 ", over the rate limit: %" PRIu64 ", capture ring drops: %" PRIu64, captured_packets, capture_rate_limited, capture_ring_drops);
+	if(block_log)
+		app.logger().information("All worker threads block events: %" PRIu64 ", block log ring drops: %" PRIu64, block_events, block_log_drops);
+	size_t learned_entries=0;
+	if(learned)
+	{
+		learned_entries=learned->occupancy(rte_rdtsc());
+		app.logger().information("All worker threads learned table lookups: %" PRIu64 ", hits: %" PRIu64 ", inserts: %" PRIu64 ", occupancy: %z of %z", learned_lookups, learned_hits, learned_inserts, learned_entries, learned->size());
+	}
 	if(!_statisticsFile.empty())
 	{
 		std::string worker_name("allworkers");
@@ -243,12 +424,73 @@ void StatisticTask::OutStatistic()
 		os << worker_name << ".ipv4_fragments=" << ipv4_fragments << std::endl;
 		os << worker_name << ".ipv6_fragments=" << ipv6_fragments << std::endl;
 		os << worker_name << ".ipv4_short_packets=" << ipv4_short_packets << std::endl;
+		os << worker_name << ".url_index_lookups=" << url_index_lookups << std::endl;
+		os << worker_name << ".url_index_hits=" << url_index_hits << std::endl;
+		os << worker_name << ".url_index_probes=" << url_index_probes << std::endl;
+		os << worker_name << ".verdict_cache_lookups=" << verdict_cache_lookups << std::endl;
+		os << worker_name << ".verdict_cache_hits=" << verdict_cache_hits << std::endl;
+		os << worker_name << ".inject_duplicates=" << inject_duplicates << std::endl;
+		os << worker_name << ".inject_rate_limited=" << inject_rate_limited << std::endl;
+		if(inject)
+		{
+			os << worker_name << ".injected_packets=" << injected_packets << std::endl;
+			os << worker_name << ".inject_drops=" << inject_drops << std::endl;
+		}
+		if(bridge)
+		{
+			os << worker_name << ".bridge_forwarded=" << bridge_forwarded << std::endl;
+			os << worker_name << ".bridge_dropped=" << bridge_dropped << std::endl;
+			os << worker_name << ".bridge_tx_dropped=" << bridge_tx_dropped << std::endl;
+		}
+		if(sender_rings)
+		{
+			os << worker_name << ".sender_ring_depth=" << sender_ring_depth << std::endl;
+			os << worker_name << ".sender_ring_drops=" << sender_ring_drops << std::endl;
+		}
+		if(capture)
+		{
+			os << worker_name << ".captured_packets=" << captured_packets << std::endl;
+			os << worker_name << ".capture_rate_limited=" << capture_rate_limited << std::endl;
+			os << worker_name << ".capture_ring_drops=" << capture_ring_drops << std::endl;
+		}
+		if(block_log)
+		{
+			os << worker_name << ".block_events=" << block_events << std::endl;
+			os << worker_name << ".block_log_drops=" << block_log_drops << std::endl;
+		}
+		if(learned)
+		{
+			os << worker_name << ".learned_lookups=" << learned_lookups << std::endl;
+			os << worker_name << ".learned_hits=" << learned_hits << std::endl;
+			os << worker_name << ".learned_inserts=" << learned_inserts << std::endl;
+			os << worker_name << ".learned_entries=" << learned_entries << std::endl;
+		}
 		
 		worker_name.assign("allreaders");
 		os << worker_name << ".received_packets=" << r_received_packets << std::endl;
 		os << worker_name << ".enqueued_packets=" << r_enqueued_packets << std::endl;
 		os << worker_name << ".missed_packets=" << r_missed_packets << std::endl;
 	}
+	for(auto sender : _senders)
+	{
+		const LatencyHistogram &latency=sender->latency();
+		uint64_t count=latency.count();
+		if(!count)
+			continue;
+		app.logger().information("Sender %d packet to injection latency: requests: %" PRIu64 ", p50 < %" PRIu64 " us, p99 < %" PRIu64 " us, p99.9 < %" PRIu64 " us", sender->instance(), count, latency.percentile(50), latency.percentile(99), latency.percentile(99.9));
+		if(!_statisticsFile.empty())
+		{
+			std::string sender_name("sender."+std::to_string(sender->instance()));
+			os << sender_name << ".requests=" << count << std::endl;
+			os << sender_name << ".packets=" << sender->sender().packets() << std::endl;
+			os << sender_name << ".syscalls=" << sender->sender().syscalls() << std::endl;
+			for(int i=0; i < LATENCY_BUCKETS; i++)
+			{
+				if(latency.bucket(i))
+					os << sender_name << ".latency_lt_" << LatencyHistogram::bound(i) << "us=" << latency.bucket(i) << std::endl;
+			}
+		}
+	}
 	if(!_statisticsFile.empty())
 	{
 		os.close();
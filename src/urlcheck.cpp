@@ -0,0 +1,241 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+
+/*
+ * extfilter-urlcheck: проверка URLNormalizer и замер его скорости.
+ * Без параметров сравнивает результат URLNormalizer с нормализацией через Poco::URI, как она
+ * делалась раньше в worker'е, на наборе url: %xx в разном регистре, сегменты '.' и '..',
+ * url длиннее буфера нормализатора, специальные символы на границах 16-байтных блоков
+ * и случайные url. Возвращает 1, если есть расхождения.
+ * -b <n> - замер тактов на url для URLNormalizer и Poco::URI, n проходов по набору url.
+*/
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdlib.h>
+#include <unistd.h>
+#include <rte_config.h>
+#include <rte_cycles.h>
+#include <Poco/URI.h>
+#include <Poco/Exception.h>
+#include "urlnormalizer.h"
+
+/// Normalization as the worker did it with Poco.
+static std::string reference(const std::string &url, int flags)
+{
+	std::string uri(url);
+	if(flags & URLNormalizer::NORM_PATH)
+	{
+		try
+		{
+			Poco::URI uri_p(url);
+			uri_p.normalize();
+			uri.assign(uri_p.toString());
+		} catch (Poco::SyntaxException &)
+		{
+			uri.assign(url);
+			flags &= URLNormalizer::NORM_STRIP_DOT;
+		}
+	}
+	size_t host_start = uri.find("://");
+	host_start = (host_start == std::string::npos) ? 0 : host_start + 3;
+	size_t host_end = uri.find_first_of("/?#", host_start);
+	if(host_end == std::string::npos)
+		host_end = uri.length();
+	if(!(flags & URLNormalizer::NORM_PATH) && (flags & URLNormalizer::NORM_LOWER_HOST))
+		std::transform(uri.begin() + host_start, uri.begin() + host_end, uri.begin() + host_start, ::tolower);
+	if((flags & URLNormalizer::NORM_STRIP_DOT) && host_end < uri.length() && uri[host_end] == '/' && host_end > host_start && uri[host_end-1] == '.')
+		uri.erase(host_end - 1, 1);
+	return uri;
+}
+
+static void addCorpus(std::vector<std::string> &corpus)
+{
+	static const char *urls[] = {
+		"http://example.com/",
+		"http://example.com",
+		"http://EXAMPLE.com/Path/To/File.html",
+		"HTTP://Example.COM:80/a",
+		"http://example.com:8080/a",
+		"https://example.com:443/a",
+		"http://example.com./a",
+		"http://example.com.:80/a",
+		"http://example.com/%41%42%43",
+		"http://example.com/%61%62%63",
+		"http://example.com/%2f%2F",
+		"http://example.com/%7e%7E~",
+		"http://example.com/%e2%82%ac",
+		"http://example.com/%E2%82%AC",
+		"http://example.com/%zz",
+		"http://example.com/%4",
+		"http://example.com/%",
+		"http://example.com/a/./b",
+		"http://example.com/a/../b",
+		"http://example.com/../a",
+		"http://example.com/a/b/..",
+		"http://example.com/a/b/../",
+		"http://example.com/a/.b/..c/...",
+		"http://example.com//a//b//",
+		"http://example.com/./",
+		"http://example.com/a?",
+		"http://example.com/a?#x",
+		"http://example.com/a?b=%41&c=/../d",
+		"http://example.com/a#frag/../x",
+		"http://example.com/a b<c>d{e}f|g\\h\"i^j`k",
+		"http://example.com/!*'()$,[]",
+		"http://example.com/\x7f\x80\xff",
+		"http://example.com/a;b=c/d@e:f",
+		"http://[::1]:80/a",
+		"http://user@example.com/a",
+	};
+	for(auto u : urls)
+		corpus.push_back(u);
+
+	// специальные символы на границах 16-байтных блоков пути
+	static const char *specials[] = { "%41", "%2f", "/./", "/../", "//", "?", "?#", "#", " ", "\x80", "{", "." };
+	for(auto sp : specials)
+	{
+		for(size_t k = 0; k < 40; k++)
+		{
+			corpus.push_back("http://example.com/" + std::string(k, 'a') + sp + "b");
+			corpus.push_back("http://example.com/" + std::string(k, 'a') + sp);
+		}
+	}
+
+	// url около размера буфера нормализатора и длиннее него
+	for(size_t k = URL_NORMALIZER_BUFFER_SIZE - 40; k < URL_NORMALIZER_BUFFER_SIZE + 8; k++)
+	{
+		corpus.push_back("http://example.com/" + std::string(k, 'a'));
+		corpus.push_back("http://Example.COM/" + std::string(k, 'a'));
+		corpus.push_back("http://example.com./" + std::string(k, 'a') + "/../b");
+		corpus.push_back("http://example.com/" + std::string(k / 3, 'a') + std::string(k / 3, '{'));
+	}
+	corpus.push_back("http://EXAMPLE.COM/" + std::string(3 * URL_NORMALIZER_BUFFER_SIZE, 'a') + "/./%41");
+
+	// случайные url из символов, требующих обработки
+	static const char alphabet[] = "aZ09./%2fF?#~-_ {\x80:";
+	srand(1);
+	for(int n = 0; n < 100000; n++)
+	{
+		std::string u(rand() % 2 ? "http://Example.com" : "http://example.com.");
+		if(rand() % 4 == 0)
+			u += ":80";
+		u += '/';
+		size_t len = rand() % 64;
+		for(size_t i = 0; i < len; i++)
+			u += alphabet[rand() % (sizeof(alphabet) - 1)];
+		corpus.push_back(u);
+	}
+}
+
+static int check(const std::vector<std::string> &corpus)
+{
+	static const int modes[] = {
+		URLNormalizer::NORM_URI,
+		URLNormalizer::NORM_URI | URLNormalizer::NORM_STRIP_DOT,
+		URLNormalizer::NORM_URI | URLNormalizer::NORM_FAST,
+		URLNormalizer::NORM_URI | URLNormalizer::NORM_FAST | URLNormalizer::NORM_STRIP_DOT,
+		URLNormalizer::NORM_LOWER_HOST,
+		URLNormalizer::NORM_LOWER_HOST | URLNormalizer::NORM_STRIP_DOT,
+		URLNormalizer::NORM_STRIP_DOT
+	};
+	URLNormalizer normalizer;
+	size_t failed = 0;
+	for(auto &url : corpus)
+	{
+		for(auto flags : modes)
+		{
+			std::string expected = reference(url, flags);
+			normalizer.normalize(url.data(), url.length(), flags);
+			std::string result(normalizer.data(), normalizer.length());
+			if(result != expected)
+			{
+				if(failed++ < 20)
+					std::cerr << "Mismatch, flags " << flags << ":" << std::endl << "  url:      " << url << std::endl << "  expected: " << expected << std::endl << "  result:   " << result << std::endl;
+			}
+		}
+	}
+	std::cout << "Checked " << corpus.size() << " urls, mismatches: " << failed << std::endl;
+	return failed ? 1 : 0;
+}
+
+static void benchmark(int iterations)
+{
+	std::vector<std::string> corpus = {
+		"http://example.com/",
+		"http://www.example.com/news/2017/01/01/article.html",
+		"http://cdn.example.com/static/js/app.min.js?v=1234567890",
+		"http://WWW.Example.COM/Index.html",
+		"http://example.com/search?q=%D0%BF%D1%80%D0%B8%D0%B2%D0%B5%D1%82",
+		"http://example.com/a/../b/./c/%7Euser/",
+		"http://example.com./download/file.zip",
+	};
+	URLNormalizer normalizer;
+	size_t sum = 0;
+	uint64_t start = rte_rdtsc();
+	for(int i = 0; i < iterations; i++)
+	{
+		for(auto &url : corpus)
+		{
+			normalizer.normalize(url.data(), url.length(), URLNormalizer::NORM_URI | URLNormalizer::NORM_FAST | URLNormalizer::NORM_STRIP_DOT);
+			sum += normalizer.length();
+		}
+	}
+	uint64_t normalizer_cycles = rte_rdtsc() - start;
+	start = rte_rdtsc();
+	for(int i = 0; i < iterations; i++)
+	{
+		for(auto &url : corpus)
+			sum += reference(url, URLNormalizer::NORM_URI | URLNormalizer::NORM_STRIP_DOT).length();
+	}
+	uint64_t poco_cycles = rte_rdtsc() - start;
+	uint64_t urls = (uint64_t) iterations * corpus.size();
+	std::cout << "URLNormalizer: " << normalizer_cycles / urls << " cycles per url" << std::endl;
+	std::cout << "Poco::URI: " << poco_cycles / urls << " cycles per url" << std::endl;
+	std::cout << "(" << sum << ")" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+	int iterations = 0;
+	int opt;
+	while((opt = getopt(argc, argv, "b:")) != -1)
+	{
+		switch(opt)
+		{
+			case 'b':
+				iterations = atoi(optarg);
+				break;
+			default:
+				std::cerr << "Usage: " << argv[0] << " [-b iterations]" << std::endl;
+				return 2;
+		}
+	}
+	if(iterations > 0)
+	{
+		benchmark(iterations);
+		return 0;
+	}
+	std::vector<std::string> corpus;
+	addCorpus(corpus);
+	return check(corpus);
+}
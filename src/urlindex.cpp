@@ -0,0 +1,229 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#include <string.h>
+#include <algorithm>
+#include "urlindex.h"
+
+#define URLINDEX_EMPTY_HOST 0xffffffff
+#define URLINDEX_MIN_HOSTS 16
+
+static inline uint64_t align_pow2(uint64_t v)
+{
+	uint64_t r = 1;
+	while(r < v)
+		r <<= 1;
+	return r;
+}
+
+URLIndex::URLIndex() :
+	_hosts_mask(0),
+	_urls_count(0),
+	_hosts_count(0),
+	_finalized(false)
+{
+}
+
+URLIndex::~URLIndex()
+{
+}
+
+URLIndex::EnumInsertStatus URLIndex::insert(const std::string &url, uint32_t id)
+{
+	if(_finalized)
+		return INSERT_CLOSED;
+	if(url.empty())
+		return INSERT_EMPTY;
+	pending_url p;
+	hash(url.c_str(), url.length(), p.host_hash, p.url_hash);
+	auto range = _pending_hashes.equal_range(p.url_hash);
+	for(auto it = range.first; it != range.second; it++)
+	{
+		pending_url &o = _pending[it->second];
+		if(o.length == url.length() && memcmp(&_pool[o.offset], url.c_str(), o.length) == 0)
+			return INSERT_DUPLICATE;
+	}
+	p.offset = _pool.size();
+	p.length = url.length();
+	p.id = id;
+	_pool.insert(_pool.end(), url.begin(), url.end());
+	_pending_hashes.insert(std::make_pair(p.url_hash, (uint32_t)_pending.size()));
+	_pending.push_back(p);
+	return INSERT_SUCCESS;
+}
+
+void URLIndex::finalize()
+{
+	if(_finalized)
+		return;
+	_finalized = true;
+	_pending_hashes.clear();
+	std::stable_sort(_pending.begin(), _pending.end(), [](const pending_url &a, const pending_url &b) { return a.host_hash < b.host_hash; });
+
+	size_t hosts = 0;
+	for(size_t i = 0; i < _pending.size(); i++)
+	{
+		if(i == 0 || _pending[i].host_hash != _pending[i-1].host_hash)
+			hosts++;
+	}
+
+	_hosts.clear();
+	_hosts.resize(align_pow2(std::max<uint64_t>(hosts * 2, URLINDEX_MIN_HOSTS)));
+	for(auto &h : _hosts)
+	{
+		h.hash = 0;
+		h.first = URLINDEX_EMPTY_HOST;
+		h.mask = 0;
+	}
+	_hosts_mask = _hosts.size() - 1;
+	_urls.clear();
+
+	size_t begin = 0;
+	while(begin < _pending.size())
+	{
+		size_t end = begin;
+		while(end < _pending.size() && _pending[end].host_hash == _pending[begin].host_hash)
+			end++;
+		uint32_t size = align_pow2((end - begin) * 2);
+		uint32_t first = _urls.size();
+		_urls.resize(_urls.size() + size);
+		for(size_t i = first; i < _urls.size(); i++)
+		{
+			_urls[i].hash = 0;
+			_urls[i].offset = 0;
+			_urls[i].length = 0;
+			_urls[i].id = 0;
+		}
+		for(size_t i = begin; i < end; i++)
+		{
+			uint32_t j = _pending[i].url_hash & (size - 1);
+			while(_urls[first + j].length != 0)
+				j = (j + 1) & (size - 1);
+			url_slot &u = _urls[first + j];
+			u.hash = _pending[i].url_hash;
+			u.offset = _pending[i].offset;
+			u.length = _pending[i].length;
+			u.id = _pending[i].id;
+		}
+		uint64_t k = _pending[begin].host_hash & _hosts_mask;
+		while(_hosts[k].first != URLINDEX_EMPTY_HOST)
+			k = (k + 1) & _hosts_mask;
+		_hosts[k].hash = _pending[begin].host_hash;
+		_hosts[k].first = first;
+		_hosts[k].mask = size - 1;
+		begin = end;
+	}
+	_urls_count = _pending.size();
+	_hosts_count = hosts;
+	std::vector<pending_url>().swap(_pending);
+}
+
+const URLIndex::host_slot *URLIndex::findHost(uint64_t host_hash, uint32_t &probes) const
+{
+	uint64_t k = host_hash & _hosts_mask;
+	while(true)
+	{
+		probes++;
+		const host_slot &h = _hosts[k];
+		if(h.first == URLINDEX_EMPTY_HOST)
+			return nullptr;
+		if(h.hash == host_hash)
+			return &h;
+		k = (k + 1) & _hosts_mask;
+	}
+	return nullptr;
+}
+
+bool URLIndex::find(const char *url, size_t length, uint32_t &id, uint32_t &probes) const
+{
+	probes = 0;
+	if(!_finalized || _urls_count == 0)
+		return false;
+	uint64_t host_hash, url_hash;
+	hash(url, length, host_hash, url_hash);
+	const host_slot *h = findHost(host_hash, probes);
+	if(h == nullptr)
+		return false;
+	uint32_t j = url_hash & h->mask;
+	while(true)
+	{
+		probes++;
+		const url_slot &u = _urls[h->first + j];
+		if(u.length == 0)
+			return false;
+		if(u.hash == url_hash && u.length == length && memcmp(&_pool[u.offset], url, length) == 0)
+		{
+			id = u.id;
+			return true;
+		}
+		j = (j + 1) & h->mask;
+	}
+	return false;
+}
+
+bool URLIndex::hasHost(const char *host, size_t length) const
+{
+	if(!_finalized || _urls_count == 0)
+		return false;
+	uint64_t host_hash, url_hash;
+	hash(host, length, host_hash, url_hash);
+	uint32_t probes = 0;
+	return findHost(host_hash, probes) != nullptr;
+}
+
+void URLHosts::insert(const std::string &url)
+{
+	size_t slash = url.find('/');
+	if(slash == 0 || slash == std::string::npos)
+	{
+		_any = true;
+		return;
+	}
+	uint64_t host_hash, url_hash;
+	URLIndex::hash(url.c_str(), slash, host_hash, url_hash);
+	_hashes.push_back(host_hash);
+}
+
+void URLHosts::finalize()
+{
+	std::sort(_hashes.begin(), _hashes.end());
+	_hashes.erase(std::unique(_hashes.begin(), _hashes.end()), _hashes.end());
+	_hashes.shrink_to_fit();
+}
+
+bool URLHosts::match(const char *host, size_t length) const
+{
+	if(_any)
+		return true;
+	if(_hashes.empty())
+		return false;
+	size_t i = 0;
+	while(true)
+	{
+		uint64_t host_hash, url_hash;
+		URLIndex::hash(host + i, length - i, host_hash, url_hash);
+		if(std::binary_search(_hashes.begin(), _hashes.end(), host_hash))
+			return true;
+		const char *dot = (const char *) memchr(host + i, '.', length - i);
+		if(dot == nullptr)
+			return false;
+		i = dot - host + 1;
+	}
+	return false;
+}
@@ -0,0 +1,120 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+
+
+/*
+ * extfilter-urlindexcheck: индекс url для match_url_exactly.
+ * - каждый добавленный url находится со своим id, отличающиеся на символ, префиксы и продолжения - нет;
+ * - повторы, пустые url и добавление после finalize() отвергаются;
+ * - hasHost(), size() и hostsCount() на большом наборе хостов.
+ * Возвращает 1, если хотя бы одна проверка не прошла.
+*/
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <random>
+#include <string.h>
+#include "urlindex.h"
+#include "check.h"
+
+static std::string randomText(std::mt19937 &rng, const char *alphabet, size_t min_length, size_t max_length)
+{
+	size_t length = min_length + rng() % (max_length - min_length + 1);
+	std::string text;
+	size_t n = strlen(alphabet);
+	for(size_t i = 0; i < length; i++)
+		text += alphabet[rng() % n];
+	return text;
+}
+
+static void checkIndex()
+{
+	std::mt19937 rng(3);
+	std::vector<std::string> hosts;
+	std::set<std::string> unique_hosts;
+	while(unique_hosts.size() < 2000)
+		unique_hosts.insert(randomText(rng, "abcdefgh", 1, 6) + ".ru");
+	hosts.assign(unique_hosts.begin(), unique_hosts.end());
+
+	// у части хостов много url, чтобы подтаблицы были разного размера
+	std::map<std::string, uint32_t> urls;
+	uint32_t id = 1;
+	for(size_t i = 0; i < hosts.size(); i++)
+	{
+		size_t count = (i % 100 == 0) ? 500 : 1 + rng() % 5;
+		for(size_t j = 0; j < count; j++)
+			urls.insert(std::make_pair(hosts[i] + "/" + randomText(rng, "abc/?=.%", 0, 20), id++));
+	}
+
+	URLIndex index;
+	size_t inserted = 0;
+	for(auto &u : urls)
+	{
+		if(index.insert(u.first, u.second) == URLIndex::INSERT_SUCCESS)
+			inserted++;
+	}
+	expect(inserted == urls.size(), "URLIndex inserts all unique urls");
+	expect(index.insert(urls.begin()->first, 0) == URLIndex::INSERT_DUPLICATE, "URLIndex rejects the duplicate url");
+	expect(index.insert("", 0) == URLIndex::INSERT_EMPTY, "URLIndex rejects the empty url");
+	uint32_t found_id = 0, probes = 0;
+	expect(!index.find(urls.begin()->first.data(), urls.begin()->first.length(), found_id, probes), "URLIndex finds nothing before finalize()");
+	index.finalize();
+	expect(index.insert("late.ru/", 0) == URLIndex::INSERT_CLOSED, "URLIndex is closed after finalize()");
+	expect(index.size() == urls.size(), "URLIndex size");
+	expect(index.hostsCount() == hosts.size(), "URLIndex counts the hosts, " + std::to_string(index.hostsCount()));
+
+	uint64_t total_probes = 0;
+	size_t misses = 0;
+	for(auto &u : urls)
+	{
+		bool found = index.find(u.first.data(), u.first.length(), found_id, probes);
+		expect(found && found_id == u.second, "URLIndex finds '" + u.first + "'");
+		total_probes += probes;
+
+		// изменения, которых нет в индексе
+		std::string longer = u.first + "x";
+		std::string shorter = u.first.substr(0, u.first.length() - 1);
+		std::string changed = u.first;
+		changed[changed.length() - 1] ^= 0x20;
+		for(auto &other : { longer, shorter, changed })
+		{
+			if(urls.count(other))
+				continue;
+			misses++;
+			expect(!index.find(other.data(), other.length(), found_id, probes), "URLIndex does not find '" + other + "'");
+		}
+	}
+	expect(total_probes < urls.size() * 4, "URLIndex probes " + std::to_string(total_probes) + " slots for " + std::to_string(urls.size()) + " urls");
+
+	for(auto &h : hosts)
+		expect(index.hasHost(h.data(), h.length()), "URLIndex has the host " + h);
+	expect(!index.hasHost("unknown.ru", 10), "URLIndex does not have the unknown host");
+	std::string host_only = hosts[0];
+	expect(!index.find(host_only.data(), host_only.length(), found_id, probes), "URLIndex does not find the host without the path");
+	std::cout << "url index: " << urls.size() << " urls of " << hosts.size() << " hosts, " << misses << " misses, " << (double) total_probes / urls.size() << " probes per url" << std::endl;
+}
+
+int main()
+{
+	checkIndex();
+	return checkResult();
+}
@@ -0,0 +1,383 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#include <string.h>
+#include <strings.h>
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include <Poco/URI.h>
+#include <Poco/Exception.h>
+#include "urlnormalizer.h"
+
+/*
+ * Классы символов пути. Символ требует внимания, если lo_class[c & 0x0f] & hi_class[c >> 4] != 0.
+ * Это '%', '.', '/', '?', '#', пробел и управляющие символы, байты >= 0x7f и символы,
+ * которые Poco всегда кодирует: "<>{}|\\\"^`!*'()$,[]".
+*/
+#define C_CTRL	0x01 // 0x00-0x1f, 0x80-0xff
+#define C_2X	0x02 // ' ' '!' '"' '#' '$' '%' '\'' '(' ')' '*' ',' '.' '/'
+#define C_3X	0x04 // '<' '>' '?'
+#define C_5X	0x08 // '[' '\\' ']' '^'
+#define C_6X	0x10 // '`'
+#define C_7X	0x20 // '{' '|' '}' 0x7f
+
+alignas(16) static const uint8_t lo_class[16] = {
+	C_CTRL|C_2X|C_6X, C_CTRL|C_2X, C_CTRL|C_2X, C_CTRL|C_2X,
+	C_CTRL|C_2X, C_CTRL|C_2X, C_CTRL, C_CTRL|C_2X,
+	C_CTRL|C_2X, C_CTRL|C_2X, C_CTRL|C_2X, C_CTRL|C_5X|C_7X,
+	C_CTRL|C_2X|C_3X|C_5X|C_7X, C_CTRL|C_5X|C_7X, C_CTRL|C_2X|C_3X|C_5X, C_CTRL|C_2X|C_3X|C_7X
+};
+
+alignas(16) static const uint8_t hi_class[16] = {
+	C_CTRL, C_CTRL, C_2X, C_3X, 0, C_5X, C_6X, C_7X,
+	C_CTRL, C_CTRL, C_CTRL, C_CTRL, C_CTRL, C_CTRL, C_CTRL, C_CTRL
+};
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+static inline bool is_special(unsigned char c)
+{
+	return (lo_class[c & 0x0f] & hi_class[c >> 4]) != 0;
+}
+
+static inline bool needs_encoding(unsigned char c)
+{
+	return c != '.' && c != '/' && is_special(c);
+}
+
+static inline char to_lower(char c)
+{
+	return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+static inline int hex_value(char c)
+{
+	if(c >= '0' && c <= '9')
+		return c - '0';
+	if(c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if(c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+/// Bitmask of the special bytes in the block p[0..length), length <= 16.
+static inline uint32_t special_mask(const char *p, size_t length)
+{
+#ifdef __SSSE3__
+	if(length == 16)
+	{
+		const __m128i nibble = _mm_set1_epi8(0x0f);
+		__m128i v = _mm_loadu_si128((const __m128i *) p);
+		__m128i lo = _mm_shuffle_epi8(_mm_load_si128((const __m128i *) lo_class), _mm_and_si128(v, nibble));
+		__m128i hi = _mm_shuffle_epi8(_mm_load_si128((const __m128i *) hi_class), _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+		return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) ^ 0xffff;
+	}
+#endif
+	uint32_t mask = 0;
+	for(size_t i = 0; i < length; i++)
+	{
+		if(is_special(p[i]))
+			mask |= 1 << i;
+	}
+	return mask;
+}
+
+static inline bool has_upper(const char *p, size_t length)
+{
+	size_t i = 0;
+#if defined(__SSE2__)
+	const __m128i a = _mm_set1_epi8('A' - 1);
+	const __m128i z = _mm_set1_epi8('Z' + 1);
+	for(; i + 16 <= length; i += 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+		if(_mm_movemask_epi8(_mm_and_si128(_mm_cmpgt_epi8(v, a), _mm_cmplt_epi8(v, z))))
+			return true;
+	}
+#endif
+	for(; i < length; i++)
+	{
+		if(p[i] >= 'A' && p[i] <= 'Z')
+			return true;
+	}
+	return false;
+}
+
+/// '.' or '..' segment starting at i.
+static inline bool is_dot_segment(const char *p, size_t i, size_t length)
+{
+	i++;
+	if(i < length && p[i] == '.')
+		i++;
+	return i == length || p[i] == '/' || p[i] == '?' || p[i] == '#';
+}
+
+static inline bool is_default_port(const char *scheme, size_t scheme_len, const char *port, size_t port_len)
+{
+	if(port_len == 0)
+		return true;
+	if(scheme_len == 4 && strncasecmp(scheme, "http", 4) == 0)
+		return port_len == 2 && memcmp(port, "80", 2) == 0;
+	if(scheme_len == 5 && strncasecmp(scheme, "https", 5) == 0)
+		return port_len == 3 && memcmp(port, "443", 3) == 0;
+	return false;
+}
+
+URLNormalizer::URLNormalizer() :
+	_data(nullptr),
+	_length(0),
+	_host_start(0),
+	_host_end(0),
+	_authority_end(0),
+	_out(0)
+{
+}
+
+bool URLNormalizer::normalize(const char *url, size_t length, int flags)
+{
+	_data = url;
+	_length = length;
+	if(!flags)
+		return false;
+	if((flags & (NORM_PATH | NORM_FAST)) == NORM_PATH)
+		return fallback(url, length, flags);
+	if(!needsWork(url, length, flags))
+		return false;
+	if(length <= URL_NORMALIZER_BUFFER_SIZE && build(url, length, flags))
+	{
+		_data = _buf;
+		_length = _out;
+		return true;
+	}
+	return fallback(url, length, flags);
+}
+
+bool URLNormalizer::fallback(const char *url, size_t length, int flags)
+{
+	_long.assign(url, length);
+	if(flags & NORM_PATH)
+	{
+		try
+		{
+			Poco::URI uri(_long);
+			uri.normalize();
+			_long = uri.toString();
+		} catch (Poco::SyntaxException &)
+		{
+			// оставляем url как есть, но точку после хоста все равно удаляем
+			flags &= NORM_STRIP_DOT;
+		}
+	} else if(flags & NORM_LOWER_HOST)
+	{
+		for(size_t i = _host_start; i < _host_end; i++)
+			_long[i] = to_lower(_long[i]);
+	}
+	if(flags & NORM_STRIP_DOT)
+	{
+		size_t host_start = _long.find("://");
+		host_start = (host_start == std::string::npos) ? 0 : host_start + 3;
+		size_t end = _long.find_first_of("/?#", host_start);
+		if(end != std::string::npos && _long[end] == '/' && end > host_start && _long[end-1] == '.')
+			_long.erase(end - 1, 1);
+	}
+	if(_long.length() == length && memcmp(_long.data(), url, length) == 0)
+		return false;
+	_data = _long.data();
+	_length = _long.length();
+	return true;
+}
+
+bool URLNormalizer::needsWork(const char *url, size_t length, int flags)
+{
+	_host_start = 0;
+	for(size_t i = 0; i + 2 < length && i < 16; i++)
+	{
+		if(url[i] == ':')
+		{
+			if(url[i+1] == '/' && url[i+2] == '/')
+				_host_start = i + 3;
+			break;
+		}
+		if(url[i] == '/')
+			break;
+	}
+	_authority_end = _host_start;
+	while(_authority_end < length && url[_authority_end] != '/' && url[_authority_end] != '?' && url[_authority_end] != '#')
+		_authority_end++;
+	_host_end = _authority_end;
+
+	bool work = false;
+	if(flags & NORM_PATH)
+	{
+		if(has_upper(url, _host_start))
+			work = true;
+		size_t i = _authority_end;
+		while(i > _host_start && url[i-1] >= '0' && url[i-1] <= '9')
+			i--;
+		if(i > _host_start && url[i-1] == ':' && _host_start >= 3 && is_default_port(url, _host_start - 3, url + i, _authority_end - i))
+		{
+			_host_end = i - 1;
+			work = true;
+		}
+	}
+	if(!work && (flags & NORM_LOWER_HOST) && has_upper(url + _host_start, _host_end - _host_start))
+		work = true;
+	if(!work && (flags & NORM_STRIP_DOT) && _authority_end < length && url[_authority_end] == '/' && _host_end > _host_start && url[_host_end-1] == '.')
+		work = true;
+	if(work || !(flags & NORM_PATH))
+		return work;
+
+	for(size_t base = _authority_end; base < length; base += 16)
+	{
+		size_t block = length - base < 16 ? length - base : 16;
+		uint32_t mask = special_mask(url + base, block);
+		while(mask)
+		{
+			size_t i = base + __builtin_ctz(mask);
+			mask &= mask - 1;
+			char c = url[i];
+			if(c == '?' || c == '#')
+			{
+				// пустой запрос Poco отбрасывает
+				return c == '?' && (i + 1 == length || url[i+1] == '#');
+			}
+			if(c == '/')
+			{
+				if(i + 1 < length && url[i+1] == '/')
+					return true;
+			} else if(c == '.')
+			{
+				if(url[i-1] == '/' && is_dot_segment(url, i, length))
+					return true;
+			} else {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+bool URLNormalizer::build(const char *url, size_t length, int flags)
+{
+	_out = 0;
+	for(size_t i = 0; i < _host_start; i++)
+		_buf[_out++] = (flags & NORM_PATH) ? to_lower(url[i]) : url[i];
+	for(size_t i = _host_start; i < _host_end; i++)
+		_buf[_out++] = (flags & NORM_LOWER_HOST) ? to_lower(url[i]) : url[i];
+	if((flags & NORM_STRIP_DOT) && _authority_end < length && url[_authority_end] == '/' && _out > _host_start && _buf[_out-1] == '.')
+		_out--;
+
+	size_t path_end = _authority_end;
+	while(path_end < length && url[path_end] != '?' && url[path_end] != '#')
+		path_end++;
+	if(flags & NORM_PATH)
+	{
+		if(!buildPath(url + _authority_end, path_end - _authority_end))
+			return false;
+	} else {
+		for(size_t i = _authority_end; i < path_end; i++)
+			_buf[_out++] = url[i];
+	}
+
+	size_t i = path_end;
+	if((flags & NORM_PATH) && i < length && url[i] == '?' && (i + 1 == length || url[i+1] == '#'))
+		i++;
+	if(length - i > URL_NORMALIZER_BUFFER_SIZE - _out)
+		return false;
+	memcpy(_buf + _out, url + i, length - i);
+	_out += length - i;
+	return true;
+}
+
+bool URLNormalizer::buildPath(const char *path, size_t length)
+{
+	size_t d = 0;
+	for(size_t i = 0; i < length; i++)
+	{
+		char c = path[i];
+		if(c == '%')
+		{
+			if(i + 2 >= length)
+				return false;
+			int h = hex_value(path[i+1]);
+			int l = hex_value(path[i+2]);
+			if(h < 0 || l < 0)
+				return false;
+			c = (char)((h << 4) | l);
+			i += 2;
+		}
+		_path[d++] = c;
+	}
+	if(d == 0)
+		return true;
+
+	bool leading_slash = _path[0] == '/';
+	bool trailing_slash = _path[d-1] == '/';
+	size_t segments = 0;
+	size_t i = 0;
+	while(i < d)
+	{
+		while(i < d && _path[i] == '/')
+			i++;
+		if(i == d)
+			break;
+		size_t start = i;
+		while(i < d && _path[i] != '/')
+			i++;
+		size_t len = i - start;
+		if(len == 1 && _path[start] == '.')
+			continue;
+		if(len == 2 && _path[start] == '.' && _path[start+1] == '.')
+		{
+			// для абсолютного url ведущие '..' отбрасываются
+			if(segments > 0)
+				segments--;
+			continue;
+		}
+		_seg_offset[segments] = start;
+		_seg_length[segments] = len;
+		segments++;
+	}
+
+	for(size_t k = 0; k < segments; k++)
+	{
+		if((k > 0 || leading_slash) && !put('/'))
+			return false;
+		const char *s = _path + _seg_offset[k];
+		for(size_t j = 0; j < _seg_length[k]; j++)
+		{
+			unsigned char c = s[j];
+			if(needs_encoding(c))
+			{
+				if(!put('%') || !put(hex_digits[c >> 4]) || !put(hex_digits[c & 0x0f]))
+					return false;
+			} else if(!put(c))
+			{
+				return false;
+			}
+		}
+	}
+	if(trailing_slash && !put('/'))
+		return false;
+	return true;
+}
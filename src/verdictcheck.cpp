@@ -0,0 +1,171 @@
+/*
+*
+*    Copyright (C) Max <max1976@mail.ru>
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+
+
+/*
+ * extfilter-verdictcheck: кэш результатов поиска worker'а и хосты url.
+ * - запись кэша действительна только в своем поколении списков, новое поколение делает
+ *   недействительными все записи без очистки, пустая ячейка не находится;
+ * - профиль и тип поиска разделяют ключи одного текста, коллизия ячейки вытесняет запись;
+ * - URLHosts: хост запроса и его родительские домены, шаблоны без хоста.
+ * Возвращает 1, если хотя бы одна проверка не прошла.
+*/
+
+#include <string>
+#include <vector>
+#include <set>
+#include <random>
+#include <string.h>
+#include "verdictcache.h"
+#include "urlindex.h"
+#include "check.h"
+
+static uint64_t key(const std::string &text, VerdictCache::kind kind, unsigned profile)
+{
+	// так же, как ключи worker'а
+	return VerdictCache::hash(text.data(), text.length(), kind | (profile << 8));
+}
+
+static void checkGenerations()
+{
+	VerdictCache cache;
+	uint8_t verdict;
+	uint32_t id;
+	expect(!cache.find(0, 1, verdict, id), "empty slot is not found");
+
+	std::mt19937 rng(7);
+	std::vector<uint64_t> keys;
+	for(int i = 0; i < 1000; i++)
+		keys.push_back(key("host" + std::to_string(rng()) + ".ru", VerdictCache::K_HTTP_HOST, 0));
+
+	uint32_t generation = 1;
+	for(size_t i = 0; i < keys.size(); i++)
+		cache.insert(keys[i], generation, VerdictCache::V_DOMAIN, i);
+	size_t found = 0;
+	bool right = true;
+	for(size_t i = 0; i < keys.size(); i++)
+	{
+		if(cache.find(keys[i], generation, verdict, id))
+		{
+			found++;
+			right &= (verdict == VerdictCache::V_DOMAIN && id == i);
+		}
+	}
+	expect(found > keys.size() * 3 / 4, "most of the verdicts stay in the cache, " + std::to_string(found));
+	expect(right, "cached verdict and id are returned");
+
+	// публикация нового поколения списков
+	generation++;
+	found = 0;
+	for(auto k : keys)
+		found += cache.find(k, generation, verdict, id);
+	expect(found == 0, "new generation invalidates all the verdicts, found " + std::to_string(found));
+	cache.insert(keys[0], generation, VerdictCache::V_NONE, 0);
+	expect(cache.find(keys[0], generation, verdict, id) && verdict == VerdictCache::V_NONE, "verdict of the new generation replaces the old one");
+	expect(!cache.find(keys[0], generation - 1, verdict, id), "verdict of the new generation is not valid in the old one");
+	found = 0;
+	for(size_t i = 1; i < keys.size(); i++)
+		found += cache.find(keys[i], generation, verdict, id);
+	expect(found == 0, "other old verdicts stay invalid");
+
+	// поколение сравнивается целиком, а не по младшим битам
+	cache.insert(keys[1], 0xffffffff, VerdictCache::V_URL, 5);
+	expect(cache.find(keys[1], 0xffffffff, verdict, id) && verdict == VerdictCache::V_URL && id == 5, "last generation is valid");
+	expect(!cache.find(keys[1], 1, verdict, id), "generation is compared exactly");
+}
+
+static void checkKeys()
+{
+	VerdictCache cache;
+	uint8_t verdict;
+	uint32_t id;
+	const std::string host = "example.com";
+	std::set<uint64_t> kinds = {
+		key(host, VerdictCache::K_HTTP, 0),
+		key(host, VerdictCache::K_SSL, 0),
+		key(host, VerdictCache::K_HTTP_HOST, 0),
+		key(host, VerdictCache::K_HTTP_HOST, 1),
+		key(host, VerdictCache::K_HTTP_HOST, 31)
+	};
+	expect(kinds.size() == 5, "kind and profile give different keys to the same text");
+
+	// тексты, отличающиеся длиной или последним байтом, в том числе нулевым
+	std::set<uint64_t> texts;
+	std::mt19937 rng(8);
+	for(int i = 0; i < 20000; i++)
+	{
+		std::string text;
+		size_t length = rng() % 40;
+		for(size_t j = 0; j < length; j++)
+			text += "ab.\0"[rng() % 4];
+		if(!texts.insert(key(text, VerdictCache::K_SSL, 0)).second)
+			continue;
+		std::string zero = text + '\0';
+		expect(key(zero, VerdictCache::K_SSL, 0) != key(text, VerdictCache::K_SSL, 0), "trailing zero byte changes the key");
+	}
+
+	// два ключа одной ячейки: последний вытесняет первый, но не выдается за него
+	uint64_t first = key("first.ru", VerdictCache::K_SSL, 0);
+	uint64_t second = first + VERDICT_CACHE_SIZE;
+	cache.insert(first, 1, VerdictCache::V_SSL, 1);
+	cache.insert(second, 1, VerdictCache::V_NONE, 0);
+	expect(!cache.find(first, 1, verdict, id), "evicted verdict is not found");
+	expect(cache.find(second, 1, verdict, id) && verdict == VerdictCache::V_NONE, "verdict of the colliding key is found");
+}
+
+static bool hostMatch(const URLHosts &hosts, const std::string &host)
+{
+	return hosts.match(host.data(), host.length());
+}
+
+static void checkURLHosts()
+{
+	URLHosts hosts;
+	hosts.insert("site.ru/page");
+	hosts.insert("news.example.com/a/b");
+	hosts.finalize();
+	expect(hosts.size() == 2, "URLHosts keeps the hosts");
+	expect(hostMatch(hosts, "site.ru") && hostMatch(hosts, "news.example.com"), "host of the url pattern matches");
+	expect(hostMatch(hosts, "www.site.ru") && hostMatch(hosts, "a.b.news.example.com"), "subdomains of the url host match");
+	expect(!hostMatch(hosts, "example.com") && !hostMatch(hosts, "othersite.ru") && !hostMatch(hosts, "site.ru.net"), "other hosts do not match");
+
+	URLHosts empty;
+	empty.finalize();
+	expect(!hostMatch(empty, "site.ru"), "no url patterns - no hosts match");
+
+	// шаблон без пути или без хоста может совпасть с url любого хоста
+	URLHosts any;
+	any.insert("site.ru/page");
+	any.insert("/path");
+	any.finalize();
+	expect(hostMatch(any, "unrelated.org"), "url pattern without the host matches every host");
+	URLHosts nopath;
+	nopath.insert("site");
+	nopath.finalize();
+	expect(hostMatch(nopath, "unrelated.org"), "url pattern without the path matches every host");
+}
+
+int main()
+{
+	checkGenerations();
+	checkKeys();
+	checkURLHosts();
+	return checkResult();
+}
@@ -2,7 +2,6 @@
 #include <inttypes.h>
 #include <netinet/in.h>
 #include <Poco/Stopwatch.h>
-#include <Poco/URI.h>
 #include <Poco/Net/IPAddress.h>
 #include <sstream>
 #include <iomanip>
@@ -18,7 +17,6 @@
 
 #include "worker.h"
 #include "main.h"
-#include "sendertask.h"
 #include "flow.h"
 #include "distributor.h"
 #include <rte_hash.h>
@@ -33,7 +31,9 @@ WorkerThread::WorkerThread(const std::string& name, WorkerConfig &workerConfig,
 		_logger(Poco::Logger::get(name)),
 		 m_FlowHash(fh),
 		_distr(distr),
-		_worker_id(worker_id)
+		_worker_id(worker_id),
+		_limiter(workerConfig.inject_rate, workerConfig.inject_burst, extFilter::getTscHz()),
+		_capture_budget(workerConfig.capture_rate, workerConfig.capture_rate / 10 + CAPTURE_SNAPLEN, extFilter::getTscHz())
 {
 	ipv4_flows = (struct ndpi_flow_info **)calloc(fh->getHashSize(),sizeof(struct ndpi_flow_info *));
 	if(ipv4_flows == nullptr)
@@ -55,7 +55,6 @@ WorkerThread::WorkerThread(const std::string& name, WorkerConfig &workerConfig,
 		_logger.fatal("Not enough memory for flows pool. Tried to allocate %d bytes", (int) (fh->getHashSize()*2*sizeof(struct ndpi_flow_info)));
 		throw Poco::Exception("Not enough memory for flows pool");
 	}
-	uri.reserve(URI_RESERVATION_SIZE);
 }
 
 WorkerThread::~WorkerThread()
@@ -198,6 +197,207 @@ ndpi_flow_info *WorkerThread::getFlow(uint8_t *ip_header, int ip_version, uint64
 
 
 
+void WorkerThread::learnBlocked(int ip_version, const void *ip_header, uint16_t port, uint32_t lineno, uint64_t timestamp)
+{
+	if(m_WorkerConfig.learned == nullptr)
+		return;
+	uint32_t generation=m_WorkerConfig.patterns_generation.load(std::memory_order_relaxed);
+	if(ip_version == 4)
+		m_WorkerConfig.learned->insert(&((const struct ipv4_hdr *)ip_header)->dst_addr, 4, port, lineno, generation, timestamp);
+	else
+		m_WorkerConfig.learned->insert(((const struct ipv6_hdr *)ip_header)->dst_addr, 16, port, lineno, generation, timestamp);
+	m_ThreadStats.learned_inserts++;
+}
+
+static std::string addrToString(int ip_version, const void *addr)
+{
+	return Poco::Net::IPAddress(addr, ip_version == 4 ? sizeof(in_addr) : sizeof(in6_addr)).toString();
+}
+
+inject_request *WorkerThread::newRequest(uint64_t timestamp, uint8_t *l3, int ip_version, int src_port, int dst_port, uint32_t acknum, uint32_t seqnum)
+{
+	inject_request *req=m_WorkerConfig.senderRing->reserve();
+	if(req == nullptr)
+		return nullptr;
+	req->timestamp=timestamp;
+	req->ip_version=ip_version;
+	req->user_port=src_port;
+	req->dst_port=dst_port;
+	if(ip_version == 4)
+	{
+		memcpy(req->user_ip, &((struct ipv4_hdr *)l3)->src_addr, 4);
+		memcpy(req->dst_ip, &((struct ipv4_hdr *)l3)->dst_addr, 4);
+	} else {
+		memcpy(req->user_ip, ((struct ipv6_hdr *)l3)->src_addr, 16);
+		memcpy(req->dst_ip, ((struct ipv6_hdr *)l3)->dst_addr, 16);
+	}
+	req->acknum=acknum;
+	req->seqnum=seqnum;
+	req->param_length=0;
+	return req;
+}
+
+bool WorkerThread::injectAllowed(ndpi_flow_info *flow, uint8_t *l3, int ip_version, uint64_t timestamp)
+{
+	// повторы запроса клиентом после уже отправленного ответа
+	if(flow && flow->last_inject && timestamp - flow->last_inject < m_WorkerConfig.inject_dedup_cycles)
+	{
+		m_ThreadStats.inject_duplicates++;
+		return false;
+	}
+	if(m_WorkerConfig.inject_rate)
+	{
+		bool allow;
+		if(ip_version == 4)
+			allow = _limiter.allow(&((struct ipv4_hdr *)l3)->src_addr, 4, timestamp);
+		else
+			allow = _limiter.allow(((struct ipv6_hdr *)l3)->src_addr, 16, timestamp);
+		if(!allow)
+		{
+			m_ThreadStats.inject_rate_limited++;
+			return false;
+		}
+	}
+	if(flow)
+		flow->last_inject = timestamp;
+	return true;
+}
+
+void WorkerThread::capturePacket(struct rte_mbuf *m, uint64_t timestamp)
+{
+	if(m_WorkerConfig.captureRing == nullptr)
+		return;
+	uint32_t caplen=RTE_MIN((uint32_t)rte_pktmbuf_data_len(m), (uint32_t)CAPTURE_SNAPLEN);
+	if(!_capture_budget.take(caplen, timestamp))
+	{
+		m_ThreadStats.capture_rate_limited++;
+		return;
+	}
+	// пакет копируется: mbuf освобождается сразу, медленная запись на диск не держит пул
+	capture_record *rec=m_WorkerConfig.captureRing->reserve();
+	if(rec == nullptr)
+		return;
+	rec->timestamp=timestamp;
+	rec->caplen=caplen;
+	rec->len=rte_pktmbuf_pkt_len(m);
+	memcpy(rec->data, rte_pktmbuf_mtod(m, uint8_t *), caplen);
+	m_WorkerConfig.captureRing->commit();
+	m_ThreadStats.captured_packets++;
+}
+
+void WorkerThread::logBlock(uint64_t timestamp, uint8_t *l3, int ip_version, int src_port, int dst_port, uint8_t profile, uint8_t list, uint32_t lineno, uint8_t action)
+{
+	if(m_WorkerConfig.blockLog == nullptr)
+		return;
+	// без форматирования строк на ядре worker'а, текст получается утилитой extfilter-blocklog
+	block_event *ev=m_WorkerConfig.blockLog->reserve();
+	if(ev == nullptr)
+		return;
+	ev->time=timestamp;
+	if(ip_version == 4)
+	{
+		memcpy(ev->src_ip, &((struct ipv4_hdr *)l3)->src_addr, 4);
+		memcpy(ev->dst_ip, &((struct ipv4_hdr *)l3)->dst_addr, 4);
+	} else {
+		memcpy(ev->src_ip, ((struct ipv6_hdr *)l3)->src_addr, 16);
+		memcpy(ev->dst_ip, ((struct ipv6_hdr *)l3)->dst_addr, 16);
+	}
+	ev->src_port=src_port;
+	ev->dst_port=dst_port;
+	ev->ip_version=ip_version;
+	ev->protocol=IPPROTO_TCP;
+	ev->list=list;
+	ev->action=action;
+	ev->lineno=lineno;
+	ev->profile=profile;
+	ev->worker=_worker_id;
+	m_WorkerConfig.blockLog->commit();
+	m_ThreadStats.block_events++;
+}
+
+void WorkerThread::sendRST(struct rte_mbuf *m, ndpi_flow_info *flow, uint64_t timestamp, uint8_t *l3, int ip_version, int src_port, int dst_port, uint32_t acknum, uint32_t seqnum)
+{
+	if(!injectAllowed(flow, l3, ip_version, timestamp))
+		return;
+	// повторы и ответы сверх лимита не записываются и не расходуют бюджет захвата
+	capturePacket(m, timestamp);
+	if(m_WorkerConfig.injector)
+	{
+		m_WorkerConfig.injector->reset(rte_pktmbuf_mtod(m, uint8_t *), l3, ip_version, acknum, seqnum, timestamp);
+		return;
+	}
+	inject_request *req=newRequest(timestamp, l3, ip_version, src_port, dst_port, acknum, seqnum);
+	if(req == nullptr)
+		return;
+	req->is_rst=1;
+	req->f_psh=0;
+	const struct tcphdr *tcph=(const struct tcphdr *)(l3 + (ip_version == 4 ? (((struct ipv4_hdr *)l3)->version_ihl & IPV4_HDR_IHL_MASK) * IPV4_IHL_MULTIPLIER : sizeof(struct ipv6_hdr)));
+	req->window=rte_be_to_cpu_16(tcph->window);
+	m_WorkerConfig.senderRing->commit();
+	if(m_WorkerConfig.senderWakeup)
+		m_WorkerConfig.senderWakeup->notify();
+}
+
+size_t WorkerThread::redirectParam(const entry_data *entry, char *buf, size_t size) const
+{
+	switch (m_WorkerConfig.add_p_type)
+	{
+		case A_TYPE_ID:
+			{
+				char digits[10];
+				size_t n=0;
+				uint32_t v=entry->lineno;
+				do
+				{
+					digits[n++]='0' + v % 10;
+					v /= 10;
+				} while(v);
+				if(3 + n > size)
+					return 0;
+				memcpy(buf, "id=", 3);
+				for(size_t i=0; i < n; i++)
+					buf[3 + i]=digits[n - 1 - i];
+				return 3 + n;
+			}
+		case A_TYPE_URL:
+			// слишком длинный параметр все равно не поместится в пакет, редирект уйдет без него
+			if(4 + _normalizer.length() > size)
+				return 0;
+			memcpy(buf, "url=", 4);
+			memcpy(buf + 4, _normalizer.data(), _normalizer.length());
+			return 4 + _normalizer.length();
+		default:
+			return 0;
+	}
+}
+
+void WorkerThread::sendRedirect(struct rte_mbuf *m, ndpi_flow_info *flow, uint64_t timestamp, uint8_t *l3, int ip_version, int src_port, int dst_port, uint32_t acknum, uint32_t seqnum, int f_psh, const char *param, size_t param_length)
+{
+	if(!injectAllowed(flow, l3, ip_version, timestamp))
+		return;
+	// повторы и ответы сверх лимита не записываются и не расходуют бюджет захвата
+	capturePacket(m, timestamp);
+	if(m_WorkerConfig.injector)
+	{
+		m_WorkerConfig.injector->redirect(rte_pktmbuf_mtod(m, uint8_t *), l3, ip_version, acknum, seqnum, f_psh, param, param_length, timestamp);
+		return;
+	}
+	inject_request *req=newRequest(timestamp, l3, ip_version, src_port, dst_port, acknum, seqnum);
+	if(req == nullptr)
+		return;
+	req->is_rst=0;
+	req->f_psh=f_psh;
+	req->window=0;
+	if(param_length <= SENDER_PARAM_MAX)
+	{
+		memcpy(req->param, param, param_length);
+		req->param_length=param_length;
+	}
+	m_WorkerConfig.senderRing->commit();
+	if(m_WorkerConfig.senderWakeup)
+		m_WorkerConfig.senderWakeup->notify();
+}
+
 bool WorkerThread::analyzePacket(struct rte_mbuf* m, uint64_t timestamp)
 {
 	struct ether_hdr *eth_hdr;
@@ -216,6 +416,8 @@ bool WorkerThread::analyzePacket(struct rte_mbuf* m, uint64_t timestamp)
 	int ip_version=0;
 	uint32_t ip_len;
 	int iphlen=0;
+	// внешний vlan для выбора профиля списков, тег может быть снят сетевой картой
+	uint16_t vlan=(m->ol_flags & PKT_RX_VLAN_PKT) ? (m->vlan_tci & 0xfff) : PROFILE_NO_VLAN;
 
 	if(ether_type == ETHER_TYPE_VLAN || ether_type == 0x8847)
 	{
@@ -224,6 +426,8 @@ bool WorkerThread::analyzePacket(struct rte_mbuf* m, uint64_t timestamp)
 			if(ether_type == ETHER_TYPE_VLAN)
 			{
 				struct vlan_hdr *vlan_hdr = (struct vlan_hdr *)(l3);
+				if(vlan == PROFILE_NO_VLAN)
+					vlan=rte_be_to_cpu_16(vlan_hdr->vlan_tci) & 0xfff;
 				ether_type = rte_be_to_cpu_16(vlan_hdr->eth_proto);
 				l3 += sizeof(struct vlan_hdr);
 			} else if(ether_type == 0x8847)
@@ -290,6 +494,8 @@ bool WorkerThread::analyzePacket(struct rte_mbuf* m, uint64_t timestamp)
 
 	m_ThreadStats.total_bytes += size;
 
+	uint8_t profile=m_WorkerConfig.profiles ? m_WorkerConfig.profiles->lookup(m->port, vlan) : 0;
+
 	uint8_t *pkt_data_ptr = NULL;
 	struct tcphdr* tcph;
 
@@ -316,46 +522,77 @@ bool WorkerThread::analyzePacket(struct rte_mbuf* m, uint64_t timestamp)
 	int tcp_src_port=rte_be_to_cpu_16(tcph->source);
 	int tcp_dst_port=rte_be_to_cpu_16(tcph->dest);
 
-	std::unique_ptr<Poco::Net::IPAddress> src_ip;
-	std::unique_ptr<Poco::Net::IPAddress> dst_ip;
-	if(ip_version == 4)
-	{
-		src_ip.reset(new Poco::Net::IPAddress(&ipv4_header->src_addr,sizeof(in_addr)));
-		dst_ip.reset(new Poco::Net::IPAddress(&ipv4_header->dst_addr,sizeof(in_addr)));
-	} else {
-		src_ip.reset(new Poco::Net::IPAddress(&ipv6_header->src_addr,sizeof(in6_addr)));
-		dst_ip.reset(new Poco::Net::IPAddress(&ipv6_header->dst_addr,sizeof(in6_addr)));
-	}
+	// адреса в строку переводятся только для отладочного лога
+	const void *src_addr=(ip_version == 4) ? (const void *)&ipv4_header->src_addr : (const void *)ipv6_header->src_addr;
+	const void *dst_addr=(ip_version == 4) ? (const void *)&ipv4_header->dst_addr : (const void *)ipv6_header->dst_addr;
 
 
-	if(m_WorkerConfig.ipportMap && m_WorkerConfig.ipportMapLock.tryLock())
+	/* setting time */
+	uint64_t packet_time = timestamp;
+
+	ndpi_flow_info *flow_info = getFlow(l3, ip_version, timestamp);
+
+	if(m_WorkerConfig.ipPortTable)
 	{
-	
-		if(m_WorkerConfig.ipPortMap->try_search_exact_ip(*dst_ip.get()))
+		// результат поиска кэшируется во flow до следующей перезагрузки списка
+		bool ipport_blocked=false;
+		if(flow_info && flow_info->ipport_generation == m_WorkerConfig.ipport_generation.load(std::memory_order_relaxed))
 		{
-
-			IPPortMap::iterator it_ip=m_WorkerConfig.ipportMap->find(*dst_ip.get());
-			if(it_ip != m_WorkerConfig.ipportMap->end())
+			ipport_blocked=flow_info->ipport_blocked;
+		} else if(m_WorkerConfig.ipportMapLock.tryLock())
+		{
+			uint32_t lpm_value;
+			if(ip_version == 4)
+				ipport_blocked=m_WorkerConfig.ipPortTable->lookup4(ipv4_header->dst_addr, tcp_dst_port) || m_WorkerConfig.ipPortNets->lookup4(rte_be_to_cpu_32(ipv4_header->dst_addr), lpm_value);
+			else
+				ipport_blocked=m_WorkerConfig.ipPortTable->lookup6(ipv6_header->dst_addr, tcp_dst_port) || m_WorkerConfig.ipPortNets->lookup6(ipv6_header->dst_addr, lpm_value);
+			if(flow_info)
 			{
-				unsigned short port=tcp_dst_port;
-				if (it_ip->second.size() == 0 || it_ip->second.find(port) != it_ip->second.end())
-				{
-					m_WorkerConfig.ipportMapLock.unlock();
-					m_ThreadStats.matched_ip_port++;
-					_logger.debug("Found record in ip:port list for the client %s:%d and server %s:%d",src_ip->toString(),tcp_src_port,dst_ip->toString(),tcp_dst_port);
-					std::string empty_str;
-					SenderTask::queue.enqueueNotification(new RedirectNotification(tcp_src_port, tcp_dst_port,src_ip.get(), dst_ip.get(),/*acknum*/ tcph->ack_seq, /*seqnum*/ tcph->seq, 0, empty_str, true));
-					m_ThreadStats.sended_rst++;
-					return true;
-				}
+				flow_info->ipport_blocked=ipport_blocked;
+				flow_info->ipport_generation=m_WorkerConfig.ipport_generation.load(std::memory_order_relaxed);
 			}
+			m_WorkerConfig.ipportMapLock.unlock();
+		}
+		if(ipport_blocked)
+		{
+			m_ThreadStats.matched_ip_port++;
+			if(_logger.debug())
+				_logger.debug("Found record in ip:port list for the client %s:%d and server %s:%d",addrToString(ip_version, src_addr),tcp_src_port,addrToString(ip_version, dst_addr),tcp_dst_port);
+			sendRST(m, flow_info, timestamp, l3, ip_version, tcp_src_port, tcp_dst_port, /*acknum*/ tcph->ack_seq, /*seqnum*/ tcph->seq);
+			m_ThreadStats.sended_rst++;
+			logBlock(timestamp, l3, ip_version, tcp_src_port, tcp_dst_port, profile, B_LIST_IP_PORT, 0, B_ACTION_RST);
+			return true;
 		}
-		m_WorkerConfig.ipportMapLock.unlock();
 	}
-	/* setting time */
-	uint64_t packet_time = timestamp;
 
-	ndpi_flow_info *flow_info = getFlow(l3, ip_version, timestamp);
+	// сервер уже блокировался по SNI или Host, ждать DPI не нужно.
+	// Таблица общая для всех ядер, поэтому сервер ищется один раз на соединение и поколение списков
+	uint32_t lists_generation=m_WorkerConfig.patterns_generation.load(std::memory_order_relaxed);
+	if(m_WorkerConfig.learned && !(flow_info && (flow_info->detection_completed || flow_info->learned_generation == lists_generation)))
+	{
+		uint32_t lineno;
+		bool learned;
+		m_ThreadStats.learned_lookups++;
+		if(ip_version == 4)
+			learned=m_WorkerConfig.learned->lookup(&ipv4_header->dst_addr, 4, tcp_dst_port, lists_generation, timestamp, lineno);
+		else
+			learned=m_WorkerConfig.learned->lookup(ipv6_header->dst_addr, 16, tcp_dst_port, lists_generation, timestamp, lineno);
+		// запоминается только промах: повторы в заблокированное соединение по-прежнему получают rst
+		if(flow_info && !learned)
+			flow_info->learned_generation=lists_generation;
+		if(learned)
+		{
+			m_ThreadStats.learned_hits++;
+			if(_logger.debug())
+				_logger.debug("Server %s:%d is learned as blocked (file line %u), client %s:%d", addrToString(ip_version, dst_addr), tcp_dst_port, lineno, addrToString(ip_version, src_addr), tcp_src_port);
+			sendRST(m, flow_info, timestamp, l3, ip_version, tcp_src_port, tcp_dst_port, /*acknum*/ tcph->ack_seq, /*seqnum*/ tcph->seq);
+			m_ThreadStats.sended_rst++;
+			logBlock(timestamp, l3, ip_version, tcp_src_port, tcp_dst_port, profile, B_LIST_LEARNED, lineno, B_ACTION_RST);
+			if(flow_info)
+				flow_info->block=true;
+			return true;
+		}
+	}
 
 	if(!flow_info)
 	{
@@ -366,6 +603,13 @@ bool WorkerThread::analyzePacket(struct rte_mbuf* m, uint64_t timestamp)
 
 	flow_info->last_seen = timestamp;
 
+	// в разрыве соединение уже не пропускается, повторный анализ не нужен
+	if(m_WorkerConfig.bridge && flow_info->block)
+	{
+		m_ThreadStats.already_detected_blocked++;
+		return true;
+	}
+
 	if(flow_info->detection_completed && flow_info->block == false)
 		return false;
 
@@ -402,59 +646,84 @@ bool WorkerThread::analyzePacket(struct rte_mbuf* m, uint64_t timestamp)
 
 	if(flow_info->detected_protocol.master_protocol == NDPI_PROTOCOL_SSL || flow_info->detected_protocol.protocol == NDPI_PROTOCOL_SSL || flow_info->detected_protocol.protocol == NDPI_PROTOCOL_TOR)
 	{
-		if(m_WorkerConfig.atmSSLDomains && flow_info->ndpi_flow->l4.tcp.ssl_seen_client_cert == 1)
+		if(m_WorkerConfig.patternsDB && flow_info->ndpi_flow->l4.tcp.ssl_seen_client_cert == 1)
 		{
-			std::string ssl_client;
-			if(flow_info->ndpi_flow->protos.ssl.client_certificate[0] != '\0')
-			{
-				ssl_client=flow_info->ndpi_flow->protos.ssl.client_certificate;
-//				_logger.debug("SSL client is: %s",ssl_client);
-			}
-			if(!ssl_client.empty())
+			char *ssl_client=flow_info->ndpi_flow->protos.ssl.client_certificate;
+			if(ssl_client[0] != '\0')
 			{
 				// если не можем выставить lock, то нет смысла продолжать...
-				if(!m_WorkerConfig.atmSSLDomainsLock.tryLock())
+				if(!m_WorkerConfig.atmLock.tryLock())
 					return false;
 #ifdef DEBUG_TIME
 				sw.reset();
 				sw.start();
 #endif
-				if(m_WorkerConfig.lower_host)
-					std::transform(ssl_client.begin(), ssl_client.end(), ssl_client.begin(), ::tolower);
-				AhoCorasickPlus::Match match;
-				std::size_t host_len=ssl_client.length();
+				FlatAC::Cursor cursor;
+				FlatAC::Match match;
+				std::size_t host_len=strlen(ssl_client);
 				bool found=false;
+				const entry_data *entry=nullptr;
+				const PatternDB *db=m_WorkerConfig.patternsDB;
+				// индекс общий с http, url в нем чувствительны к регистру, поэтому регистр имени складывается
+				// только при поиске (lower_host), домены ssl загружены в нижнем регистре. Копия имени не нужна.
+				const char *host=ssl_client;
+				bool fold_case=m_WorkerConfig.lower_host;
+				uint32_t generation=m_WorkerConfig.patterns_generation.load(std::memory_order_relaxed);
+				uint64_t cache_key=VerdictCache::hash(host, host_len, VerdictCache::K_SSL | (profile << 8));
+				uint8_t verdict;
+				uint32_t entry_id=0;
+				m_ThreadStats.verdict_cache_lookups++;
+				if(_verdicts.find(cache_key, generation, verdict, entry_id))
 				{
-					m_WorkerConfig.atmSSLDomains->search(ssl_client,false);
-					while(m_WorkerConfig.atmSSLDomains->findNext(match) && !found)
+					m_ThreadStats.verdict_cache_hits++;
+					if(verdict != VerdictCache::V_NONE)
+					{
+						entry=db->entries->find(entry_id);
+						found=(entry != nullptr);
+					}
+				} else {
+					const FlatAC *automata[2]={ db->base.get(), db->overlay.get() };
+					for(int k=0; k < 2 && !found && automata[k] && (db->entries->flags() & E_FLAGS_SSL); k++)
 					{
-						if(match.pattern.ptext.length != host_len)
+						automata[k]->search(cursor, host, host_len, fold_case);
+						while(!found && automata[k]->findNext(cursor, match))
 						{
-							DomainsMatchType::Iterator it=m_WorkerConfig.SSLdomainsMatchType->find(match.id);
-							bool exact_match=false;
-							if(it != m_WorkerConfig.SSLdomainsMatchType->end())
-								exact_match = it->second;
-							if(exact_match)
+							// шаблоны, удаленные после сборки автомата, отсутствуют в entries
+							entry=db->entries->find(match.id);
+							if(entry == nullptr)
 								continue;
-							if(ssl_client[host_len-match.pattern.ptext.length-1] != '.')
+							uint8_t eflags=db->entries->profileFlags(match.id, profile);
+							if(!(eflags & E_FLAGS_SSL))
 								continue;
+							if(match.length != host_len)
+							{
+								// "*.домен" совпадает с окончанием имени после точки
+								if(!(eflags & E_FLAG_SSL_WILDCARD) || match.position != host_len)
+									continue;
+								if(host[host_len-match.length-1] != '.')
+									continue;
+							}
+							found=true;
+							entry_id=match.id;
 						}
-						found=true;
 					}
+					_verdicts.insert(cache_key, generation, found ? VerdictCache::V_SSL : VerdictCache::V_NONE, entry_id);
 				}
-				m_WorkerConfig.atmSSLDomainsLock.unlock();
+				m_WorkerConfig.atmLock.unlock();
 #ifdef DEBUG_TIME
 				sw.stop();
-				_logger.debug("SSL Host seek occupied %ld us, host: %s",sw.elapsed(),ssl_client);
+				_logger.debug("SSL Host seek occupied %ld us, host: %s",sw.elapsed(),std::string(ssl_client));
 #endif
 				if(found)
 				{
 					m_ThreadStats.matched_ssl++;
-					_logger.debug("SSL host %s present in SSL domain (file line %u) list from ip %s:%d to ip %s:%d", ssl_client, match.id, src_ip->toString(),tcp_src_port,dst_ip->toString(),tcp_dst_port);
-					std::string empty_str;
-					SenderTask::queue.enqueueNotification(new RedirectNotification(tcp_src_port, tcp_dst_port,src_ip.get(), dst_ip.get(), /*acknum*/ tcph->ack_seq, /*seqnum*/ tcph->seq, 0, empty_str, true));
+					if(_logger.debug())
+						_logger.debug("SSL host %s present in SSL domain (file line %u) list from ip %s:%d to ip %s:%d", std::string(ssl_client), entry->lineno, addrToString(ip_version, src_addr),tcp_src_port,addrToString(ip_version, dst_addr),tcp_dst_port);
+					sendRST(m, flow_info, timestamp, l3, ip_version, tcp_src_port, tcp_dst_port, /*acknum*/ tcph->ack_seq, /*seqnum*/ tcph->seq);
 					m_ThreadStats.sended_rst++;
+					logBlock(timestamp, l3, ip_version, tcp_src_port, tcp_dst_port, profile, B_LIST_SSL, entry->lineno, B_ACTION_RST);
 					flow_info->block=true;
+					learnBlocked(ip_version, l3, tcp_dst_port, entry->lineno, timestamp);
 					return true;
 				} else {
 					return false;
@@ -463,14 +732,21 @@ bool WorkerThread::analyzePacket(struct rte_mbuf* m, uint64_t timestamp)
 			{
 				if(m_WorkerConfig.sslIPsLock.tryLock())
 				{
-					if(m_WorkerConfig.sslIPs->try_search_exact_ip(*dst_ip.get()))
+					uint32_t lpm_value;
+					bool lpm_found;
+					if(ip_version == 4)
+						lpm_found=m_WorkerConfig.sslIPs->lookup4(rte_be_to_cpu_32(ipv4_header->dst_addr), lpm_value);
+					else
+						lpm_found=m_WorkerConfig.sslIPs->lookup6(ipv6_header->dst_addr, lpm_value);
+					if(lpm_found)
 					{
 						m_WorkerConfig.sslIPsLock.unlock();
 						m_ThreadStats.matched_ssl_ip++;
-						_logger.debug("Blocking/Marking SSL client hello packet from %s:%d to %s:%d", src_ip->toString(),tcp_src_port,dst_ip->toString(),tcp_dst_port);
+						if(_logger.debug())
+							_logger.debug("Blocking/Marking SSL client hello packet from %s:%d to %s:%d", addrToString(ip_version, src_addr),tcp_src_port,addrToString(ip_version, dst_addr),tcp_dst_port);
 						m_ThreadStats.sended_rst++;
-						std::string empty_str;
-						SenderTask::queue.enqueueNotification(new RedirectNotification(tcp_src_port, tcp_dst_port,src_ip.get(), dst_ip.get(), /*acknum*/ tcph->ack_seq, /*seqnum*/ tcph->seq, 0, empty_str, true));
+						sendRST(m, flow_info, timestamp, l3, ip_version, tcp_src_port, tcp_dst_port, /*acknum*/ tcph->ack_seq, /*seqnum*/ tcph->seq);
+						logBlock(timestamp, l3, ip_version, tcp_src_port, tcp_dst_port, profile, B_LIST_SSL_IP, 0, B_ACTION_RST);
 						flow_info->block=true;
 						return true;
 					}
@@ -490,121 +766,184 @@ bool WorkerThread::analyzePacket(struct rte_mbuf* m, uint64_t timestamp)
 
 	if((flow_info->ndpi_flow->http.method == HTTP_METHOD_GET || flow_info->ndpi_flow->http.method == HTTP_METHOD_POST || flow_info->ndpi_flow->http.method == HTTP_METHOD_HEAD) && flow_info->ndpi_flow->http.url != NULL)
 	{
-		if(m_WorkerConfig.atm)
+		if(m_WorkerConfig.patternsDB)
 		{
 			if(m_WorkerConfig.atmLock.tryLock())
 			{
+				int norm_flags=0;
 				if(m_WorkerConfig.url_normalization)
+					norm_flags |= m_WorkerConfig.fast_url_normalization ? (URLNormalizer::NORM_URI | URLNormalizer::NORM_FAST) : URLNormalizer::NORM_URI;
+				else if(m_WorkerConfig.lower_host)
+					norm_flags |= URLNormalizer::NORM_LOWER_HOST;
+				if(m_WorkerConfig.remove_dot)
+					norm_flags |= URLNormalizer::NORM_STRIP_DOT;
+				_normalizer.normalize(flow_info->ndpi_flow->http.url, strlen(flow_info->ndpi_flow->http.url), norm_flags);
+				FlatAC::Cursor cursor;
+				FlatAC::Match match;
+				bool found=false;
+				bool found_domain=false;
+				size_t uri_length=_normalizer.length() - 7;
+				char const *uri_ptr=_normalizer.data() + 7; // skip http://
+				const entry_data *entry=nullptr;
+				const PatternDB *db=m_WorkerConfig.patternsDB;
+				// домен определяется только хостом, поэтому кэшируется по хосту: url с разными путями и
+				// параметрами одного хоста не вытесняют друг друга. url кэшируется отдельно и только
+				// для хостов, у которых есть url в списках
+				size_t host_length=uri_length;
+				const char *slash=(const char *) memchr(uri_ptr, '/', uri_length);
+				if(slash)
+					host_length=slash - uri_ptr;
+				uint32_t generation=m_WorkerConfig.patterns_generation.load(std::memory_order_relaxed);
+				uint64_t host_key=VerdictCache::hash(uri_ptr, host_length, VerdictCache::K_HTTP_HOST | (profile << 8));
+				uint8_t verdict;
+				uint32_t entry_id=0;
+				// базовый автомат и накладной с шаблонами, добавленными после его сборки
+				const FlatAC *automata[2]={ db->base.get(), db->overlay.get() };
+				m_ThreadStats.verdict_cache_lookups++;
+				if(_verdicts.find(host_key, generation, verdict, entry_id))
 				{
-					try
-					{
-						Poco::URI uri_p(flow_info->ndpi_flow->http.url);
-						uri_p.normalize();
-						uri.assign(uri_p.toString());
-					} catch (Poco::SyntaxException &ex)
-					{
-						uri.assign(flow_info->ndpi_flow->http.url);
-						_logger.debug("An SyntaxException occured: '%s' on URI: '%s'", ex.displayText(), uri);
-					}
+					m_ThreadStats.verdict_cache_hits++;
 				} else {
-					uri.assign(flow_info->ndpi_flow->http.url);
-				}
-				if(m_WorkerConfig.remove_dot || (!m_WorkerConfig.url_normalization && m_WorkerConfig.lower_host))
-				{
-					// remove dot after domain...
-					size_t f_slash_pos=uri.find('/',10);
-					if(!m_WorkerConfig.url_normalization && m_WorkerConfig.lower_host && f_slash_pos != std::string::npos)
+					verdict=VerdictCache::V_NONE;
+					for(int k=0; k < 2 && verdict == VerdictCache::V_NONE && automata[k]; k++)
 					{
-						std::transform(uri.begin()+7, uri.begin()+f_slash_pos, uri.begin()+7, ::tolower);
+						automata[k]->search(cursor, uri_ptr, host_length);
+						while(verdict == VerdictCache::V_NONE && automata[k]->findNext(cursor, match))
+						{
+							if(db->entries->find(match.id) == nullptr)
+								continue;
+							uint8_t eflags=db->entries->profileFlags(match.id, profile);
+							if(!(eflags & E_FLAGS_DOMAIN))
+								continue;
+							bool domain;
+							if(match.length == host_length)
+							{
+								domain=true;
+							} else {
+								int r=match.position-match.length;
+								bool boundary=(r == 0 || *(uri_ptr+r-1) == '.');
+								domain=((eflags & E_FLAG_DOMAIN_WILDCARD) && boundary) || ((eflags & E_FLAG_DOMAIN_EXACT) && r == 0);
+							}
+							if(domain)
+							{
+								verdict=VerdictCache::V_DOMAIN;
+								entry_id=match.id;
+							}
+						}
 					}
-					if(m_WorkerConfig.remove_dot && f_slash_pos != std::string::npos)
+					if(verdict == VerdictCache::V_NONE && (db->entries->flags() & E_FLAG_URL))
 					{
-						if(uri[f_slash_pos-1] == '.')
-							uri.erase(f_slash_pos-1,1);
+						bool host_urls;
+						if(db->urlIndex)
+							host_urls=db->urlIndex->hasHost(uri_ptr, host_length);
+						else if(db->urlHosts)
+							host_urls=db->urlHosts->match(uri_ptr, host_length);
+						else
+							host_urls=true; // база из снимка, хосты url неизвестны
+						if(host_urls)
+							verdict=VerdictCache::V_HOST_URLS;
 					}
+					_verdicts.insert(host_key, generation, verdict, entry_id);
 				}
-				AhoCorasickPlus::Match match;
-				bool found=false;
-				size_t uri_length=uri.length() - 7;
-				char const *uri_ptr=uri.c_str() + 7;
-				m_WorkerConfig.atm->search((char *)uri_ptr, uri_length, false); // skip http://
-				EntriesData::Iterator it;
-				while(m_WorkerConfig.atm->findNext(match) && !found)
+				if(verdict == VerdictCache::V_DOMAIN)
+				{
+					entry=db->entries->find(entry_id);
+					found=(entry != nullptr);
+					found_domain=found;
+				} else if(verdict == VerdictCache::V_HOST_URLS)
 				{
-					it=m_WorkerConfig.entriesData->find(match.id);
-					if(match.pattern.ptext.length != uri_length)
+					if(db->urlIndex)
 					{
-						int r=match.position-match.pattern.ptext.length;
-						if(it->second.type == E_TYPE_DOMAIN)
+						// точные url ищем в хэше, поиск в нем дешевле кэша
+						uint32_t url_id;
+						uint32_t probes;
+						m_ThreadStats.url_index_lookups++;
+						if(db->urlIndex->find(uri_ptr, uri_length, url_id, probes))
 						{
-							if(r > 0)
-							{
-								if(it->second.match_exactly)
-									continue;
-								if(*(uri_ptr+r-1) != '.')
-									continue;
-							}
-						} else if(it->second.type == E_TYPE_URL)
+							entry=db->entries->find(url_id);
+							found=(entry != nullptr && (db->entries->profileFlags(url_id, profile) & E_FLAG_URL));
+							m_ThreadStats.url_index_hits++;
+						}
+						m_ThreadStats.url_index_probes += probes;
+					} else {
+						uint64_t url_key=VerdictCache::hash(uri_ptr, uri_length, VerdictCache::K_HTTP | (profile << 8));
+						m_ThreadStats.verdict_cache_lookups++;
+						if(_verdicts.find(url_key, generation, verdict, entry_id))
 						{
-							if(m_WorkerConfig.match_url_exactly)
-								continue;
-							if(r > 0)
+							m_ThreadStats.verdict_cache_hits++;
+						} else {
+							verdict=VerdictCache::V_NONE;
+							for(int k=0; k < 2 && verdict == VerdictCache::V_NONE && automata[k]; k++)
 							{
-								if(*(uri_ptr+r-1) != '.')
-									continue;
+								automata[k]->search(cursor, uri_ptr, uri_length);
+								while(verdict == VerdictCache::V_NONE && automata[k]->findNext(cursor, match))
+								{
+									if(db->entries->find(match.id) == nullptr)
+										continue;
+									uint8_t eflags=db->entries->profileFlags(match.id, profile);
+									if(!(eflags & E_FLAG_URL))
+										continue;
+									bool url;
+									if(match.length == uri_length)
+									{
+										url=true;
+									} else {
+										int r=match.position-match.length;
+										url=!m_WorkerConfig.match_url_exactly && (r == 0 || *(uri_ptr+r-1) == '.');
+									}
+									if(url)
+									{
+										verdict=VerdictCache::V_URL;
+										entry_id=match.id;
+									}
+								}
 							}
+							_verdicts.insert(url_key, generation, verdict, entry_id);
+						}
+						if(verdict == VerdictCache::V_URL)
+						{
+							entry=db->entries->find(entry_id);
+							found=(entry != nullptr);
 						}
 					}
-					found=true;
 				}
 				m_WorkerConfig.atmLock.unlock();
 				if(found)
 				{
-					if(it->second.type == E_TYPE_DOMAIN) // block by domain...
+					if(found_domain) // block by domain...
 					{
 						m_ThreadStats.matched_domains++;
 //						_logger.debug("Host %s present in domain (file line %u) list from ip %s to ip %s", host, match.id, src_ip->toString(), dst_ip->toString());
 						if(m_WorkerConfig.http_redirect)
 						{
-							std::string add_param;
-							switch (m_WorkerConfig.add_p_type)
-							{
-								case A_TYPE_ID: add_param="id="+std::to_string(it->second.lineno);
-									break;
-								case A_TYPE_URL: add_param="url="+uri;
-									break;
-								default: break;
-							}
-							SenderTask::queue.enqueueNotification(new RedirectNotification(tcp_src_port, tcp_dst_port, src_ip.get(), dst_ip.get(), /*acknum*/ tcph->ack_seq, /*seqnum*/ rte_cpu_to_be_32(rte_be_to_cpu_32(tcph->seq)+payload_len),/* flag psh */ 1, add_param));
+							char add_param[SENDER_PARAM_MAX];
+							size_t add_param_length=redirectParam(entry, add_param, sizeof(add_param));
+							sendRedirect(m, flow_info, timestamp, l3, ip_version, tcp_src_port, tcp_dst_port, /*acknum*/ tcph->ack_seq, /*seqnum*/ rte_cpu_to_be_32(rte_be_to_cpu_32(tcph->seq)+payload_len),/* flag psh */ 1, add_param, add_param_length);
 							m_ThreadStats.redirected_domains++;
 						} else {
-							std::string empty_str;
-							SenderTask::queue.enqueueNotification(new RedirectNotification(tcp_src_port, tcp_dst_port,src_ip.get(), dst_ip.get(), /*acknum*/ tcph->ack_seq, /*seqnum*/ tcph->seq, 0, empty_str, true));
+							sendRST(m, flow_info, timestamp, l3, ip_version, tcp_src_port, tcp_dst_port, /*acknum*/ tcph->ack_seq, /*seqnum*/ tcph->seq);
 							m_ThreadStats.sended_rst++;
+							// с редиректом сервер не запоминаем: выученный адрес блокируется rst до http запроса
+							learnBlocked(ip_version, l3, tcp_dst_port, entry->lineno, timestamp);
 						}
+						logBlock(timestamp, l3, ip_version, tcp_src_port, tcp_dst_port, profile, B_LIST_DOMAIN, entry->lineno, m_WorkerConfig.http_redirect ? B_ACTION_REDIRECT : B_ACTION_RST);
+						flow_info->block=true;
 						return true;
-					} else if(it->second.type == E_TYPE_URL) // block by url...
+					} else // block by url...
 					{
 						m_ThreadStats.matched_urls++;
 //						_logger.debug("URL %s present in url (file pos %u) list from ip %s to ip %s", uri, match.id, src_ip->toString(), dst_ip->toString());
 						if(m_WorkerConfig.http_redirect)
 						{
-							std::string add_param;
-							switch (m_WorkerConfig.add_p_type)
-							{
-								case A_TYPE_ID: add_param="id="+std::to_string(it->second.lineno);
-									break;
-								case A_TYPE_URL: add_param="url="+uri;
-									break;
-								default: break;
-							}
-							SenderTask::queue.enqueueNotification(new RedirectNotification(tcp_src_port, tcp_dst_port, src_ip.get(), dst_ip.get(), /*acknum*/ tcph->ack_seq, /*seqnum*/ rte_cpu_to_be_32(rte_be_to_cpu_32(tcph->seq)+payload_len),/* flag psh */ 1, add_param));
+							char add_param[SENDER_PARAM_MAX];
+							size_t add_param_length=redirectParam(entry, add_param, sizeof(add_param));
+							sendRedirect(m, flow_info, timestamp, l3, ip_version, tcp_src_port, tcp_dst_port, /*acknum*/ tcph->ack_seq, /*seqnum*/ rte_cpu_to_be_32(rte_be_to_cpu_32(tcph->seq)+payload_len),/* flag psh */ 1, add_param, add_param_length);
 							m_ThreadStats.redirected_urls++;
 						} else {
-							std::string empty_str;
-							SenderTask::queue.enqueueNotification(new RedirectNotification(tcp_src_port, tcp_dst_port,src_ip.get(), dst_ip.get(), /*acknum*/ tcph->ack_seq, /*seqnum*/ tcph->seq, 0, empty_str, true));
+							sendRST(m, flow_info, timestamp, l3, ip_version, tcp_src_port, tcp_dst_port, /*acknum*/ tcph->ack_seq, /*seqnum*/ tcph->seq);
 							m_ThreadStats.sended_rst++;
 						}
+						logBlock(timestamp, l3, ip_version, tcp_src_port, tcp_dst_port, profile, B_LIST_URL, entry->lineno, m_WorkerConfig.http_redirect ? B_ACTION_REDIRECT : B_ACTION_RST);
 						flow_info->block=true;
 						return true;
 					}
@@ -650,6 +989,11 @@ bool WorkerThread::run(uint32_t coreId)
 		{
 			if(m_Stop)
 				break;
+			// нет входящих пакетов - отправляем накопленные ответы
+			if(m_WorkerConfig.injector)
+				m_WorkerConfig.injector->flush();
+			if(m_WorkerConfig.bridge)
+				m_WorkerConfig.bridge->flush();
 			rte_pause();
 		}
 		if (unlikely(buf == NULL))
@@ -661,12 +1005,29 @@ bool WorkerThread::run(uint32_t coreId)
 
 		// count received packets
 		m_ThreadStats.total_packets++;
-		analyzePacket(buf, last_time);
-		rte_pktmbuf_free(buf);
+		bool blocked=analyzePacket(buf, last_time);
+		if(m_WorkerConfig.bridge)
+		{
+			// в разрыве пакеты заблокированных соединений дальше не идут
+			_distr->done(_worker_id);
+			if(blocked)
+			{
+				m_ThreadStats.bridge_dropped++;
+				rte_pktmbuf_free(buf);
+			} else {
+				m_WorkerConfig.bridge->forward(buf);
+			}
+		} else {
+			rte_pktmbuf_free(buf);
+		}
 
 		diff_gc_tsc = cur_tsc - prev_gc_tsc;
 		if (unlikely(diff_gc_tsc >= gc_int_tsc))
 		{
+			if(m_WorkerConfig.injector)
+				m_WorkerConfig.injector->flush();
+			if(m_WorkerConfig.bridge)
+				m_WorkerConfig.bridge->flush();
 			int z=0;
 			while(z < gc_budget && iter_flows < n_flows)
 			{